@@ -0,0 +1,217 @@
+/***************************************************************************
+*                    MLTP Channel Pipeline Measurments
+*
+*   File    : mchan.c
+*   Purpose : measure message throughput of a pipeline of mltp threads
+*             connected by channels for a range of virtual processors.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mltp.h"
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+MLTP_CHAN_DECLARE(long, long)
+
+long_chan_t *chans;             /* channel feeding each stage and the sink */
+int stages;                     /* number of pipeline stages */
+long messages;                  /* number of messages sent through pipe */
+volatile long received;         /* number of messages reaching the sink */
+mltp_t **threads;               /* source, stages, and sink */
+int handoff;                    /* non-zero to mltp_yield_to the receiver */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Source
+*   Description: This function is the entry point for the thread that feeds
+*                the pipeline.  It sends the requested number of messages
+*                and then closes the first channel.
+*   Parameters : unused - not used
+*   Effects    : Messages are sent on the first channel.
+*   Returned   : NULL
+****************************************************************************/
+void *Source(void *unused)
+{
+    long i;
+
+    for (i = 0; i < messages; i++)
+    {
+        long_chan_send(&chans[0], i);
+
+        if (handoff)
+        {
+            mltp_yield_to(threads[1]);
+        }
+    }
+
+    mltp_chan_close(&(chans[0].chan));
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Stage
+*   Description: This function is the entry point for pipeline stages.  A
+*                stage passes every message it receives on to the next
+*                stage, closing its output once its input is closed.
+*   Parameters : id - stage number
+*   Effects    : Messages are moved from one channel to the next.
+*   Returned   : NULL
+****************************************************************************/
+void *Stage(void *id)
+{
+    long msg;
+    long_chan_t *in, *out;
+
+    in = &chans[(long)id];
+    out = &chans[(long)id + 1];
+
+    while (long_chan_recv(in, &msg) == 0)
+    {
+        long_chan_send(out, msg + 1);
+
+        if (handoff)
+        {
+            /* receiver of out is the next thread */
+            mltp_yield_to(threads[(long)id + 2]);
+        }
+    }
+
+    mltp_chan_close(&(out->chan));
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Sink
+*   Description: This function is the entry point for the thread at the end
+*                of the pipeline.  It counts the messages that make it all
+*                the way through.
+*   Parameters : unused - not used
+*   Effects    : received is set to the number of messages received.
+*   Returned   : NULL
+****************************************************************************/
+void *Sink(void *unused)
+{
+    long msg, count;
+
+    count = 0;
+
+    while (long_chan_recv(&chans[stages], &msg) == 0)
+    {
+        count++;
+    }
+
+    received = count;
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the channel benchmark.  It runs
+*                the pipeline once for each number of virtual processors
+*                from 1 to the requested maximum.  With handoff, each
+*                thread yields straight to the receiver it just woke.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Pipeline throughput is written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    struct timeval t1, t2;
+    double seconds;
+    int maxvps, capacity, nvps, i;
+
+    if ((argc != 5) && (argc != 6))
+    {
+        fprintf(stderr, "syntax: %s maxvps stages messages capacity "
+            "[handoff]\n", argv[0]);
+        fprintf(stderr, "\tcapacity of -1 is unbounded, 0 is unbuffered\n");
+        fprintf(stderr, "\thandoff of 1 uses mltp_yield_to after sends\n");
+        exit(1);
+    }
+
+    maxvps = atoi(argv[1]);
+    stages = atoi(argv[2]);
+    messages = atol(argv[3]);
+    capacity = atoi(argv[4]);
+    handoff = (argc == 6) ? atoi(argv[5]) : 0;
+
+    if ((maxvps < 1) || (stages < 0) || (messages < 1) ||
+        (capacity < MLTP_CHAN_UNBOUNDED))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    mltp_init();
+
+    chans = (long_chan_t *)malloc((stages + 1) * sizeof(long_chan_t));
+    threads = (mltp_t **)malloc((stages + 2) * sizeof(mltp_t *));
+
+    for (nvps = 1; nvps <= maxvps; nvps++)
+    {
+        for (i = 0; i <= stages; i++)
+        {
+            long_chan_init(&chans[i], capacity);
+        }
+
+        received = 0;
+        gettimeofday(&t1, NULL);
+
+        threads[0] = mltp_create(Source, NULL);
+
+        for (i = 0; i < stages; i++)
+        {
+            threads[i + 1] = mltp_create(Stage, (void *)(long)i);
+        }
+
+        threads[stages + 1] = mltp_create(Sink, NULL);
+
+        mltp_start(nvps);
+
+        gettimeofday(&t2, NULL);
+
+        for (i = 0; i < stages + 2; i++)
+        {
+            free(threads[i]);
+        }
+
+        for (i = 0; i <= stages; i++)
+        {
+            mltp_chan_destroy(&(chans[i].chan));
+        }
+
+        seconds = (double)(t2.tv_usec - t1.tv_usec)/1000000.0;
+        seconds += (double)(t2.tv_sec - t1.tv_sec);
+        printf("%d vps: %ld of %ld messages in %e seconds, ",
+            nvps, received, messages, seconds);
+        printf("%e messages/second\n", received / seconds);
+    }
+
+    free(threads);
+    free(chans);
+
+    return(0);
+}
@@ -0,0 +1,228 @@
+/***************************************************************************
+*                       MLTP Coroutine Measurments
+*
+*   File    : mcoro.c
+*   Purpose : compare passing values from a producer to a consumer with a
+*             coroutine generator against a pair of threads handing off
+*             with conditionals.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+long values;                    /* number of values produced */
+volatile long total;            /* sum of values consumed */
+
+/* conditional ping-pong state */
+mltp_cond_t emptyCond;          /* signalled when slot is emptied */
+mltp_cond_t fullCond;           /* signalled when slot is filled */
+volatile long slot;             /* value being passed */
+volatile int full;              /* non-zero if slot holds a value */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Generator
+*   Description: This function is the main function of the generator
+*                coroutine.  It yields each value in turn.
+*   Parameters : unused - not used
+*   Effects    : Values 1 to values are yielded.
+*   Returned   : NULL
+****************************************************************************/
+void *Generator(void *unused)
+{
+    long i;
+
+    for (i = 1; i <= values; i++)
+    {
+        mltp_coro_yield((void *)i);
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : CoroConsumer
+*   Description: This function is the entry point for the thread that
+*                consumes values from the generator coroutine.
+*   Parameters : unused - not used
+*   Effects    : total is set to the sum of the generated values.
+*   Returned   : NULL
+****************************************************************************/
+void *CoroConsumer(void *unused)
+{
+    mltp_coro_t *gen;
+    long sum;
+    void *value;
+
+    sum = 0;
+    gen = mltp_coro_create(Generator, NULL);
+
+    for (;;)
+    {
+        value = mltp_coro_resume(gen, NULL);
+
+        if (mltp_coro_done(gen))
+        {
+            break;
+        }
+
+        sum += (long)value;
+    }
+
+    mltp_coro_destroy(gen);
+    total = sum;
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : CondProducer
+*   Description: This function is the entry point for the thread that
+*                produces values for the conditional ping-pong.
+*   Parameters : unused - not used
+*   Effects    : Values 1 to values are passed through slot.
+*   Returned   : NULL
+****************************************************************************/
+void *CondProducer(void *unused)
+{
+    long i;
+
+    for (i = 1; i <= values; i++)
+    {
+        while (full)
+        {
+            mltp_cond_wait(&emptyCond);
+        }
+
+        slot = i;
+        full = 1;
+        mltp_cond_signal(&fullCond);
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : CondConsumer
+*   Description: This function is the entry point for the thread that
+*                consumes values in the conditional ping-pong.
+*   Parameters : unused - not used
+*   Effects    : total is set to the sum of the passed values.
+*   Returned   : NULL
+****************************************************************************/
+void *CondConsumer(void *unused)
+{
+    long i, sum;
+
+    sum = 0;
+
+    for (i = 1; i <= values; i++)
+    {
+        while (!full)
+        {
+            mltp_cond_wait(&fullCond);
+        }
+
+        sum += slot;
+        full = 0;
+        mltp_cond_signal(&emptyCond);
+    }
+
+    total = sum;
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the coroutine benchmark.  Both
+*                tests run on a single VP, so the conditional waits can't
+*                miss a signal.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    mltp_t *threads[2];
+    struct timeval t1, t2;
+    double seconds;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "syntax: %s values\n", argv[0]);
+        exit(1);
+    }
+
+    values = atol(argv[1]);
+
+    if (values < 1)
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    /* coroutine generator */
+    mltp_init();
+    total = 0;
+    threads[0] = mltp_create(CoroConsumer, NULL);
+
+    gettimeofday(&t1, NULL);
+    mltp_start(1);
+    gettimeofday(&t2, NULL);
+
+    free(threads[0]);
+
+    seconds = Elapsed(&t1, &t2);
+    printf("coroutine:   sum %ld, %e seconds/value\n", total,
+        seconds / values);
+
+    /* conditional ping-pong */
+    mltp_init();
+    mltp_cond_init(&emptyCond);
+    mltp_cond_init(&fullCond);
+    total = 0;
+    full = 0;
+    threads[0] = mltp_create(CondProducer, NULL);
+    threads[1] = mltp_create(CondConsumer, NULL);
+
+    gettimeofday(&t1, NULL);
+    mltp_start(1);
+    gettimeofday(&t2, NULL);
+
+    free(threads[0]);
+    free(threads[1]);
+
+    seconds = Elapsed(&t1, &t2);
+    printf("conditional: sum %ld, %e seconds/value\n", total,
+        seconds / values);
+
+    return(0);
+}
@@ -0,0 +1,177 @@
+/***************************************************************************
+*                       MLTP Thread Creation Measurments
+*
+*   File    : mcreate.c
+*   Purpose : measure the time and memory it takes to create unbound
+*             threads one at a time and with mltp_create_n, and what it
+*             costs threads to use private storage and thread-specific
+*             data keys, which are set up on demand.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                            TYPE DEFINITIONS
+***************************************************************************/
+typedef enum
+{
+    USE_NONE,                   /* threads use no thread-specific data */
+    USE_PRIVATE,                /* threads write their private storage */
+    USE_KEY,                    /* threads set a thread-specific data key */
+    USE_BATCH,                  /* like USE_NONE, created by mltp_create_n */
+    USE_KINDS
+} use_t;
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+const char *useNames[USE_KINDS] =
+{
+    "none", "private", "key", "batch"
+};
+
+mltp_key_t key;                 /* key set by USE_KEY threads */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Worker
+*   Description: This function is the entry point for the created threads.
+*                It uses thread-specific data as selected by use.
+*   Parameters : use - kind of thread-specific data to use (a use_t)
+*   Effects    : None
+*   Returned   : NULL
+****************************************************************************/
+void *Worker(void *use)
+{
+    mltp_vp_local_t *mltp_vp_local;
+    long *private;
+
+    switch ((long)use)
+    {
+        case USE_PRIVATE:
+            MLTP_PREEMPT_OFF();
+            mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+            private = (long *)mltp_get_private();
+            MLTP_PREEMPT_ON();
+            private[0]++;
+            break;
+
+        case USE_KEY:
+            mltp_setspecific(key, use);
+            break;
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the creation benchmark.  For
+*                each kind of use it creates the threads, measuring the
+*                time and resident memory taken, then runs them.  The
+*                batch threads are created with one call to mltp_create_n.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    mltp_t **threads;
+    struct timeval t1, t2, t3;
+    long nthreads, before, after, i;
+    int vps, use;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "syntax: %s threads vps\n", argv[0]);
+        exit(1);
+    }
+
+    nthreads = atol(argv[1]);
+    vps = atoi(argv[2]);
+
+    if ((nthreads < 1) || (vps < 1))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    threads = (mltp_t **)malloc(nthreads * sizeof(mltp_t *));
+
+    if (threads == NULL)
+    {
+        fprintf(stderr, "error: failed to allocate thread handles\n");
+        exit(1);
+    }
+
+    mltp_init();
+
+    if (mltp_key_create(&key, NULL) != 0)
+    {
+        fprintf(stderr, "error: failed to create key\n");
+        exit(1);
+    }
+
+    printf("%-8s %14s %14s %14s\n", "use", "sec/create", "bytes/thread",
+        "sec/run");
+
+    for (use = 0; use < USE_KINDS; use++)
+    {
+        before = ResidentBytes();
+        gettimeofday(&t1, NULL);
+
+        if (use == USE_BATCH)
+        {
+            mltp_create_n(nthreads, Worker, NULL, threads);
+        }
+        else
+        {
+            for (i = 0; i < nthreads; i++)
+            {
+                threads[i] = mltp_create(Worker, (void *)(long)use);
+            }
+        }
+
+        gettimeofday(&t2, NULL);
+        after = ResidentBytes();
+
+        mltp_start(vps);
+        gettimeofday(&t3, NULL);
+
+        for (i = 0; i < nthreads; i++)
+        {
+            free(threads[i]);
+        }
+
+        printf("%-8s %14e %14ld %14e\n", useNames[use],
+            Elapsed(&t1, &t2) / nthreads, (after - before) / nthreads,
+            Elapsed(&t2, &t3) / nthreads);
+    }
+
+    mltp_key_delete(key);
+    free(threads);
+    return(0);
+}
@@ -0,0 +1,145 @@
+/***************************************************************************
+*                       MLTP Dispatch Measurments
+*
+*   File    : mdispatch.c
+*   Purpose : measure how fast the work stealing policy dispatches many
+*             tiny threads, and how many run queue locks its VPs take per
+*             thread run.  The threads are created by one thread, so the
+*             other VPs have to steal them.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+int nthreads;                   /* number of tiny threads per run */
+mltp_t **threads;               /* tiny thread handles */
+volatile long work;             /* incremented by every tiny thread */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Tiny
+*   Description: This function is the entry point for the tiny threads.
+*                They do almost nothing, so dispatch costs dominate.
+*   Parameters : unused - not used
+*   Effects    : work is incremented.
+*   Returned   : NULL
+****************************************************************************/
+void *Tiny(void *unused)
+{
+    mltp_atomic_fetch_add(&work, 1, MLTP_RELAXED);
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Creator
+*   Description: This function is the entry point for the thread that
+*                creates all of the tiny threads.
+*   Parameters : unused - not used
+*   Effects    : nthreads tiny threads are made runnable.
+*   Returned   : NULL
+****************************************************************************/
+void *Creator(void *unused)
+{
+    mltp_create_n(nthreads, Tiny, NULL, threads);
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the dispatch benchmark.  For
+*                1 VP up to the number given, it times the tiny threads
+*                and reports the run queue locks taken per thread run.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    struct timeval t1, t2;
+    unsigned long locks, runs;
+    mltp_t *creator;
+    int i, vps, maxVps;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "syntax: %s threads max_vps\n", argv[0]);
+        exit(1);
+    }
+
+    nthreads = atoi(argv[1]);
+    maxVps = atoi(argv[2]);
+
+    if ((nthreads < 1) || (maxVps < 1))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    threads = (mltp_t **)malloc(nthreads * sizeof(mltp_t *));
+
+    if (threads == NULL)
+    {
+        fprintf(stderr, "error: failed to allocate thread handles\n");
+        exit(1);
+    }
+
+    printf("%-6s %14s %14s\n", "vps", "sec/thread", "locks/thread");
+
+    for (vps = 1; vps <= maxVps; vps *= 2)
+    {
+        mltp_init_sched(&mltp_sched_steal);
+        work = 0;
+
+        creator = mltp_create(Creator, NULL);
+
+        gettimeofday(&t1, NULL);
+        mltp_start(vps);
+        gettimeofday(&t2, NULL);
+
+        mltp_steal_stats(&locks, &runs);
+
+        if (work != nthreads)
+        {
+            fprintf(stderr, "error: %ld of %d threads ran\n", work,
+                nthreads);
+        }
+
+        printf("%-6d %14e %14f\n", vps, Elapsed(&t1, &t2) / nthreads,
+            (double)locks / runs);
+
+        free(creator);
+
+        for (i = 0; i < nthreads; i++)
+        {
+            free(threads[i]);
+        }
+    }
+
+    free(threads);
+    return(0);
+}
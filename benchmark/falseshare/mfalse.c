@@ -0,0 +1,212 @@
+/***************************************************************************
+*                       MLTP False Sharing Measurments
+*
+*   File    : mfalse.c
+*   Purpose : measure the cost of VPs writing to data on shared cache
+*             lines, and the dispatch rate of the per-VP run queues, which
+*             are kept on cache lines of their own.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                                CONSTANTS
+***************************************************************************/
+#define MAX_VPS         64      /* largest number of VPs tested */
+#define YIELDERS        4       /* yielding threads per VP */
+
+/***************************************************************************
+*                            TYPE DEFINITIONS
+***************************************************************************/
+/* a counter alone on its cache line */
+typedef struct
+{
+    volatile long value;
+} MLTP_CACHE_ALIGNED padded_count_t;
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+long iterations;                        /* writes or yields per thread */
+volatile long packed[MAX_VPS];          /* counters sharing cache lines */
+padded_count_t padded[MAX_VPS];         /* counters on lines of their own */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : PackedWriter
+*   Description: This function is the entry point for threads incrementing
+*                a counter that shares its cache line with other threads'
+*                counters.
+*   Parameters : id - index of the thread's counter
+*   Effects    : packed[id] is incremented iterations times.
+*   Returned   : NULL
+****************************************************************************/
+void *PackedWriter(void *id)
+{
+    long i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        packed[(long)id]++;
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : PaddedWriter
+*   Description: This function is the entry point for threads incrementing
+*                a counter on a cache line of its own.
+*   Parameters : id - index of the thread's counter
+*   Effects    : padded[id] is incremented iterations times.
+*   Returned   : NULL
+****************************************************************************/
+void *PaddedWriter(void *id)
+{
+    long i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        padded[(long)id].value++;
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Yielder
+*   Description: This function is the entry point for threads that yield
+*                in a loop, so VPs keep taking threads off and putting them
+*                back on their own run queues.
+*   Parameters : unused - not used
+*   Effects    : None
+*   Returned   : NULL
+****************************************************************************/
+void *Yielder(void *unused)
+{
+    long i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        mltp_yield();
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Run
+*   Description: This function runs nthreads threads with the same main
+*                function on vps VPs under the work stealing policy.
+*   Parameters : func - threads' main function
+*                nthreads - number of threads
+*                vps - number of VPs
+*   Effects    : The threads are created and run to completion.
+*   Returned   : Seconds taken by mltp_start
+****************************************************************************/
+double Run(mltp_userf_t *func, int nthreads, int vps)
+{
+    mltp_t **threads;
+    struct timeval t1, t2;
+    long i;
+
+    threads = (mltp_t **)malloc(nthreads * sizeof(mltp_t *));
+
+    if (threads == NULL)
+    {
+        fprintf(stderr, "error: failed to allocate thread handles\n");
+        exit(1);
+    }
+
+    mltp_init_sched(&mltp_sched_steal);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        threads[i] = mltp_create(func, (void *)(i % MAX_VPS));
+    }
+
+    gettimeofday(&t1, NULL);
+    mltp_start(vps);
+    gettimeofday(&t2, NULL);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        free(threads[i]);
+    }
+
+    free(threads);
+    return Elapsed(&t1, &t2);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the false sharing benchmark.
+*                For 8 to 64 VPs (up to the number given) it times one
+*                writer per VP on packed and padded counters, then
+*                YIELDERS yielding threads per VP.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    double packedSecs, paddedSecs, yieldSecs;
+    int vps, maxVps;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "syntax: %s iterations max_vps\n", argv[0]);
+        exit(1);
+    }
+
+    iterations = atol(argv[1]);
+    maxVps = atoi(argv[2]);
+
+    if ((iterations < 1) || (maxVps < 8) || (maxVps > MAX_VPS))
+    {
+        fprintf(stderr, "error: bad argument, max_vps must be 8 to %d\n",
+            MAX_VPS);
+        exit(1);
+    }
+
+    printf("%-6s %14s %14s %14s\n", "vps", "packed/write", "padded/write",
+        "sec/yield");
+
+    for (vps = 8; vps <= maxVps; vps *= 2)
+    {
+        packedSecs = Run(PackedWriter, vps, vps) / iterations;
+        paddedSecs = Run(PaddedWriter, vps, vps) / iterations;
+        yieldSecs = Run(Yielder, vps * YIELDERS, vps) /
+            ((double)iterations * vps * YIELDERS);
+
+        printf("%-6d %14e %14e %14e\n", vps, packedSecs, paddedSecs,
+            yieldSecs);
+    }
+
+    return(0);
+}
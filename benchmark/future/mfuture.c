@@ -0,0 +1,272 @@
+/***************************************************************************
+*                  MLTP Future Fan-Out/Fan-In Measurments
+*
+*   File    : mfuture.c
+*   Purpose : measure fan-out/fan-in latency of mltp futures against the
+*             same pattern built from mltp conditionals.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mltp.h"
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+int workers;                    /* number of worker threads */
+int rounds;                     /* number of fan-out/fan-in rounds */
+
+/* future version: one go future per round, one done future per worker */
+mltp_future_t *go;
+mltp_future_t **done;
+
+/* conditional version */
+mltp_cond_t goCond;             /* workers wait here for the next round */
+volatile int goRound;           /* round workers may start */
+volatile int acks;              /* number of rounds finished by workers */
+mltp_lock_t ackLock;            /* protects acks */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : FutureWorker
+*   Description: This function is the entry point for worker threads in
+*                the futures test.  Each round the worker waits for the go
+*                future and then sets its done future.
+*   Parameters : id - worker number
+*   Effects    : Sets done futures for this worker.
+*   Returned   : NULL
+****************************************************************************/
+void *FutureWorker(void *id)
+{
+    int r;
+
+    for (r = 0; r < rounds; r++)
+    {
+        mltp_future_get(&go[r]);
+        mltp_future_set(&done[r][(long)id], NULL);
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : FutureCoordinator
+*   Description: This function is the entry point for the coordinating
+*                thread in the futures test.  Each round it sets the go
+*                future (fan-out) and then waits for all done futures
+*                (fan-in).
+*   Parameters : unused - not used
+*   Effects    : Sets go futures.
+*   Returned   : NULL
+****************************************************************************/
+void *FutureCoordinator(void *unused)
+{
+    mltp_future_t **all;
+    int r, i;
+
+    all = (mltp_future_t **)malloc(workers * sizeof(mltp_future_t *));
+
+    for (r = 0; r < rounds; r++)
+    {
+        for (i = 0; i < workers; i++)
+        {
+            all[i] = &done[r][i];
+        }
+
+        mltp_future_set(&go[r], NULL);
+        mltp_future_when_all(all, workers);
+    }
+
+    free(all);
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : CondWorker
+*   Description: This function is the entry point for worker threads in
+*                the conditional test.  Each round the worker waits for the
+*                round number to advance and then acknowledges it.
+*   Parameters : unused - not used
+*   Effects    : Increments acks once per round.
+*   Returned   : NULL
+****************************************************************************/
+void *CondWorker(void *unused)
+{
+    int r;
+
+    for (r = 1; r <= rounds; r++)
+    {
+        while (goRound < r)
+        {
+            mltp_cond_wait(&goCond);
+        }
+
+        mltp_lock(&ackLock);
+        acks++;
+        mltp_unlock(&ackLock);
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : CondCoordinator
+*   Description: This function is the entry point for the coordinating
+*                thread in the conditional test.  mltp_cond_wait has no
+*                lock to close the window between a waiter testing the round
+*                and being queued on the conditional, so the coordinator
+*                must keep broadcasting and polling the acknowledgements
+*                until every worker has finished the round.
+*   Parameters : unused - not used
+*   Effects    : Advances round.
+*   Returned   : NULL
+****************************************************************************/
+void *CondCoordinator(void *unused)
+{
+    int r;
+
+    for (r = 1; r <= rounds; r++)
+    {
+        goRound = r;
+
+        while (acks < r * workers)
+        {
+            mltp_cond_broadcast(&goCond);
+            mltp_yield();
+        }
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : RunTest
+*   Description: This function creates a coordinator and the workers, runs
+*                them and reports the time per round.
+*   Parameters : name - name of test
+*                coordinator - coordinator thread function
+*                worker - worker thread function
+*                nvps - number of virtual processors
+*   Effects    : Runs test and writes results to stdout.
+*   Returned   : None
+****************************************************************************/
+void RunTest(char *name, mltp_userf_t *coordinator, mltp_userf_t *worker,
+    int nvps)
+{
+    mltp_t **threads;
+    struct timeval t1, t2;
+    double seconds;
+    int i;
+
+    threads = (mltp_t **)malloc((workers + 1) * sizeof(mltp_t *));
+
+    gettimeofday(&t1, NULL);
+
+    threads[0] = mltp_create(coordinator, NULL);
+
+    for (i = 1; i <= workers; i++)
+    {
+        threads[i] = mltp_create(worker, (void *)(long)(i - 1));
+    }
+
+    mltp_start(nvps);
+
+    gettimeofday(&t2, NULL);
+
+    for (i = 0; i <= workers; i++)
+    {
+        free(threads[i]);
+    }
+    free(threads);
+
+    seconds = (double)(t2.tv_usec - t1.tv_usec)/1000000.0;
+    seconds += (double)(t2.tv_sec - t1.tv_sec);
+    printf("%-12s %d workers, %d vps: %e seconds, %e seconds per round\n",
+        name, workers, nvps, seconds, seconds / rounds);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the future benchmark.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Runs the futures and conditionals tests.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    int nvps, r, i;
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "syntax: %s vps workers rounds\n", argv[0]);
+        exit(1);
+    }
+
+    nvps = atoi(argv[1]);
+    workers = atoi(argv[2]);
+    rounds = atoi(argv[3]);
+
+    if ((nvps < 1) || (workers < 1) || (rounds < 1))
+    {
+        fprintf(stderr, "error: all arguments must be greater than 0\n");
+        exit(1);
+    }
+
+    mltp_init();
+
+    /* futures can only be set once, so every round gets its own */
+    go = (mltp_future_t *)malloc(rounds * sizeof(mltp_future_t));
+    done = (mltp_future_t **)malloc(rounds * sizeof(mltp_future_t *));
+
+    for (r = 0; r < rounds; r++)
+    {
+        mltp_future_init(&go[r]);
+        done[r] = (mltp_future_t *)malloc(workers * sizeof(mltp_future_t));
+
+        for (i = 0; i < workers; i++)
+        {
+            mltp_future_init(&done[r][i]);
+        }
+    }
+
+    RunTest("futures", FutureCoordinator, FutureWorker, nvps);
+
+    for (r = 0; r < rounds; r++)
+    {
+        free(done[r]);
+    }
+    free(done);
+    free(go);
+
+    mltp_cond_init(&goCond);
+    mltp_lock_init(&ackLock, MLTP_LOCK_STD);
+    goRound = 0;
+    acks = 0;
+
+    RunTest("conditionals", CondCoordinator, CondWorker, nvps);
+
+    return(0);
+}
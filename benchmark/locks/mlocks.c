@@ -0,0 +1,205 @@
+/***************************************************************************
+*                         MLTP Lock Measurments
+*
+*   File    : mlocks.c
+*   Purpose : compare the cost of locks whose class is chosen at run time
+*             (mltp_lock_t) with the statically typed locks (mltp_spinlock_t
+*             and mltp_mutex_t), both uncontended and contended.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                            TYPE DEFINITIONS
+***************************************************************************/
+typedef enum
+{
+    LOCK_SPIN,                  /* mltp_lock_t, MLTP_LOCK_SPIN */
+    LOCK_BLOCK,                 /* mltp_lock_t, MLTP_LOCK_BLOCK */
+    LOCK_SPINLOCK,              /* mltp_spinlock_t */
+    LOCK_MUTEX,                 /* mltp_mutex_t */
+    LOCK_KINDS
+} lock_kind_t;
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+const char *kindNames[LOCK_KINDS] =
+{
+    "spin", "block", "spinlock_t", "mutex_t"
+};
+
+long iterations;                /* lock/unlock pairs per thread */
+volatile long count;            /* incremented while holding the lock */
+
+mltp_lock_t spinLock;
+mltp_lock_t blockLock;
+mltp_spinlock_t spinlock;
+mltp_mutex_t mutex;
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Worker
+*   Description: This function is the entry point for the threads that
+*                take one kind of lock iterations times.
+*   Parameters : kind - kind of lock to take (a lock_kind_t)
+*   Effects    : count is incremented iterations times.
+*   Returned   : NULL
+****************************************************************************/
+void *Worker(void *kind)
+{
+    long i;
+
+    switch ((long)kind)
+    {
+        case LOCK_SPIN:
+            for (i = 0; i < iterations; i++)
+            {
+                mltp_lock(&spinLock);
+                count++;
+                mltp_unlock(&spinLock);
+            }
+            break;
+
+        case LOCK_BLOCK:
+            for (i = 0; i < iterations; i++)
+            {
+                mltp_lock(&blockLock);
+                count++;
+                mltp_unlock(&blockLock);
+            }
+            break;
+
+        case LOCK_SPINLOCK:
+            for (i = 0; i < iterations; i++)
+            {
+                mltp_spinlock_lock(&spinlock);
+                count++;
+                mltp_spinlock_unlock(&spinlock);
+            }
+            break;
+
+        case LOCK_MUTEX:
+            for (i = 0; i < iterations; i++)
+            {
+                mltp_mutex_lock(&mutex);
+                count++;
+                mltp_mutex_unlock(&mutex);
+            }
+            break;
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the lock benchmark.  Each kind
+*                of lock is timed with one thread on one VP, then with one
+*                thread per VP.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    mltp_t **threads;
+    struct timeval t1, t2;
+    double seconds;
+    long kind;
+    int vps, run, nthreads, i;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "syntax: %s iterations vps\n", argv[0]);
+        exit(1);
+    }
+
+    iterations = atol(argv[1]);
+    vps = atoi(argv[2]);
+
+    if ((iterations < 1) || (vps < 1))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    threads = (mltp_t **)malloc(vps * sizeof(mltp_t *));
+
+    if (threads == NULL)
+    {
+        fprintf(stderr, "error: failed to allocate thread handles\n");
+        exit(1);
+    }
+
+    printf("%-12s %14s %14s\n", "lock", "uncontended", "contended");
+
+    for (kind = 0; kind < LOCK_KINDS; kind++)
+    {
+        printf("%-12s", kindNames[kind]);
+
+        /* run 0 is uncontended, run 1 is contended */
+        for (run = 0; run < 2; run++)
+        {
+            nthreads = (run == 0) ? 1 : vps;
+
+            mltp_init();
+            mltp_lock_init(&spinLock, MLTP_LOCK_SPIN);
+            mltp_lock_init(&blockLock, MLTP_LOCK_BLOCK);
+            mltp_spinlock_init(&spinlock);
+            mltp_mutex_init(&mutex);
+            count = 0;
+
+            for (i = 0; i < nthreads; i++)
+            {
+                threads[i] = mltp_create(Worker, (void *)kind);
+            }
+
+            gettimeofday(&t1, NULL);
+            mltp_start(nthreads);
+            gettimeofday(&t2, NULL);
+
+            for (i = 0; i < nthreads; i++)
+            {
+                free(threads[i]);
+            }
+
+            if (count != nthreads * iterations)
+            {
+                fprintf(stderr, "error: %s count is %ld, expected %ld\n",
+                    kindNames[kind], count, nthreads * iterations);
+            }
+
+            /* seconds per lock/unlock pair */
+            seconds = Elapsed(&t1, &t2) / (nthreads * iterations);
+            printf(" %14e", seconds);
+        }
+
+        printf("\n");
+    }
+
+    free(threads);
+    return(0);
+}
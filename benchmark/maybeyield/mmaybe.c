@@ -0,0 +1,225 @@
+/***************************************************************************
+*                    MLTP Cooperative Preemption Point Measurments
+*
+*   File    : mmaybe.c
+*   Purpose : measure the cost of mltp_maybe_yield in a compute loop and
+*             how it lets compute threads share fewer VPs.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                            TYPE DEFINITIONS
+***************************************************************************/
+typedef enum
+{
+    LOOP_PLAIN,             /* no preemption point */
+    LOOP_MAYBE,             /* call mltp_maybe_yield each iteration */
+    LOOP_YIELD              /* call mltp_yield each iteration */
+} loop_t;
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+long iterations;                /* loop iterations per thread */
+loop_t loopType;                /* what the loop calls each iteration */
+struct timeval start;           /* time threads were started */
+double *finish;                 /* time each thread finished (seconds) */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Compute
+*   Description: This function is the entry point for compute threads.  It
+*                runs a simple loop with or without a preemption point.
+*   Parameters : id - thread number
+*   Effects    : Thread's finish time is recorded.
+*   Returned   : NULL
+****************************************************************************/
+void *Compute(void *id)
+{
+    struct timeval now;
+    volatile long sum;
+    long i;
+
+    sum = 0;
+
+    switch (loopType)
+    {
+        case LOOP_PLAIN:
+            for (i = 0; i < iterations; i++)
+            {
+                sum += i;
+            }
+            break;
+
+        case LOOP_MAYBE:
+            for (i = 0; i < iterations; i++)
+            {
+                sum += i;
+                mltp_maybe_yield();
+            }
+            break;
+
+        case LOOP_YIELD:
+            for (i = 0; i < iterations; i++)
+            {
+                sum += i;
+                mltp_yield();
+            }
+            break;
+    }
+
+    gettimeofday(&now, NULL);
+    finish[(long)id] = Elapsed(&start, &now);
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Run
+*   Description: This function runs a set of compute threads to completion.
+*   Parameters : vps - number of virtual processors
+*                nthreads - number of compute threads
+*                type - what the loop calls each iteration
+*                quantum - mltp_maybe_yield quantum (usec)
+*   Effects    : finish holds the finish time of each thread.
+*   Returned   : Total run time in seconds
+****************************************************************************/
+double Run(int vps, int nthreads, loop_t type, long quantum)
+{
+    mltp_t **threads;
+    struct timeval end;
+    int i;
+
+    mltp_init();
+    mltp_set_yield_quantum(quantum);
+    loopType = type;
+
+    threads = (mltp_t **)malloc(nthreads * sizeof(mltp_t *));
+
+    for (i = 0; i < nthreads; i++)
+    {
+        threads[i] = mltp_create(Compute, (void *)(long)i);
+    }
+
+    gettimeofday(&start, NULL);
+    mltp_start(vps);
+    gettimeofday(&end, NULL);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        free(threads[i]);
+    }
+
+    free(threads);
+
+    return Elapsed(&start, &end);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the mltp_maybe_yield benchmark.
+*                It first times a single thread loop with no preemption
+*                point, mltp_maybe_yield, and mltp_yield.  Then it runs
+*                more compute threads than VPs and reports how far apart
+*                the first and last threads finish, with and without a
+*                quantum.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    double seconds, first, last;
+    int vps, nthreads, q, i;
+    long quanta[2];
+
+    if (argc != 5)
+    {
+        fprintf(stderr, "syntax: %s vps threads iterations quantum(usec)\n",
+            argv[0]);
+        exit(1);
+    }
+
+    vps = atoi(argv[1]);
+    nthreads = atoi(argv[2]);
+    iterations = atol(argv[3]);
+    quanta[0] = 0;
+    quanta[1] = atol(argv[4]);
+
+    if ((vps < 1) || (nthreads < 1) || (iterations < 1) || (quanta[1] < 1))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    finish = (double *)malloc(nthreads * sizeof(double));
+
+    /* cost per iteration of one thread on one VP */
+    seconds = Run(1, 1, LOOP_PLAIN, 0);
+    printf("plain loop:              %e seconds/iteration\n",
+        seconds / iterations);
+
+    seconds = Run(1, 1, LOOP_MAYBE, 0);
+    printf("mltp_maybe_yield:        %e seconds/iteration\n",
+        seconds / iterations);
+
+    seconds = Run(1, 1, LOOP_MAYBE, quanta[1]);
+    printf("mltp_maybe_yield ticker: %e seconds/iteration\n",
+        seconds / iterations);
+
+    seconds = Run(1, 1, LOOP_YIELD, 0);
+    printf("mltp_yield:              %e seconds/iteration\n",
+        seconds / iterations);
+
+    /* sharing VPs between more threads */
+    for (q = 0; q < 2; q++)
+    {
+        seconds = Run(vps, nthreads, LOOP_MAYBE, quanta[q]);
+
+        first = last = finish[0];
+
+        for (i = 1; i < nthreads; i++)
+        {
+            if (finish[i] < first)
+            {
+                first = finish[i];
+            }
+
+            if (finish[i] > last)
+            {
+                last = finish[i];
+            }
+        }
+
+        printf("quantum %ld usec: %d threads on %d vps, first done %e, "
+            "last done %e seconds\n", quanta[q], nthreads, vps, first, last);
+    }
+
+    free(finish);
+
+    return(0);
+}
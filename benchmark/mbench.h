@@ -0,0 +1,80 @@
+/***************************************************************************
+*                       MLTP Benchmark Helpers
+*
+*   File    : mbench.h
+*   Purpose : timing and memory measurement functions shared by the mltp
+*             benchmarks
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+#ifndef MBENCH_H
+#define MBENCH_H
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Elapsed
+*   Description: This function computes the number of seconds between two
+*                times.
+*   Parameters : t1 - earlier time
+*                t2 - later time
+*   Effects    : None
+*   Returned   : Seconds from t1 to t2
+****************************************************************************/
+static __inline__ double Elapsed(struct timeval *t1, struct timeval *t2)
+{
+    double seconds;
+
+    seconds = (double)(t2->tv_usec - t1->tv_usec)/1000000.0;
+    seconds += (double)(t2->tv_sec - t1->tv_sec);
+    return(seconds);
+}
+
+
+/****************************************************************************
+*   Function   : ResidentBytes
+*   Description: This function reads the resident set size of the process.
+*   Parameters : None
+*   Effects    : None
+*   Returned   : Resident bytes, or 0 if they can't be read
+****************************************************************************/
+static __inline__ long ResidentBytes(void)
+{
+    FILE *fp;
+    long size, resident;
+
+    fp = fopen("/proc/self/statm", "r");
+
+    if (fp == NULL)
+    {
+        return(0);
+    }
+
+    if (fscanf(fp, "%ld %ld", &size, &resident) != 2)
+    {
+        resident = 0;
+    }
+
+    fclose(fp);
+    return(resident * sysconf(_SC_PAGESIZE));
+}
+
+#endif /* MBENCH_H */
@@ -0,0 +1,307 @@
+/***************************************************************************
+*                    MLTP Priority Tail Latency Measurments
+*
+*   File    : mprio.c
+*   Purpose : measure how long high priority request threads wait to run
+*             while low priority batch threads keep every VP busy.  Batch
+*             threads either yield, comparing the FIFO and priority
+*             policies, or never yield, comparing the priority policy
+*             without and with time slice preemption.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+MLTP_CHAN_DECLARE(stamp, struct timeval)
+
+stamp_chan_t *chans;            /* one channel per request thread */
+int requesters;                 /* number of request threads */
+int batchers;                   /* number of batch threads */
+long requests;                  /* number of requests sent */
+long interval;                  /* microseconds between requests */
+long work;                      /* batch loop iterations between yields,
+                                   or in all if they never yield */
+long quantum;                   /* preemption quantum (usec), 0 if batch
+                                   threads yield */
+
+double *latency;                /* latency of each request (seconds) */
+volatile long received;         /* requests received */
+volatile int started;           /* request threads that are running */
+volatile int done;              /* non-zero when batch threads should quit */
+mltp_lock_t count_lock;         /* lock for started */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Batch
+*   Description: This function is the entry point for low priority batch
+*                threads.  They burn CPU, yielding every so often, until
+*                the requests are done.  When preemption is being measured
+*                they loop work times without ever yielding, so only
+*                preemption lets anything else run on their VP.
+*   Parameters : unused - not used
+*   Effects    : VPs are kept busy.
+*   Returned   : NULL
+****************************************************************************/
+void *Batch(void *unused)
+{
+    volatile long sum;
+    long i;
+
+    sum = 0;
+
+    if (quantum)
+    {
+        for (i = 0; i < work; i++)
+        {
+            sum += i;
+        }
+
+        return(NULL);
+    }
+
+    while (!done)
+    {
+        for (i = 0; i < work; i++)
+        {
+            sum += i;
+        }
+
+        mltp_yield();
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Request
+*   Description: This function is the entry point for high priority request
+*                threads.  They record how long each request took from the
+*                time it was sent until the thread got to run.
+*   Parameters : id - request thread number
+*   Effects    : Latencies are stored.
+*   Returned   : NULL
+****************************************************************************/
+void *Request(void *id)
+{
+    struct timeval sent, now;
+    long old;
+
+    mltp_lock(&count_lock);
+    started++;
+    mltp_unlock(&count_lock);
+
+    while (stamp_chan_recv(&chans[(long)id], &sent) == 0)
+    {
+        gettimeofday(&now, NULL);
+
+        do
+        {
+            old = received;
+        } while (!mltp_compare_and_swap(old, old + 1, &received));
+
+        latency[old] = Elapsed(&sent, &now);
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Producer
+*   Description: This function is the entry point for the bound thread that
+*                sends requests at a fixed interval.
+*   Parameters : unused - not used
+*   Effects    : Requests are sent, then all channels are closed and batch
+*                threads are told to quit.
+*   Returned   : None
+****************************************************************************/
+void Producer(void *unused)
+{
+    struct timeval start, now;
+    long i;
+
+    while (started < requesters)
+    {
+        sched_yield();
+    }
+
+    gettimeofday(&start, NULL);
+
+    for (i = 0; i < requests; i++)
+    {
+        /* wait for the next send time */
+        do
+        {
+            gettimeofday(&now, NULL);
+        } while (Elapsed(&start, &now) * 1000000.0 < (double)i * interval);
+
+        stamp_chan_send(&chans[i % requesters], now);
+    }
+
+    while (received < requests)
+    {
+        sched_yield();
+    }
+
+    for (i = 0; i < requesters; i++)
+    {
+        mltp_chan_close(&(chans[i].chan));
+    }
+
+    done = 1;
+}
+
+
+/****************************************************************************
+*   Function   : CompareDouble
+*   Description: This function compares two doubles for qsort.
+*   Parameters : a - pointer to first double
+*                b - pointer to second double
+*   Effects    : None
+*   Returned   : <0, 0, or >0 as a is less than, equal to or greater than b
+****************************************************************************/
+int CompareDouble(const void *a, const void *b)
+{
+    double diff;
+
+    diff = *(const double *)a - *(const double *)b;
+    return (diff < 0) ? -1 : (diff > 0);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the priority benchmark.  It
+*                runs the same request and batch load twice and reports
+*                request latency percentiles.  Without a quantum the runs
+*                use the FIFO and priority policies.  With one, both use the
+*                priority policy, first without then with preemption.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Latency percentiles are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    const mltp_sched_t *policies[2];
+    long quanta[2];
+    mltp_t **threads;
+    mltp_t *producer;
+    int vps, p, i;
+
+    if ((argc != 7) && (argc != 8))
+    {
+        fprintf(stderr, "syntax: %s vps requesters batchers requests "
+            "interval(usec) work [quantum(usec)]\n", argv[0]);
+        exit(1);
+    }
+
+    vps = atoi(argv[1]);
+    requesters = atoi(argv[2]);
+    batchers = atoi(argv[3]);
+    requests = atol(argv[4]);
+    interval = atol(argv[5]);
+    work = atol(argv[6]);
+    quantum = (argc == 8) ? atol(argv[7]) : 0;
+
+    if ((vps < 1) || (requesters < 1) || (batchers < 0) || (requests < 1) ||
+        (interval < 0) || (work < 0) || (quantum < 0))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    if (quantum)
+    {
+        /* requests go ahead of preempted batch threads */
+        policies[0] = policies[1] = &mltp_sched_priority;
+        quanta[0] = 0;
+        quanta[1] = quantum;
+    }
+    else
+    {
+        policies[0] = &mltp_sched_fifo;
+        policies[1] = &mltp_sched_priority;
+        quanta[0] = quanta[1] = 0;
+    }
+
+    chans = (stamp_chan_t *)malloc(requesters * sizeof(stamp_chan_t));
+    threads = (mltp_t **)malloc((requesters + batchers) * sizeof(mltp_t *));
+    latency = (double *)malloc(requests * sizeof(double));
+
+    for (p = 0; p < 2; p++)
+    {
+        mltp_init_sched(policies[p]);
+        mltp_set_quantum(quanta[p]);
+        mltp_lock_init(&count_lock, MLTP_LOCK_SPIN);
+
+        started = 0;
+        received = 0;
+        done = 0;
+
+        for (i = 0; i < requesters; i++)
+        {
+            stamp_chan_init(&chans[i], MLTP_CHAN_UNBOUNDED);
+            threads[i] = mltp_create(Request, (void *)(long)i);
+            mltp_set_priority(threads[i], MLTP_PRIO_MAX);
+        }
+
+        for (i = 0; i < batchers; i++)
+        {
+            threads[requesters + i] = mltp_create(Batch, NULL);
+            mltp_set_priority(threads[requesters + i], MLTP_PRIO_MIN);
+        }
+
+        producer = mltp_create_bound(Producer, NULL, 0, NULL);
+        mltp_start(vps);
+        mltp_join_bound(*producer);
+        free(producer);
+
+        for (i = 0; i < requesters + batchers; i++)
+        {
+            free(threads[i]);
+        }
+
+        for (i = 0; i < requesters; i++)
+        {
+            mltp_chan_destroy(&(chans[i].chan));
+        }
+
+        qsort(latency, requests, sizeof(double), CompareDouble);
+        printf("%-8s quantum %ld usec: p50 %e  p99 %e  p99.9 %e  "
+            "max %e seconds\n", policies[p]->name, quanta[p],
+            latency[requests / 2],
+            latency[(requests * 99) / 100],
+            latency[(requests * 999) / 1000], latency[requests - 1]);
+    }
+
+    free(latency);
+    free(threads);
+    free(chans);
+
+    return(0);
+}
@@ -0,0 +1,354 @@
+/***************************************************************************
+*                    MLTP Scheduling Policy Measurments
+*
+*   File    : msched.c
+*   Purpose : run the same set of workloads under each of the scheduling
+*             policies provided by mltp and report the time each took.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "mltp.h"
+
+/***************************************************************************
+*                            TYPE DEFINITIONS
+***************************************************************************/
+typedef struct
+{
+    const char *name;               /* name of workload for report */
+    void (*setup)(void);            /* creates the workload's threads */
+    void (*cleanup)(void);          /* frees the workload's threads */
+} workload_t;
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+MLTP_CHAN_DECLARE(long, long)
+
+int nthreads;                   /* threads used by yield and ping-pong */
+int yields;                     /* yields per thread, also ping-pong count */
+int depth;                      /* depth of spawn tree */
+
+mltp_t **threads;               /* threads created by setup */
+long_chan_t *chans;             /* channels used by ping-pong pairs */
+
+const mltp_sched_t *policies[] =
+{
+    &mltp_sched_fifo,
+    &mltp_sched_lifo,
+    &mltp_sched_priority,
+    &mltp_sched_steal
+};
+
+#define NUM_POLICIES    (sizeof(policies) / sizeof(policies[0]))
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Yielder
+*   Description: This function is the entry point for yield workload
+*                threads.  It just yields over and over.
+*   Parameters : unused - not used
+*   Effects    : Thread yields the requested number of times.
+*   Returned   : NULL
+****************************************************************************/
+void *Yielder(void *unused)
+{
+    int i;
+
+    for (i = 0; i < yields; i++)
+    {
+        mltp_yield();
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : YieldSetup
+*   Description: This function creates the threads for the yield workload.
+*                Threads are given one of four priorities so the priority
+*                policy has some ordering to do.
+*   Parameters : None
+*   Effects    : Yield threads are created.
+*   Returned   : None
+****************************************************************************/
+void YieldSetup(void)
+{
+    int i;
+
+    for (i = 0; i < nthreads; i++)
+    {
+        threads[i] = mltp_create(Yielder, NULL);
+        mltp_set_priority(threads[i], i % 4);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : Spawn
+*   Description: This function is the entry point for spawn workload
+*                threads.  Each thread creates and joins two children
+*                until the tree is the requested depth.
+*   Parameters : level - levels left to create below this thread
+*   Effects    : Subtree of threads is created and joined.
+*   Returned   : NULL
+****************************************************************************/
+void *Spawn(void *level)
+{
+    mltp_t *left, *right;
+
+    if ((long)level == 0)
+    {
+        return(NULL);
+    }
+
+    left = mltp_create(Spawn, (void *)((long)level - 1));
+    right = mltp_create(Spawn, (void *)((long)level - 1));
+
+    mltp_join(left, NULL);
+    mltp_join(right, NULL);
+
+    free(left);
+    free(right);
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : SpawnSetup
+*   Description: This function creates the root of the spawn workload.
+*   Parameters : None
+*   Effects    : Root spawn thread is created.
+*   Returned   : None
+****************************************************************************/
+void SpawnSetup(void)
+{
+    threads[0] = mltp_create(Spawn, (void *)(long)depth);
+}
+
+
+/****************************************************************************
+*   Function   : SpawnCleanup
+*   Description: This function frees the root of the spawn workload.
+*   Parameters : None
+*   Effects    : Root spawn thread is freed.
+*   Returned   : None
+****************************************************************************/
+void SpawnCleanup(void)
+{
+    free(threads[0]);
+}
+
+
+/****************************************************************************
+*   Function   : Pinger
+*   Description: This function is the entry point for ping-pong workload
+*                threads.  Pairs of threads pass a message back and forth
+*                over a pair of unbuffered channels, so every message is a
+*                block and a wakeup.
+*   Parameters : id - thread number, even threads start the ping-pong
+*   Effects    : Messages are exchanged with partner thread.
+*   Returned   : NULL
+****************************************************************************/
+void *Pinger(void *id)
+{
+    long msg;
+    long_chan_t *in, *out;
+    int i;
+
+    if ((long)id & 1)
+    {
+        in = &chans[(long)id - 1];
+        out = &chans[(long)id];
+    }
+    else
+    {
+        in = &chans[(long)id + 1];
+        out = &chans[(long)id];
+    }
+
+    msg = 0;
+
+    for (i = 0; i < yields; i++)
+    {
+        if ((long)id & 1)
+        {
+            long_chan_recv(in, &msg);
+            long_chan_send(out, msg + 1);
+        }
+        else
+        {
+            long_chan_send(out, msg + 1);
+            long_chan_recv(in, &msg);
+        }
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : PingSetup
+*   Description: This function creates the threads and channels for the
+*                ping-pong workload.
+*   Parameters : None
+*   Effects    : Ping-pong threads and channels are created.
+*   Returned   : None
+****************************************************************************/
+void PingSetup(void)
+{
+    int i;
+
+    for (i = 0; i < nthreads; i++)
+    {
+        long_chan_init(&chans[i], 0);
+        threads[i] = mltp_create(Pinger, (void *)(long)i);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : ThreadCleanup
+*   Description: This function frees the threads created by the yield and
+*                ping-pong workloads.
+*   Parameters : None
+*   Effects    : Workload threads are freed.
+*   Returned   : None
+****************************************************************************/
+void ThreadCleanup(void)
+{
+    int i;
+
+    for (i = 0; i < nthreads; i++)
+    {
+        free(threads[i]);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : PingCleanup
+*   Description: This function frees the threads and channels created by
+*                the ping-pong workload.
+*   Parameters : None
+*   Effects    : Ping-pong threads and channels are freed.
+*   Returned   : None
+****************************************************************************/
+void PingCleanup(void)
+{
+    int i;
+
+    ThreadCleanup();
+
+    for (i = 0; i < nthreads; i++)
+    {
+        mltp_chan_destroy(&(chans[i].chan));
+    }
+}
+
+workload_t workloads[] =
+{
+    {"yield", YieldSetup, ThreadCleanup},
+    {"spawn", SpawnSetup, SpawnCleanup},
+    {"ping-pong", PingSetup, PingCleanup}
+};
+
+#define NUM_WORKLOADS   (sizeof(workloads) / sizeof(workloads[0]))
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the scheduling benchmark.  It
+*                runs each workload under each scheduling policy.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Run times are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    struct timeval t1, t2;
+    double seconds;
+    int vps;
+    unsigned int p, w;
+
+    if (argc != 5)
+    {
+        fprintf(stderr, "syntax: %s vps threads yields depth\n", argv[0]);
+        exit(1);
+    }
+
+    vps = atoi(argv[1]);
+    nthreads = atoi(argv[2]);
+    yields = atoi(argv[3]);
+    depth = atoi(argv[4]);
+
+    /* ping-pong needs pairs */
+    nthreads &= ~1;
+
+    if ((vps < 1) || (nthreads < 2) || (yields < 1) || (depth < 0))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    threads = (mltp_t **)malloc(nthreads * sizeof(mltp_t *));
+    chans = (long_chan_t *)malloc(nthreads * sizeof(long_chan_t));
+
+    printf("%-10s", "policy");
+
+    for (w = 0; w < NUM_WORKLOADS; w++)
+    {
+        printf(" %14s", workloads[w].name);
+    }
+
+    printf("\n");
+
+    for (p = 0; p < NUM_POLICIES; p++)
+    {
+        printf("%-10s", policies[p]->name);
+
+        for (w = 0; w < NUM_WORKLOADS; w++)
+        {
+            mltp_init_sched(policies[p]);
+            workloads[w].setup();
+
+            gettimeofday(&t1, NULL);
+            mltp_start(vps);
+            gettimeofday(&t2, NULL);
+
+            workloads[w].cleanup();
+
+            seconds = (double)(t2.tv_usec - t1.tv_usec)/1000000.0;
+            seconds += (double)(t2.tv_sec - t1.tv_sec);
+            printf(" %14e", seconds);
+            fflush(stdout);
+        }
+
+        printf("\n");
+    }
+
+    free(chans);
+    free(threads);
+
+    return(0);
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+*                       MLTP Idle Thread Measurments
+*
+*   File    : mstacks.c
+*   Purpose : measure the memory used by a large number of idle unbound
+*             threads, each parked on a conditional.  Thread stacks are
+*             mapped, so only the pages they touch are committed.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+long nthreads;                  /* number of idle threads */
+size_t stackSize;               /* bytes of stack per idle thread */
+mltp_cond_t idleCond;           /* idle threads wait here */
+volatile int parked;            /* number of idle threads parked */
+volatile int released;          /* non-zero once idle threads may exit */
+volatile int exited;            /* number of idle threads exited */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Idle
+*   Description: This function is the entry point for the idle threads.
+*                Each parks on a conditional until it is released.
+*   Parameters : unused - not used
+*   Effects    : parked and exited are incremented.
+*   Returned   : NULL
+****************************************************************************/
+void *Idle(void *unused)
+{
+    mltp_atomic_fetch_add(&parked, 1, MLTP_RELAXED);
+
+    while (!released)
+    {
+        mltp_cond_wait(&idleCond);
+    }
+
+    mltp_atomic_fetch_add(&exited, 1, MLTP_RELAXED);
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Creator
+*   Description: This function is the entry point for the thread that
+*                creates the idle threads, measures memory once they have
+*                all parked, and then releases them.
+*   Parameters : unused - not used
+*   Effects    : Results are written to stdout.
+*   Returned   : NULL
+****************************************************************************/
+void *Creator(void *unused)
+{
+    struct timeval t1, t2;
+    long before, after, i;
+
+    before = ResidentBytes();
+    gettimeofday(&t1, NULL);
+
+    for (i = 0; i < nthreads; i++)
+    {
+        mltp_detach(mltp_create_sized(Idle, NULL, stackSize));
+    }
+
+    gettimeofday(&t2, NULL);
+
+    /* wait for everyone to park */
+    while (parked < nthreads)
+    {
+        mltp_yield();
+    }
+
+    after = ResidentBytes();
+
+    printf("%ld threads created in %e seconds/thread\n", nthreads,
+        Elapsed(&t1, &t2) / nthreads);
+    printf("resident: %ld Mbytes, %ld bytes/thread\n",
+        (after - before) / (1024 * 1024), (after - before) / nthreads);
+
+    released = 1;
+
+    /* a thread between parked++ and its wait misses a broadcast */
+    while (exited < nthreads)
+    {
+        mltp_cond_broadcast(&idleCond);
+        mltp_yield();
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the idle thread benchmark.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    mltp_t *creator;
+    int vps;
+
+    if ((argc != 3) && (argc != 4))
+    {
+        fprintf(stderr, "syntax: %s threads vps [stack_bytes]\n", argv[0]);
+        exit(1);
+    }
+
+    nthreads = atol(argv[1]);
+    vps = atoi(argv[2]);
+    stackSize = (argc == 4) ? (size_t)atol(argv[3]) : 0;
+
+    if ((nthreads < 1) || (vps < 1))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    mltp_init();
+    mltp_cond_init(&idleCond);
+    parked = 0;
+    released = 0;
+    exited = 0;
+
+    creator = mltp_create(Creator, NULL);
+    mltp_start(vps);
+    free(creator);
+
+    return(0);
+}
@@ -0,0 +1,230 @@
+/***************************************************************************
+*                    MLTP Cross-Layer Wakeup Measurments
+*
+*   File    : mwakeup.c
+*   Purpose : measure the latency and throughput of wakeups sent by a bound
+*             thread to unbound threads waiting on channels.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+***************************************************************************/
+
+/*
+ * $Id:$
+ *
+ * $Log:$
+ *
+ */
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/time.h>
+#include "mltp.h"
+#include "mbench.h"
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+MLTP_CHAN_DECLARE(stamp, struct timeval)
+
+stamp_chan_t *chans;            /* one channel per receiving thread */
+int receivers;                  /* number of unbound receiving threads */
+long messages;                  /* number of wakeups sent in each phase */
+int paced;                      /* non-zero wait for each wakeup to land */
+
+volatile int started;           /* receivers that are running */
+volatile long received;         /* wakeups received this phase */
+volatile int done;              /* non-zero once producer is finished */
+mltp_lock_t stat_lock;          /* lock for stats below */
+double total_latency;           /* sum of latencies (seconds) */
+double max_latency;             /* longest latency (seconds) */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Receiver
+*   Description: This function is the entry point for the unbound threads
+*                being woken.  Each receives time stamps on its channel and
+*                records how long the wakeup took.
+*   Parameters : id - receiver number
+*   Effects    : Latency stats and received count are updated.
+*   Returned   : NULL
+****************************************************************************/
+void *Receiver(void *id)
+{
+    struct timeval sent, now;
+    double latency;
+    stamp_chan_t *in;
+    long old;
+
+    in = &chans[(long)id];
+
+    mltp_lock(&stat_lock);
+    started++;
+    mltp_unlock(&stat_lock);
+
+    while (stamp_chan_recv(in, &sent) == 0)
+    {
+        gettimeofday(&now, NULL);
+        latency = Elapsed(&sent, &now);
+
+        mltp_lock(&stat_lock);
+        total_latency += latency;
+
+        if (latency > max_latency)
+        {
+            max_latency = latency;
+        }
+
+        mltp_unlock(&stat_lock);
+
+        do
+        {
+            old = received;
+        } while (!mltp_compare_and_swap(old, old + 1, &received));
+    }
+
+    return(NULL);
+}
+
+
+/****************************************************************************
+*   Function   : Producer
+*   Description: This function is the entry point for the bound thread that
+*                wakes the receivers.  It sends time stamps to the receivers
+*                in turn, optionally waiting for each to be received before
+*                sending the next.
+*   Parameters : unused - not used
+*   Effects    : Messages are sent and all channels are closed.
+*   Returned   : None
+****************************************************************************/
+void Producer(void *unused)
+{
+    struct timeval t1, t2, now;
+    long i;
+
+    /* wait for the receivers to park on their channels */
+    while (started < receivers)
+    {
+        sched_yield();
+    }
+
+    gettimeofday(&t1, NULL);
+
+    for (i = 0; i < messages; i++)
+    {
+        gettimeofday(&now, NULL);
+        stamp_chan_send(&chans[i % receivers], now);
+
+        if (paced)
+        {
+            while (received <= i)
+            {
+                sched_yield();
+            }
+        }
+    }
+
+    while (received < messages)
+    {
+        sched_yield();
+    }
+
+    gettimeofday(&t2, NULL);
+
+    for (i = 0; i < receivers; i++)
+    {
+        mltp_chan_close(&(chans[i].chan));
+    }
+
+    printf("%s: %ld wakeups in %e seconds, %e wakeups/second\n",
+        paced ? "paced" : "burst", messages, Elapsed(&t1, &t2),
+        messages / Elapsed(&t1, &t2));
+    printf("\tlatency mean %e seconds, max %e seconds\n",
+        total_latency / messages, max_latency);
+
+    done = 1;
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the entry point for the wakeup benchmark.  It runs
+*                a paced phase to measure wakeup latency and a burst phase
+*                to measure wakeup throughput.
+*   Parameters : argc - argument count
+*                argv - arguments
+*   Effects    : Wakeup latency and throughput are written to stdout.
+*   Returned   : 0 for success, otherwise non-zero
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    mltp_t **threads;
+    mltp_t *producer;
+    int vps, i;
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "syntax: %s vps receivers messages\n", argv[0]);
+        exit(1);
+    }
+
+    vps = atoi(argv[1]);
+    receivers = atoi(argv[2]);
+    messages = atol(argv[3]);
+
+    if ((vps < 1) || (receivers < 1) || (messages < 1))
+    {
+        fprintf(stderr, "error: bad argument\n");
+        exit(1);
+    }
+
+    mltp_init();
+    mltp_lock_init(&stat_lock, MLTP_LOCK_SPIN);
+
+    chans = (stamp_chan_t *)malloc(receivers * sizeof(stamp_chan_t));
+    threads = (mltp_t **)malloc(receivers * sizeof(mltp_t *));
+
+    for (paced = 1; paced >= 0; paced--)
+    {
+        for (i = 0; i < receivers; i++)
+        {
+            /* burst phase lets every message queue up */
+            stamp_chan_init(&chans[i], paced ? 1 : MLTP_CHAN_UNBOUNDED);
+            threads[i] = mltp_create(Receiver, (void *)(long)i);
+        }
+
+        started = 0;
+        received = 0;
+        done = 0;
+        total_latency = max_latency = 0.0;
+
+        producer = mltp_create_bound(Producer, NULL, 0, NULL);
+        mltp_start(vps);
+
+        while (!done)
+        {
+            sched_yield();
+        }
+
+        mltp_join_bound(*producer);
+        free(producer);
+
+        for (i = 0; i < receivers; i++)
+        {
+            free(threads[i]);
+            mltp_chan_destroy(&(chans[i].chan));
+        }
+    }
+
+    free(threads);
+    free(chans);
+
+    return(0);
+}
@@ -254,9 +254,11 @@ FILE *fdopen (int fd, const char *mode)
         jkthread_init();
     }
 
+    (*jkthread_nopreempt())++;
     jksem_get(&_jk_fileio_sem);
     fp = _IO_fdopen (fd, mode);
     jksem_release(&_jk_fileio_sem);
+    (*jkthread_nopreempt())--;
 
     if (fp != NULL)
     {
@@ -286,9 +288,11 @@ FILE *fopen (const char *filename, const char *mode)
         jkthread_init();
     }
 
+    (*jkthread_nopreempt())++;
     jksem_get(&_jk_fileio_sem);
     fp = _IO_fopen (filename, mode);
     jksem_release(&_jk_fileio_sem);
+    (*jkthread_nopreempt())--;
 
     if (fp != NULL)
     {
@@ -327,9 +331,11 @@ FILE* freopen(const char* filename, const char* mode, FILE* fp)
         return NULL;
     }
 
+    (*jkthread_nopreempt())++;
     jksem_get(&_jk_fileio_sem);
     ret = _IO_freopen(filename, mode, fp);
     jksem_release(&_jk_fileio_sem);
+    (*jkthread_nopreempt())--;
 
     jksem_unlockfile(fp);
     return ret;
@@ -354,9 +360,11 @@ FILE *popen(const char *command, const char *mode)
         jkthread_init();
     }
 
+    (*jkthread_nopreempt())++;
     jksem_get(&_jk_fileio_sem);
     fp = _IO_popen (command, mode);
     jksem_release(&_jk_fileio_sem);
+    (*jkthread_nopreempt())--;
 
     if (fp != NULL)
     {
@@ -1085,6 +1093,7 @@ int fclose(FILE *fp)
     jksem_lockfile(fp);
     fd = fileno(fp);
 
+    (*jkthread_nopreempt())++;
     jksem_get(&_jk_fileio_sem);
     if(fp->_IO_file_flags & _IO_IS_FILEBUF)
     {
@@ -1099,6 +1108,7 @@ int fclose(FILE *fp)
     jksem_killfilelock(fp);
     //%%%need to do whatever it takes to finish off FP here.
     jksem_release(&_jk_fileio_sem);
+    (*jkthread_nopreempt())--;
 
     if (fp != _IO_stdin && fp != _IO_stdout && fp != _IO_stderr)
     {
@@ -1162,9 +1172,11 @@ int fflush(FILE *fp)
 
     if (fp == NULL)
     {
+        (*jkthread_nopreempt())++;
         jksem_get(&_jk_fileio_sem);
         result = _IO_flush_all();
         jksem_release(&_jk_fileio_sem);
+        (*jkthread_nopreempt())--;
     }
     else
     {
@@ -177,6 +177,29 @@ void *jkthread_getlocal(void)
 }
 
 
+/****************************************************************************
+*   Function   : jkthread_nopreempt
+*   Description: This function returns a pointer to the calling thread's
+*                preemption deferral count.  Thread packages that preempt
+*                threads from signal handlers must not do so while the count
+*                is non-zero.  The count is raised while the thread holds
+*                the locks guarding libc's allocator and stdio.
+*   Parameters : None
+*   Effects    : None
+*   Returned   : Pointer to current thread's preemption deferral count
+****************************************************************************/
+int *jkthread_nopreempt(void)
+{
+    if (!_jkthread_inited)
+    {
+        /* stdio may be used before we're initialized */
+        return (int *)&_jkdummythread.thr_nopreempt;
+    }
+
+    return (int *)&_jkthread_kludge[getpid()]->thr_nopreempt;
+}
+
+
 /****************************************************************************
 *   Function   : jkthread_alloclocal
 *   Description: This function allocates a block of thread specific memory.
@@ -255,6 +278,7 @@ void jkthread_init(void)
         _jkthreadinfos[i].thr_id = 0;
         _jkthreadinfos[i].thr_errno = 0;
         _jkthreadinfos[i].thr_h_errno = 0;
+        _jkthreadinfos[i].thr_nopreempt = 0;
     }
 
     for(i = 0; i < JKMAX_SEMS; ++i)
@@ -684,6 +708,7 @@ int jkthread_create(void (*fn)(void *), void *data, int stacksz,
     thread_info->start_param = data;
     thread_info->term_func = term_fn;
     thread_info->thr_local = NULL;
+    thread_info->thr_nopreempt = 0;
 
     ret=_linux_thread_create(_jkthread_starter, thread_info, stacksz);
 
@@ -1114,13 +1139,17 @@ int jkrsem_tryget(jksem *s)
     {
         /* we own it. increase usage count */
         s->usage++;
+        (*jkthread_nopreempt())++;
         return 1;
     }
-    else
+    else if (jksem_tryget(s))
     {
-        /* we don't own it, try to get it */
-        return jksem_tryget(s);
+        /* we got it */
+        (*jkthread_nopreempt())++;
+        return 1;
     }
+
+    return 0;
 }
 
 
@@ -1140,6 +1169,9 @@ int jkrsem_tryget(jksem *s)
 ****************************************************************************/
 int jkrsem_get(jksem *s)
 {
+    /* don't let a signal switch threads while we hold the semaphore */
+    (*jkthread_nopreempt())++;
+
     if (s->owner == getpid())
     {
         /* we own it. decrease usage count */
@@ -1177,6 +1209,8 @@ void jkrsem_release(jksem *s)
             /* we're done with semaphore */
             jksem_release(s);
         }
+
+        (*jkthread_nopreempt())--;
     }
 }
 
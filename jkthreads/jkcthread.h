@@ -103,6 +103,7 @@ typedef struct _jkthreadinfo
     void    (*term_func)(void *);
     void    *start_param;
     void    *thr_local;
+    volatile int thr_nopreempt; /* defer signal preemption while non-zero */
 } jkthreadinfo;
 
 typedef struct _jksem
@@ -161,6 +162,9 @@ void jkthread_join_any(pid_t id);
 void *jkthread_getlocal(void);
 void *jkthread_alloclocal(size_t sz);
 
+/* preemption deferral, see thr_nopreempt */
+int *jkthread_nopreempt(void);
+
 /* semaphore functions */
 /* NOTE: recursive semaphores are not signal safe */
 jksem *jksem_create(void);
@@ -33,22 +33,78 @@
 ***************************************************************************/
 #include <assert.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 #include "mltp.h"
 
 /***************************************************************************
 *                                CONSTANTS
 ***************************************************************************/
-#define MLTP_STKSIZE        (0x10000)   /* 128Kbyte stack size */
-#define MLTP_PRIVATE_SIZE   (1024 * sizeof(void*))
-
 /* stack alignment lifted from stp.  must be a power of 2. */
 #define MLTP_STKALIGN(sp, alignment) \
     ((void *)((((qt_word_t)(sp)) + (alignment) - 1) & ~((alignment) - 1)))
 
+/* most unused stacks of each size class kept for reuse */
+#define MLTP_STACK_POOL_MAX (64)
+
+/* stack size classes, powers of two from MLTP_STACK_MIN */
+#define MLTP_STACK_CLASSES  (7)
+
+/* word stack profiling fills stacks with */
+#define MLTP_STACK_CANARY   ((unsigned long)0xA5A5A5A5A5A5A5A5ULL)
+
+/* most main functions whose stack use is profiled */
+#define MLTP_PROFILE_FUNCS  (64)
+
+/* recommended stacks leave 1/MLTP_PROFILE_HEADROOM above the deepest use */
+#define MLTP_PROFILE_HEADROOM   (4)
+
+/* thread ID table is allocated in pages of slots as it grows */
+#define MLTP_ID_PAGE_SLOTS  (1024)
+#define MLTP_ID_PAGES       (4096)
+
+/* ID slots a VP takes from the shared pool at a time */
+#define MLTP_ID_BLOCK       (64)
+
+/* most threads a VP takes from its own run queue at a time */
+#define MLTP_STEAL_BATCH    (32)
+
+/* where mltp_steal_put places threads */
+#define MLTP_STEAL_TAIL     (0)
+#define MLTP_STEAL_HEAD     (1)
+#define MLTP_STEAL_SECOND   (2)
+
+/* exited threads a VP collects before reclaiming their storage */
+#define MLTP_ZOMBIE_BATCH   (32)
+
+/* ends a list of free ID slots */
+#define MLTP_ID_NONE        (0xFFFFFFFFu)
+
+/* thread ID from a slot and its generation, generations are 1 to 2^31-1 */
+#define MLTP_ID_MAKE(gen, slot) \
+    (((mltp_id_t)(((gen) % 0x7FFFFFFFu) + 1) << 32) | (mltp_id_t)(slot))
+#define MLTP_ID_SLOT(id)    ((unsigned int)((id) & 0xFFFFFFFF))
+
+/* released stacks whose pages are returned to the kernel together */
+#define MLTP_STACK_TRIM_BATCH   (16)
+
+/* most virtual processors mltp_start will create */
+#define MLTP_MAX_VPS        (JKMAX_THREADS - 1)
+
+/* signal sent by each VP's preemption timer */
+#define MLTP_PREEMPT_SIGNAL (SIGRTMIN)
+
+/* dequeues between agings of the priority policy's waiting threads */
+#define MLTP_PRIO_AGE       64
+
+/* next pointer of a thread in a wakeup inbox, written by other VPs */
+#define MLTP_INBOX_NEXT(t)  (*(mltp_t * volatile *)&((t)->next))
+
 /* Round `v' to be `a'-aligned, assuming `a' is a power of two. */
 #define ROUND(v, a) (((v) + (a) - 1) & ~((a)-1))
 
@@ -58,19 +114,230 @@ enum
     mltpReady = 0,
     mltpRunning = 1,
     mltpBlock = 2,
-    mltpDone = 3
+    mltpDone = 3,
+    mltpExited = 4      /* stack is a zombie, thread may be joined */
 };
 
+/***************************************************************************
+*                             TYPE DEFINITIONS
+***************************************************************************/
+
+/***************************************************************************
+* A block function is called on the VP main stack after a thread blocked by
+* mltp_block has been switched out.  It must either park the thread where
+* somebody will find it, or make it runnable again.
+***************************************************************************/
+typedef void (mltp_blockf_t)(mltp_t *t, void *arg);
+
+typedef struct
+{
+    mltp_blockf_t *func;    /* function that parks the blocked thread */
+    void *arg;              /* argument passed to func */
+} mltp_block_t;
+
+/* everything a thread selecting from several channels needs to park */
+typedef struct
+{
+    mltp_select_t *cases;       /* operations being selected from */
+    mltp_waiter_t *waiters;     /* one waiter per operation */
+    mltp_chan_t **chans;        /* distinct channels in address order */
+    int n;                      /* number of operations */
+    int nchans;                 /* number of distinct channels */
+    int linked;                 /* non-zero if waiters have been linked */
+} mltp_select_wait_t;
+
+/* everything a thread waiting on several futures needs to park itself */
+typedef struct
+{
+    mltp_future_t **futures;    /* futures being waited on */
+    mltp_waiter_t *waiters;     /* one waiter per future */
+    int n;                      /* number of futures */
+    int linked;                 /* number of waiters linked to futures */
+} mltp_future_wait_t;
+
+/***************************************************************************
+* Scheduler data written by every VP is kept on cache lines of its own, so
+* VPs using different queues don't invalidate each other's lines, and the
+* read-mostly globals (mltp_sched, mltp_quantum, mltp_yield_request) stay
+* shared in every VP's cache.  Each queue's head, tail, and lock are all
+* written by whoever holds the lock, so they're kept together.
+***************************************************************************/
+typedef struct
+{
+    mltp_q_t q;
+    int count;          /* threads on q, only kept by mltp_sched_steal */
+} MLTP_CACHE_ALIGNED mltp_runq_t;
+
+/***************************************************************************
+* Threads a VP took from its run queue under mltp_sched_steal and hasn't
+* run yet.  Only the owning VP touches its batch, so running them takes no
+* locks, but thieves can't reach them either.  So a VP only takes one
+* thread at a time while other VPs are idle, and gives its batch back to
+* its run queue if other VPs go idle while it's running.  The counts are
+* reported by mltp_steal_stats.
+***************************************************************************/
+typedef struct
+{
+    mltp_t *head;               /* next thread to run */
+    unsigned long locks;        /* run queue locks taken to dispatch */
+    unsigned long runs;         /* threads dispatched */
+} MLTP_CACHE_ALIGNED mltp_steal_batch_t;
+
+/* counts only updated when a VP starts, exits, runs dry or finds work */
+typedef struct
+{
+    volatile int num_vps;       /* number of virtual processes alive */
+    volatile int idle_vps;      /* VPs whose last dispatch found no thread */
+} MLTP_CACHE_ALIGNED mltp_counts_t;
+
+/***************************************************************************
+* Threads created and exited on one VP.  The counts only grow and each VP
+* only writes its own, so thread creation and exit don't touch shared
+* cache lines.  The number of threads alive is the sum of the created
+* counts less the sum of the exited counts, see mltp_live_threads.
+***************************************************************************/
+typedef struct
+{
+    volatile unsigned long created;
+    volatile unsigned long exited;
+} MLTP_CACHE_ALIGNED mltp_live_t;
+
+/* priority policy state updated by every enqueue and dequeue */
+typedef struct
+{
+    volatile unsigned long map;     /* bit n is set if level n isn't empty */
+    volatile unsigned int gets;     /* dequeues since aging */
+} MLTP_CACHE_ALIGNED mltp_prio_state_t;
+
+/* builds fail here if a change puts data written by different VPs back on
+   a shared cache line */
+_Static_assert((sizeof(mltp_runq_t) % MLTP_CACHE_LINE) == 0,
+    "run queues must fill whole cache lines");
+_Static_assert((sizeof(mltp_counts_t) % MLTP_CACHE_LINE) == 0,
+    "thread counts must fill whole cache lines");
+_Static_assert((sizeof(mltp_steal_batch_t) % MLTP_CACHE_LINE) == 0,
+    "dispatch batches must fill whole cache lines");
+_Static_assert((sizeof(mltp_live_t) % MLTP_CACHE_LINE) == 0,
+    "live thread counts must fill whole cache lines");
+_Static_assert((sizeof(mltp_prio_state_t) % MLTP_CACHE_LINE) == 0,
+    "priority state must fill whole cache lines");
+_Static_assert((offsetof(mltp_vp_local_t, inbox_head) -
+    offsetof(mltp_vp_local_t, vp_curr)) >= MLTP_CACHE_LINE,
+    "inbox head must not share a line with the VP's current thread");
+_Static_assert((offsetof(mltp_vp_local_t, inbox_tail) -
+    offsetof(mltp_vp_local_t, inbox_head)) >= MLTP_CACHE_LINE,
+    "inbox head must not share a line with the inbox tail");
+
 /***************************************************************************
 *                            GLOBAL VARIABLES
 ***************************************************************************/
-static mltp_q_t mltp_global_runq;   /* queue of runable threads */
+static mltp_runq_t mltp_global_runq;    /* queue of runable threads */
+
+/* per VP queues used by work stealing, the last is for non-VP callers */
+static mltp_runq_t mltp_vp_runq[MLTP_MAX_VPS + 1];
+static mltp_steal_batch_t mltp_steal_batch[MLTP_MAX_VPS];
+static const mltp_sched_t *mltp_sched = &mltp_sched_fifo;
+
+/* priority policy queues and their map of non-empty levels */
+static mltp_runq_t mltp_prio_runq[MLTP_PRIO_LEVELS];
+static mltp_prio_state_t mltp_prio;
+
+volatile long mltp_quantum = 0;         /* preemption quantum (usec) */
+
+volatile int mltp_yield_request = 0;    /* VPs with yield_flag set */
+static long mltp_yield_quantum = 0;     /* mltp_maybe_yield quantum (usec) */
+static volatile int mltp_ticking = 0;   /* non-zero while ticker runs */
+
+static mltp_counts_t mltp_counts;   /* VP counts */
+
+/* per VP thread counts, the last is for non-VP callers */
+static mltp_live_t mltp_live[MLTP_MAX_VPS + 1];
+static volatile int mltp_live_vps = 0;  /* most VPs ever started */
+
+/* virtual processors started by mltp_start, for pushing wakeups */
+static mltp_vp_local_t *mltp_vps[MLTP_MAX_VPS];
+static volatile int mltp_vp_count = 0;
+static volatile unsigned int mltp_wake_next = 0;   /* next VP woken by
+                                                     non-VP threads */
+
+static mltp_spinlock_t start_lock;      /* prevent re-entering start */
+
+/***************************************************************************
+* Unused stacks of one size class, linked through their first word.
+* Recently released stacks are kept on the dirty list and reused first,
+* since their pages are still committed.  Once MLTP_STACK_TRIM_BATCH have
+* collected, their pages are released with madvise and they move to the
+* clean list.  Each class has its own lock and cache line, so threads of
+* different sizes don't contend.
+***************************************************************************/
+typedef struct
+{
+    void *dirty;            /* recently released stacks */
+    int ndirty;
+    void *pool;             /* stacks whose pages have been released */
+    int pooled;
+    mltp_spinlock_t lock;
+} MLTP_CACHE_ALIGNED mltp_stack_class_t;
+
+_Static_assert((MLTP_STACK_MIN << (MLTP_STACK_CLASSES - 1)) ==
+    MLTP_STACK_CLASS_MAX, "stack classes must run from MIN to CLASS_MAX");
+
+static mltp_stack_class_t mltp_stack_classes[MLTP_STACK_CLASSES];
+static size_t mltp_page_size;       /* size of stack guard pages */
+
+/***************************************************************************
+* Stack use of the profiled threads created to run one main function.
+* classes counts the threads by the smallest stack size class they would
+* have fit in, the last entry counts threads that fit in none.
+***************************************************************************/
+typedef struct
+{
+    void *func;             /* threads' main function */
+    const char *name;       /* name of the first named thread or NULL */
+    long threads;           /* number of threads measured */
+    size_t max_used;        /* most bytes of stack used by any of them */
+    long classes[MLTP_STACK_CLASSES + 1];
+} mltp_stack_profile_t;
+
+static volatile int mltp_stack_profiling = 0;
+static mltp_stack_profile_t mltp_stack_profiles[MLTP_PROFILE_FUNCS];
+static int mltp_stack_nprofiles = 0;
+static long mltp_stack_unprofiled = 0;  /* threads missed, table was full */
+static mltp_spinlock_t mltp_profile_lock = MLTP_SPINLOCK_INITIALIZER;
+
+/***************************************************************************
+* Thread-specific data keys.  A key's sequence number is odd while the key
+* exists.  It's bumped when the key is created and when it's deleted, so
+* thread values stamped with an old number are ignored.
+***************************************************************************/
+typedef struct
+{
+    volatile unsigned int seq;
+    mltp_key_destructor_t *destructor;
+} mltp_key_info_t;
 
-static int thr_num = 0;             /* number of threads created */
-static volatile int uthreads = 0;   /* number of user threads alive */
-static volatile int num_vps = 0;    /* number of virtual processes alive */
+static mltp_key_info_t mltp_keys[MLTP_KEYS_MAX];
+static mltp_spinlock_t mltp_key_lock = MLTP_SPINLOCK_INITIALIZER;
 
-static mltp_lock_t start_lock;      /* prevent re-entering start */
+/***************************************************************************
+* Thread ID table.  Each slot holds the thread using it and a generation
+* that's bumped when the thread exits.  Lookups read the table without
+* locking.  VPs hand out slots from blocks of MLTP_ID_BLOCK, taken from the
+* shared free list or, when it's empty, from never used slots.  Slots
+* freed on a VP are kept on the VP's free list until it grows too long.
+***************************************************************************/
+typedef struct
+{
+    mltp_t * volatile thread;       /* thread using the slot or NULL */
+    volatile unsigned int gen;      /* bumped each time the slot is freed */
+    unsigned int next;              /* next slot on a free list */
+} mltp_id_slot_t;
+
+static mltp_id_slot_t * volatile mltp_id_pages[MLTP_ID_PAGES];
+static volatile unsigned int mltp_id_fresh = 0;     /* first unused slot */
+static unsigned int mltp_id_free = MLTP_ID_NONE;    /* shared free list */
+static unsigned int mltp_id_nfree = 0;
+static mltp_spinlock_t mltp_id_lock = MLTP_SPINLOCK_INITIALIZER;
 static jksem *mltp_start_sem;       /* zero when all VPs are created */
 
 
@@ -81,14 +348,103 @@ void *xmalloc(unsigned size);       /* malloc with error checking */
 
 static void mltp_qdump(mltp_q_t *q);
 
+static mltp_t *mltp_talloc(size_t stksize, size_t private_size);
+static void mltp_tinit(mltp_t *t, size_t stksize, size_t private_size);
+static size_t mltp_stack_round(size_t stksize);
+static int mltp_stack_class(size_t stksize);
+static void *mltp_stack_get(size_t stksize);
+static void mltp_stack_get_n(size_t stksize, void **stos, int n);
+static void mltp_stack_put(void *sto, size_t stksize);
+static void mltp_stack_map_n(size_t stksize, void **stos, int n);
+static void mltp_stack_unmap(void *sto, size_t stksize);
+static void mltp_stack_trim(mltp_stack_class_t *cls, void *list,
+    size_t stksize);
+static mltp_t *mltp_reserve(const mltp_attr_t *attr, int nbytes,
+    void **area);
+static void mltp_stack_fill(void *sto, size_t stksize);
+static size_t mltp_stack_depth(void *sto, size_t stksize);
+static void mltp_stack_record(mltp_t *t);
+
+static mltp_specific_t *mltp_specific_slot(mltp_t *t, mltp_key_t key,
+    int create);
+static void mltp_key_destroy(mltp_t *t);
+
+static mltp_id_slot_t *mltp_id_slot(unsigned int slot, int create);
+static mltp_id_t mltp_id_alloc(mltp_t *t);
+static void mltp_id_release(mltp_id_t id);
+static void mltp_id_refill(mltp_vp_local_t *vp);
+static void mltp_id_give_back(mltp_vp_local_t *vp, unsigned int count);
+
 static void mltp_only (void *pu, void *pt, qt_userf_t *f);
 static void mltp_thread_start(void *pt);
 static void mltp_thread_cleanup(void *pt, void *vuserf_retval);
 
 static void *mltp_starthelp(qt_t *old, void *ignore0, void *ignore1);
 static void *mltp_aborthelp(qt_t *sp, void *old, void *null);
-static void *mltp_yieldhelp(qt_t *sp, void *old, void *blockq);
-static void *mltp_yield_to_first_help(qt_t *sp, void *old, void *blockq);
+static void mltp_zombie_reap(mltp_vp_local_t *vp);
+static void *mltp_yieldhelp(qt_t *sp, void *old, void *why);
+static void *mltp_condhelp(qt_t *sp, void *old, void *blockq);
+static void *mltp_joinhelp(qt_t *sp, void *old, void *thread);
+
+static void mltp_coro_only(void *pu, void *pcoro, qt_userf_t *f);
+static void *mltp_corohelp(qt_t *sp, void *save, void *null);
+
+static void mltp_qput_list(mltp_q_t *q, mltp_t *first, mltp_t *last);
+static void mltp_qpush_list(mltp_q_t *q, mltp_t *first, mltp_t *last);
+
+static int mltp_vp_id(void);
+static void mltp_live_add(unsigned long created, unsigned long exited);
+static unsigned long mltp_live_threads(void);
+static void mltp_sched_put(mltp_t *first, mltp_t *last, mltp_sched_why_t why);
+static void mltp_sched_block(mltp_t *t);
+
+static void mltp_inbox_init(mltp_vp_local_t *vp);
+static void mltp_inbox_push(mltp_vp_local_t *vp, mltp_t *first, mltp_t *last);
+static mltp_t *mltp_inbox_pop(mltp_vp_local_t *vp);
+static void mltp_inbox_drain(mltp_vp_local_t *vp);
+static int mltp_inbox_take(mltp_vp_local_t *vp, mltp_t *want);
+static int mltp_inbox_adopt(void);
+static int mltp_inbox_empty(mltp_vp_local_t *vp);
+static void mltp_wake(mltp_t *t);
+static void mltp_wake_list(mltp_t *first, mltp_t *last);
+static void mltp_block(mltp_blockf_t *func, void *arg);
+static void *mltp_blockhelp(qt_t *sp, void *old, void *block);
+static mltp_t *mltp_self(void);
+
+static void mltp_watch_wait(volatile unsigned int *addr, unsigned int old,
+    int front);
+static void mltp_watch_park(mltp_t *t, void *watch);
+static void mltp_watch_add(mltp_vp_local_t *vp, mltp_watch_t *w);
+static int mltp_watch_scan(mltp_vp_local_t *vp);
+static int mltp_watch_adopt(mltp_vp_local_t *self);
+static int mltp_watch_ready(mltp_watch_t *w, long long *now);
+static int mltp_watch_task(mltp_t *task, mltp_watch_t *w);
+
+static int mltp_preempt_start(timer_t *timer);
+static void mltp_preempt_handler(int sig);
+static void *mltp_preempthelp(qt_t *sp, void *old, void *null);
+
+static void mltp_ticker(void *unused);
+static int mltp_yield_flag_clear(mltp_vp_local_t *vp);
+static void mltp_quantum_start(mltp_vp_local_t *vp, mltp_t *next);
+static void mltp_run_bounds(mltp_vp_local_t *vp, mltp_t *t);
+
+static void mltp_waiter_link(mltp_waiter_t **list, mltp_waiter_t *w);
+static void mltp_waiter_unlink(mltp_waiter_t **list, mltp_waiter_t *w);
+static int mltp_waiter_claim(mltp_waiter_t *w);
+static int mltp_waiter_fire(mltp_waiter_t *w);
+static void mltp_wait_arrive(mltp_wait_t *wait);
+
+static void mltp_future_park(mltp_t *t, void *fwait);
+static void mltp_cont_spawn(mltp_cont_t *cont, void *value);
+static void mltp_cont_run(void *arg);
+static int mltp_future_wait(mltp_future_t **futures, int n);
+
+static void mltp_chan_grow(mltp_chan_t *chan);
+static int mltp_chan_send_locked(mltp_chan_t *chan, const void *msg);
+static int mltp_chan_recv_locked(mltp_chan_t *chan, void *msg);
+static int mltp_select_try(mltp_select_t *c);
+static void mltp_select_park(mltp_t *t, void *swait);
 
 /***************************************************************************
 *                                FUNCTIONS
@@ -123,7 +479,7 @@ void *xmalloc(unsigned size)
 *   Description: This function initializes the mutual exclusion lock passed
 *                as a parameter.
 *   Parameters : lock - mutual exclusion lock being initialized
-*                class - class of lock being initialized.
+*                lock_class - class of lock being initialized.
 *   Effects    : Lock is initialized so that next thread to attempt to obtain
 *                will get it.  It is an error to call this routine on locks
 *                that are already in use.
@@ -131,13 +487,13 @@ void *xmalloc(unsigned size)
 *
 *   NOTE: Only spin locks may be used with bound threads.
 ****************************************************************************/
-void mltp_lock_init(mltp_lock_t *lock, mltp_lock_class_t class)
+void mltp_lock_init(mltp_lock_t *lock, mltp_lock_class_t lock_class)
 {
     lock->next_available = 0;
     lock->now_serving = 0;
-    lock->lock_class = class;
+    lock->lock_class = lock_class;
 
-    if (class == MLTP_LOCK_SEMAPHORE)
+    if (lock_class == MLTP_LOCK_SEMAPHORE)
     {
         /* create semaphore */
         lock->sem = jksem_create();
@@ -157,14 +513,14 @@ void mltp_lock_init(mltp_lock_t *lock, mltp_lock_class_t class)
 *                the next available ticket.  Once a ticket is obtain the
 *                thread will spin until it the now waiting value matches the
 *                ticket.  Block locks will try get the lock and if they fail,
-*                the thread will yield to the end (or head) of the queue,
-*                and try once more when it is dequeued.
+*                the thread waits on its VP's watch list until the lock is
+*                released, and tries once more.
 *                NOTE: These locks do not support recursive acquisition!!!
 *   Parameters : lock - mutual exclusion lock
 *   Effects    : For spin locks, the lock's next available is incremented and
 *                thread spins until the now serving value matches the ticket
-*                value.  Block locks will yeild to the head of the queue if
-*                a lock is being held.
+*                value.  Block locks will wait for the lock to be released if
+*                it is being held.
 *   Returned   : None
 ****************************************************************************/
 extern void mltp_lock(mltp_lock_t *lock)
@@ -172,50 +528,16 @@ extern void mltp_lock(mltp_lock_t *lock)
     switch (lock->lock_class)
     {
         case MLTP_LOCK_SPIN:
-        {
-            volatile unsigned int ticket;
-
-            /* get ticket */
-            for (ticket = lock->next_available;
-                !(mltp_compare_and_swap(ticket, (ticket + 1),
-                    &(lock->next_available)));
-                ticket = lock->next_available)
-#ifdef IDLE_SPIN
-            {
-                int i = 1 + (int)(10.0 * rand() / (RAND_MAX + 1.0));
-
-                /* spin up to 10 cycles without locking the memory bus */
-                while(i)
-                {
-                    i--;
-                }
-            }
-#endif
-                ;
-
-            /* spin until ticket is being served */
-            while (ticket != lock->now_serving);
+            mltp_spin_lock(lock);
             break;
-        }
 
         case MLTP_LOCK_BLOCK:
         case MLTP_LOCK_BLOCK_FRONT:
-            /* block on the run queue if lock is not available */
-            while (!mltp_compare_and_swap(0, 1, &(lock->now_serving)))
-            {
-                if (lock->lock_class == MLTP_LOCK_BLOCK_FRONT)
-                {
-                    mltp_yield_to_first();
-                }
-                else
-                {
-                    mltp_yield();
-                }
-            }
+            mltp_block_lock(lock);
             break;
 
         case MLTP_LOCK_SEMAPHORE:
-            jksem_get(lock->sem);
+            mltp_sem_lock(lock);
             break;
 
         default:
@@ -238,18 +560,16 @@ extern void mltp_unlock(mltp_lock_t *lock)
     switch (lock->lock_class)
     {
         case MLTP_LOCK_SPIN:
-            /* let next ticket get served */
-            lock->now_serving++;
+            mltp_spin_unlock(lock);
             break;
 
         case MLTP_LOCK_BLOCK:
         case MLTP_LOCK_BLOCK_FRONT:
-            /* release the lock */
-            lock->now_serving = 0;
+            mltp_block_unlock(lock);
             break;
 
         case MLTP_LOCK_SEMAPHORE:
-            jksem_release(lock->sem);
+            mltp_sem_unlock(lock);
             break;
 
         default:
@@ -259,6 +579,191 @@ extern void mltp_unlock(mltp_lock_t *lock)
 }
 
 
+/****************************************************************************
+*   Function   : mltp_spin_lock
+*   Description: This function obtains a spin lock.  Threads obtain the
+*                lock in the same order that they obtain the next available
+*                ticket, then spin until their ticket is served.
+*   Parameters : lock - spin lock
+*   Effects    : The lock's next available is incremented and the thread
+*                spins until the now serving value matches the ticket value.
+*                Preemption is deferred until the lock is released.
+*   Returned   : None
+****************************************************************************/
+void mltp_spin_lock(mltp_lock_t *lock)
+{
+    unsigned int ticket;
+
+    /* a preempted holder would leave everyone else spinning */
+    MLTP_PREEMPT_OFF();
+
+    /* get ticket */
+    ticket = mltp_atomic_fetch_add(&(lock->next_available), 1, MLTP_RELAXED);
+
+    /* spin until ticket is being served */
+    while (mltp_atomic_load_acquire(&(lock->now_serving)) != ticket)
+    {
+        mltp_cpu_relax();
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_spin_unlock
+*   Description: This function releases a spin lock.
+*   Parameters : lock - spin lock
+*   Effects    : Lock's now serving is incremented.
+*   Returned   : None
+****************************************************************************/
+void mltp_spin_unlock(mltp_lock_t *lock)
+{
+    /* let next ticket get served, only the holder writes now_serving */
+    mltp_atomic_store_release(&(lock->now_serving), lock->now_serving + 1);
+    MLTP_PREEMPT_ON();
+}
+
+
+/****************************************************************************
+*   Function   : mltp_block_lock
+*   Description: This function obtains a blocking lock.  If the lock is
+*                held, the thread waits on its VP's watch list until it is
+*                released, and tries once more.  Waiters for an
+*                MLTP_LOCK_BLOCK_FRONT lock run ahead of the other queued
+*                threads once it's released.
+*   Parameters : lock - MLTP_LOCK_BLOCK or MLTP_LOCK_BLOCK_FRONT lock
+*   Effects    : The calling thread holds the lock.
+*   Returned   : None
+****************************************************************************/
+void mltp_block_lock(mltp_lock_t *lock)
+{
+    /* wait for the holder to release lock if it is not available */
+    while (!mltp_atomic_cas_acquire(&(lock->now_serving), 0, 1))
+    {
+        mltp_watch_wait(&(lock->now_serving), 1,
+            (lock->lock_class == MLTP_LOCK_BLOCK_FRONT));
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_block_unlock
+*   Description: This function releases a blocking lock.
+*   Parameters : lock - MLTP_LOCK_BLOCK or MLTP_LOCK_BLOCK_FRONT lock
+*   Effects    : Lock's now serving is zeroed.
+*   Returned   : None
+****************************************************************************/
+void mltp_block_unlock(mltp_lock_t *lock)
+{
+    /* release the lock, critical section stores can't move past it */
+    mltp_atomic_store_release(&(lock->now_serving), 0);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_sem_lock
+*   Description: This function obtains a semaphore lock.
+*   Parameters : lock - semaphore lock
+*   Effects    : The calling process holds the lock's semaphore.
+*   Returned   : None
+****************************************************************************/
+void mltp_sem_lock(mltp_lock_t *lock)
+{
+    jksem_get(lock->sem);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_sem_unlock
+*   Description: This function releases a semaphore lock.
+*   Parameters : lock - semaphore lock
+*   Effects    : The lock's semaphore is released.
+*   Returned   : None
+****************************************************************************/
+void mltp_sem_unlock(mltp_lock_t *lock)
+{
+    jksem_release(lock->sem);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_trylock
+*   Description: This function gets a lock if it can do so without waiting.
+*                Spin locks are only obtained when no other thread holds or
+*                is waiting for a ticket.
+*   Parameters : lock - mutual exclusion lock
+*   Effects    : If the lock is available, the caller holds it.
+*   Returned   : Non-zero if the lock was obtained, otherwise 0.
+****************************************************************************/
+int mltp_trylock(mltp_lock_t *lock)
+{
+    unsigned int ticket;
+
+    switch (lock->lock_class)
+    {
+        case MLTP_LOCK_SPIN:
+            MLTP_PREEMPT_OFF();
+            ticket = lock->now_serving;
+
+            /* take the next ticket only if it will be served right away */
+            if (mltp_atomic_cas_acquire(&(lock->next_available), ticket,
+                ticket + 1))
+            {
+                return 1;
+            }
+
+            MLTP_PREEMPT_ON();
+            return 0;
+
+        case MLTP_LOCK_BLOCK:
+        case MLTP_LOCK_BLOCK_FRONT:
+            return mltp_atomic_cas_acquire(&(lock->now_serving), 0, 1);
+
+        case MLTP_LOCK_SEMAPHORE:
+            return jksem_tryget(lock->sem);
+
+        default:
+            fprintf(stderr, "Accessing lock of unknown class.\n");
+            return 0;
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_spinlock_wait
+*   Description: This function is the slow path of mltp_spinlock_lock.  It
+*                spins until the caller's ticket is being served.
+*   Parameters : lock - spin lock
+*                ticket - ticket the caller took from lock
+*   Effects    : The caller holds the lock.
+*   Returned   : None
+****************************************************************************/
+void mltp_spinlock_wait(mltp_spinlock_t *lock, unsigned int ticket)
+{
+    while (mltp_atomic_load_acquire(&(lock->now_serving)) != ticket)
+    {
+        mltp_cpu_relax();
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_mutex_wait
+*   Description: This function is the slow path of mltp_mutex_lock.  The
+*                thread waits on its VP's watch list until the mutex is
+*                released, then tries to get it again.
+*   Parameters : mutex - mutex being obtained
+*   Effects    : The caller holds the mutex.
+*   Returned   : None
+****************************************************************************/
+void mltp_mutex_wait(mltp_mutex_t *mutex)
+{
+    do
+    {
+        mltp_wait_until(&(mutex->locked), 1);
+    } while (!mltp_mutex_trylock(mutex));
+}
+
+
 /****************************************************************************
 *   Function   : mltp_qinit
 *   Description: This function initializes the thread queue passed as a
@@ -267,14 +772,11 @@ extern void mltp_unlock(mltp_lock_t *lock)
 *   Effects    : Head, tail, and next position in the runqueue all point
 *                to each other.
 *   Returned   : None
-*   NOTE: MLTP_LOCK_BLOCK and MLTP_LOCK_BLOCK_FRONT locks cannot be used on
-*         queues, because blocking locks can start a vicious cycle where a
-*         thread attempts to acquire a lock and fails, so it then attempts
-*         to acquire a lock to the queue it's blocking on which then sends
-*         it back to the same queue.
-*
-*         This code uses MLTP_LOCK_STD.  If MLTP_LOCK_BLOCK* is defined as
-*         the standard lock this code will fail.
+*   NOTE: Queues use spin locks.  Blocking locks cannot be used on queues,
+*         because blocking locks can start a vicious cycle where a thread
+*         attempts to acquire a lock and fails, so it then attempts to
+*         acquire a lock to the queue it's blocking on which then sends it
+*         back to the same queue.
 ****************************************************************************/
 static void mltp_qinit(mltp_q_t *q)
 {
@@ -287,17 +789,7 @@ static void mltp_qinit(mltp_q_t *q)
     q->t.next = q->tail = &q->t;
     q->t.thrid = -32767;            /* give a thread ID for easy tracing */
 
-    if ((MLTP_LOCK_STD != MLTP_LOCK_BLOCK) &&
-        (MLTP_LOCK_STD != MLTP_LOCK_BLOCK_FRONT))
-    {
-        mltp_lock_init(&(q->lock), MLTP_LOCK_STD);
-    }
-    else
-    {
-        fprintf(stderr, "Error: Queues may not use BLOCK locks./n");
-        fprintf(stderr, "Redefine MLTP_LOCK_STD or edit mltp_qinit.\n");
-        exit(0);
-    }
+    mltp_spinlock_init(&(q->lock));
 }
 
 
@@ -313,7 +805,7 @@ static mltp_t *mltp_qget(mltp_q_t *q)
 {
     mltp_t *t;                       /* next thread in queue */
 
-    mltp_lock(&(q->lock));           /* aquire the queue lock */
+    mltp_spinlock_lock(&(q->lock));   /* aquire the queue lock */
 
     /* get next thread from queue and adjust queue */
     t = q->t.next;
@@ -333,7 +825,7 @@ static mltp_t *mltp_qget(mltp_q_t *q)
         }
     }
 
-    mltp_unlock(&(q->lock));        /* release the queue lock */
+    mltp_spinlock_unlock(&(q->lock)); /* release the queue lock */
 
     return t;
 }
@@ -350,13 +842,13 @@ static mltp_t *mltp_qget(mltp_q_t *q)
 ****************************************************************************/
 static void mltp_qput(mltp_q_t *q, mltp_t *t)
 {
-    mltp_lock(&(q->lock));          /* aquire the queue lock */
+    mltp_spinlock_lock(&(q->lock));   /* aquire the queue lock */
 
     q->tail->next = t;
     t->next = &q->t;
     q->tail = t;
 
-    mltp_unlock(&(q->lock));        /* release the queue lock */
+    mltp_spinlock_unlock(&(q->lock)); /* release the queue lock */
 }
 
 
@@ -372,7 +864,7 @@ static void mltp_qput(mltp_q_t *q, mltp_t *t)
 ****************************************************************************/
 static void mltp_qput_second(mltp_q_t *q, mltp_t *t)
 {
-    mltp_lock(&(q->lock));          /* aquire the queue lock */
+    mltp_spinlock_lock(&(q->lock));   /* aquire the queue lock */
 
     if (q->t.next == &q->t)
     {
@@ -394,7 +886,58 @@ static void mltp_qput_second(mltp_q_t *q, mltp_t *t)
         }
     }
 
-    mltp_unlock(&(q->lock));        /* release the queue lock */
+    mltp_spinlock_unlock(&(q->lock)); /* release the queue lock */
+}
+
+
+/****************************************************************************
+*   Function   : mltp_qput_list
+*   Description: This function puts a list of threads chained through their
+*                next fields at the end of a queue.
+*   Parameters : q - pointer to queue to being used.
+*                first - pointer to first thread in the list
+*                last - pointer to last thread in the list
+*   Effects    : Threads from first to last are placed at the end of queue
+*                q, taking the queue lock just once.
+*   Returned   : None
+****************************************************************************/
+static void mltp_qput_list(mltp_q_t *q, mltp_t *first, mltp_t *last)
+{
+    mltp_spinlock_lock(&(q->lock));   /* aquire the queue lock */
+
+    q->tail->next = first;
+    last->next = &q->t;
+    q->tail = last;
+
+    mltp_spinlock_unlock(&(q->lock)); /* release the queue lock */
+}
+
+
+/****************************************************************************
+*   Function   : mltp_qpush_list
+*   Description: This function puts a list of threads chained through their
+*                next fields at the head of a queue.
+*   Parameters : q - pointer to queue to being used.
+*                first - pointer to first thread in the list
+*                last - pointer to last thread in the list
+*   Effects    : Threads from first to last are placed at the head of queue
+*                q, taking the queue lock just once.
+*   Returned   : None
+****************************************************************************/
+static void mltp_qpush_list(mltp_q_t *q, mltp_t *first, mltp_t *last)
+{
+    mltp_spinlock_lock(&(q->lock));   /* aquire the queue lock */
+
+    last->next = q->t.next;
+    q->t.next = first;
+
+    if (last->next == &q->t)
+    {
+        /* queue was empty */
+        q->tail = last;
+    }
+
+    mltp_spinlock_unlock(&(q->lock)); /* release the queue lock */
 }
 
 
@@ -409,19 +952,27 @@ static void mltp_qdump(mltp_q_t *q)
 {
     mltp_t *t;
 
-    mltp_lock(&(q->lock));       /* aquire the queue lock */
+    mltp_spinlock_lock(&(q->lock));   /* aquire the queue lock */
 
     printf("Dump of Global Run Queue:\n");
     t = q->t.next;
 
     /* traverse queue printing results */
-    while (t != &mltp_global_runq.t)
+    while (t != &mltp_global_runq.q.t)
     {
-        printf("\tThread %d\n", t->thrid);
+        if (t->name != NULL)
+        {
+            printf("\tThread %lld (%s)\n", t->thrid, t->name);
+        }
+        else
+        {
+            printf("\tThread %lld\n", t->thrid);
+        }
+
         t = t->next;
     }
 
-    mltp_unlock(&(q->lock));     /* release the queue lock */
+    mltp_spinlock_unlock(&(q->lock)); /* release the queue lock */
 }
 
 
@@ -437,9 +988,37 @@ static void mltp_qdump(mltp_q_t *q)
 ****************************************************************************/
 void mltp_init()
 {
+    mltp_init_sched(&mltp_sched_fifo);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_init_sched
+*   Description: This function initializes all the global thread
+*                information and selects the scheduling policy used to run
+*                threads.  This function must be called prior to thread
+*                creation.  It is an error to call this routine while
+*                threads are already running.
+*   Parameters : sched - scheduling policy
+*   Effects    : Global data and the policy's queues are initialized
+*   Returned   : None
+****************************************************************************/
+void mltp_init_sched(const mltp_sched_t *sched)
+{
+    int i;
+
     jkthread_init();
-    mltp_lock_init(&start_lock, MLTP_LOCK_STD);
-    mltp_qinit(&mltp_global_runq);
+    mltp_spinlock_init(&start_lock);
+
+    for (i = 0; i < MLTP_STACK_CLASSES; i++)
+    {
+        mltp_spinlock_init(&(mltp_stack_classes[i].lock));
+    }
+
+    mltp_page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    mltp_sched = sched;
+    mltp_sched->init();
 }
 
 
@@ -458,10 +1037,13 @@ void mltp_body(void *data)
     mltp_t *next;
     mltp_vp_local_t *mltp_vp_local;
     volatile int new_vps;
+    int vp_id;
+    int preempt;
+    timer_t timer;
 
     /* allocate local processor structure */
     mltp_vp_local =
-        (mltp_vp_local_t *)jkthread_alloclocal(sizeof(mltp_vp_local_t *));
+        (mltp_vp_local_t *)jkthread_alloclocal(sizeof(mltp_vp_local_t));
 
     if (mltp_vp_local == NULL)
     {
@@ -470,10 +1052,36 @@ void mltp_body(void *data)
     }
 
     /* save vp_id */
-    mltp_vp_local->vp_id = (int)data;
+    vp_id = (int)data;
+    mltp_vp_local->vp_id = vp_id;
 
     /* give thread main thread a unique ID for easy tracing */
     mltp_vp_local->vp_main.thrid = -(mltp_vp_local->vp_id) - 1;
+    mltp_vp_local->vp_main.private_data = NULL;
+    mltp_vp_local->vp_main.private_size = 0;
+
+    /* let other threads push wakeups to this VP */
+    mltp_inbox_init(mltp_vp_local);
+    mltp_vp_local->slice = 0;
+    mltp_vp_local->ticker_slice = 0;
+    mltp_vp_local->idle = 0;
+    mltp_vp_local->yield_flag = 0;
+    mltp_vp_local->run_lo = NULL;
+    mltp_vp_local->run_hi = NULL;
+    mltp_vp_local->watch = NULL;
+    mltp_spinlock_init(&(mltp_vp_local->watch_lock));
+    mltp_vp_local->alive = 1;
+    mltp_vp_local->id_next = 0;
+    mltp_vp_local->id_end = 0;
+    mltp_vp_local->id_free = MLTP_ID_NONE;
+    mltp_vp_local->id_nfree = 0;
+    mltp_vp_local->zombies = NULL;
+    mltp_vp_local->nzombies = 0;
+    mltp_vps[mltp_vp_local->vp_id] = mltp_vp_local;
+
+    /* main thread is never preempted, start the time slice timer */
+    MLTP_PREEMPT_OFF();
+    preempt = mltp_preempt_start(&timer);
 
     /* wait for all vps to get started. last thread is id 0 */
     if (mltp_vp_local->vp_id != 0)
@@ -488,42 +1096,145 @@ void mltp_body(void *data)
     /* execute user level threads */
     for(;;)
     {
-        next = mltp_qget(&mltp_global_runq);
+        /* move threads woken by other threads into the run queue */
+        mltp_inbox_drain(mltp_vp_local);
 
-        if (next != NULL)
+        /* threads whose watched words changed become runnable */
+        if (mltp_vp_local->watch != NULL)
         {
-            /* We have a thread to run */
-            mltp_vp_local->vp_curr = next;
-            QT_BLOCK(mltp_starthelp, 0, 0, next->sp);
+            mltp_watch_scan(mltp_vp_local);
         }
-        else
+
+        next = mltp_sched->dequeue(vp_id);
+
+        if ((next == NULL) && (mltp_sched->steal != NULL))
         {
-            new_vps = num_vps - 1;
+            next = mltp_sched->steal(vp_id);
+        }
 
-            if (new_vps >= uthreads)
+        if (next != NULL)
+        {
+            /* We have a thread to run, its quantum starts now */
+            if (mltp_vp_local->idle)
             {
-                /************************************************************
-                * there are too many virtual processors.  Since it's
-                * possible that more than one vp been in this section at a
-                * time.  It's better to leave a vp running and get it next
-                * pass than it is to terminate a vp that should be running.
-                ************************************************************/
-                if (mltp_compare_and_swap(num_vps, new_vps, &num_vps))
-                {
-                    /* let this vp die */
-                    break;
-                }
+                mltp_vp_local->idle = 0;
+                mltp_atomic_fetch_add(&(mltp_counts.idle_vps), -1,
+                    MLTP_RELAXED);
             }
-        }
-    }
-}
 
+            mltp_quantum_start(mltp_vp_local, next);
+            mltp_vp_local->vp_curr = next;
 
-/****************************************************************************
-*   Function   : mltp_start
-*   Description: This function runs all the threads in the global run queue
-*                until there are no more threads left.  It is an error to
-*                call this function before mltp_qinit.
+            if (next->type == MLTP_THREAD_TASK)
+            {
+                /* tasks run on our stack, next may be gone when it returns */
+                next->state = mltpRunning;
+                next->task_func(next->task_arg);
+                mltp_vp_local->vp_curr = &(mltp_vp_local->vp_main);
+            }
+            else
+            {
+                QT_BLOCK(mltp_starthelp, 0, 0, next->sp);
+            }
+
+            if (mltp_sched->tick != NULL)
+            {
+                mltp_sched->tick(vp_id);
+            }
+
+            if (mltp_vp_local->nzombies >= MLTP_ZOMBIE_BATCH)
+            {
+                mltp_zombie_reap(mltp_vp_local);
+            }
+        }
+        else
+        {
+            if (!mltp_vp_local->idle)
+            {
+                mltp_vp_local->idle = 1;
+                mltp_atomic_fetch_add(&(mltp_counts.idle_vps), 1,
+                    MLTP_RELAXED);
+            }
+
+            if (mltp_vp_local->zombies != NULL)
+            {
+                /* nothing to run, a good time to clean up */
+                mltp_zombie_reap(mltp_vp_local);
+            }
+
+            /* pick up wakeups stranded in the inboxes of exited VPs */
+            if (mltp_inbox_adopt())
+            {
+                /* found some, go run them */
+                continue;
+            }
+
+            /* check on waiters parked on busy VPs */
+            if (mltp_watch_adopt(mltp_vp_local))
+            {
+                continue;
+            }
+
+            if (mltp_vp_local->watch != NULL)
+            {
+                /* our watchers keep us alive */
+                continue;
+            }
+
+            new_vps = mltp_counts.num_vps - 1;
+
+            if ((unsigned long)new_vps >= mltp_live_threads())
+            {
+                /************************************************************
+                * there are too many virtual processors.  Since it's
+                * possible that more than one vp been in this section at a
+                * time.  It's better to leave a vp running and get it next
+                * pass than it is to terminate a vp that should be running.
+                ************************************************************/
+                if (mltp_atomic_cas(&(mltp_counts.num_vps), new_vps + 1,
+                    new_vps))
+                {
+                    /* let this vp die */
+                    break;
+                }
+            }
+        }
+    }
+
+    if (preempt)
+    {
+        timer_delete(timer);
+    }
+
+    /* nothing left here to yield */
+    mltp_yield_flag_clear(mltp_vp_local);
+
+    /* VPs only leave the loop idle, an exited VP isn't counted as idle */
+    mltp_vp_local->idle = 0;
+    mltp_atomic_fetch_add(&(mltp_counts.idle_vps), -1, MLTP_RELAXED);
+
+    /* the zombie list is lost with the VP's local data */
+    mltp_zombie_reap(mltp_vp_local);
+
+    /* stop taking wakeups and hand over any that were already pushed */
+    mltp_vp_local->alive = 0;
+    mltp_inbox_adopt();
+
+    /* wait out any VP still checking our (empty) watch list */
+    mltp_spinlock_lock(&(mltp_vp_local->watch_lock));
+    mltp_spinlock_unlock(&(mltp_vp_local->watch_lock));
+
+    /* the VP's local data is going away, share its ID slots */
+    mltp_id_give_back(mltp_vp_local, mltp_vp_local->id_nfree +
+        (mltp_vp_local->id_end - mltp_vp_local->id_next));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_start
+*   Description: This function runs all the threads in the global run queue
+*                until there are no more threads left.  It is an error to
+*                call this function before mltp_qinit.
 *   Parameters : num_vp - number of virtual processes
 *   Effects    : Creates the requested number of virtual processes and
 *                runs the queued threads on top of them.
@@ -532,16 +1243,38 @@ void mltp_body(void *data)
 void mltp_start(int num_vp)
 {
     int *vps;
-    int i;
+    int i, ticker;
 
     /* prevent multiple starts*/
-    mltp_lock(&start_lock);
+    mltp_spinlock_lock(&start_lock);
+
+    if (num_vp > MLTP_MAX_VPS)
+    {
+        fprintf(stderr, "Only %d virtual processors may be used.\n",
+            MLTP_MAX_VPS);
+        num_vp = MLTP_MAX_VPS;
+    }
+
+    /* VPs register themselves as they start */
+    for (i = 0; i < num_vp; i++)
+    {
+        mltp_vps[i] = NULL;
+    }
+
+    mltp_vp_count = num_vp;
 
     /* allocate handles for each virtual processor */
     vps = (int *)xmalloc(num_vp * sizeof(int));
 
     /* save the number of virtual processor */
-    num_vps = num_vp;
+    mltp_counts.num_vps = num_vp;
+    mltp_counts.idle_vps = 0;
+
+    if (num_vp > mltp_live_vps)
+    {
+        /* idle VPs sum the thread counts of every VP that's been used */
+        mltp_live_vps = num_vp;
+    }
 
     /* allocate semaphore for signaling start */
     mltp_start_sem = jksem_create();
@@ -552,16 +1285,36 @@ void mltp_start(int num_vp)
         vps[i] = jkthread_create(mltp_body, (void *)(num_vp - i - 1), 0, NULL);
     }
 
+    /* start a process to watch the quanta for mltp_maybe_yield */
+    ticker = 0;
+
+    if (mltp_yield_quantum)
+    {
+        mltp_ticking = 1;
+        ticker = jkthread_create(mltp_ticker, NULL, 0, NULL);
+    }
+
     /* now wait for all the threads to join */
     for (i = 0; i < num_vp; i++)
     {
         jkthread_join(vps[i]);
     }
 
+    if (ticker > 0)
+    {
+        mltp_ticking = 0;
+        jkthread_join(ticker);
+    }
+
+    mltp_yield_request = 0;
+
+    /* wakeups now go straight to the run queue */
+    mltp_vp_count = 0;
+
     /* clean-up */
     free(vps);
     jksem_kill(mltp_start_sem);
-    mltp_unlock(&start_lock);
+    mltp_spinlock_unlock(&start_lock);
 }
 
 
@@ -590,517 +1343,5838 @@ static void *mltp_starthelp(qt_t *old, void *ignore0, void *ignore1)
 
 
 /****************************************************************************
-*   Function   : mltp_create
-*   Description: This function creates a single parameter thread, allocating
-*                and initializing it's stack, state, and private storage.
-*   Parameters : func - thread's main function
-*                p0 - parameter to func
-*   Effects    : creates thread and makes it runnable.
-*   Returned   : pointer to thread
+*   Function   : mltp_talloc
+*   Description: This function allocates an unbound thread descriptor along
+*                with it's stack.  Private storage is left for
+*                mltp_private_alloc.  It is the common part of mltp_create
+*                and mltp_vcreate.
+*   Parameters : stksize - usable bytes of stack, a multiple of the page
+*                          size
+*                private_size - bytes of private storage, may be 0
+*   Effects    : Thread descriptor and stack are allocated and the number
+*                of user threads is incremented.
+*   Returned   : pointer to thread.  It's stack pointer still needs to be
+*                initialized.
 ****************************************************************************/
-mltp_t *mltp_create(mltp_userf_t *func, void *p0)
+static mltp_t *mltp_talloc(size_t stksize, size_t private_size)
 {
     mltp_t *t;
-    void *sto;
 
     t = xmalloc(sizeof(mltp_t));
+    t->sto = mltp_stack_get(stksize);
 
     /* assign thread next available ID */
-    t->thrid = thr_num;
-    thr_num++;
-    uthreads++;
+    t->thrid = mltp_id_alloc(t);
+    mltp_live_add(1, 0);
+    mltp_tinit(t, stksize, private_size);
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_tinit
+*   Description: This function initializes the fields of a newly allocated
+*                unbound thread descriptor.
+*   Parameters : t - thread, its thrid and sto are already set
+*                stksize - usable bytes of stack at t->sto
+*                private_size - bytes of private storage, may be 0
+*   Effects    : t is initialized.  Its stack is filled if stacks are being
+*                profiled.
+*   Returned   : None
+****************************************************************************/
+static void mltp_tinit(mltp_t *t, size_t stksize, size_t private_size)
+{
     t->type = MLTP_THREAD_UNBOUND;
     t->state = mltpReady;
+    t->retval = NULL;
+    t->priority = 0;
+    t->home_vp = MLTP_VP_ANY;
+    t->name = NULL;
+    t->main_func = NULL;
+    t->coro = NULL;
+    t->task_func = NULL;
+    t->task_arg = NULL;
+
+    /* nobody is waiting for the new thread to exit */
+    t->detached = 0;
+    t->joiners = NULL;
+    mltp_spinlock_init(&(t->join_lock));
+
+    t->stksize = stksize;
+    t->stack_profiled = mltp_stack_profiling;
+
+    if (t->stack_profiled)
+    {
+        /* before anything is pushed, so the fill doesn't clobber it */
+        mltp_stack_fill(t->sto, stksize);
+    }
 
-    /* allocate stack */
-    t->sto = xmalloc(MLTP_STKSIZE);
-    sto = MLTP_STKALIGN(t->sto, QT_STKALIGN);
+    /* private memory section is allocated by first mltp_get_private */
+    t->private_data = NULL;
+    t->private_size = private_size;
 
-    /* allocate and zero private memory section */
-    t->private = xmalloc(MLTP_PRIVATE_SIZE);
-    memset(t->private, 0, MLTP_PRIVATE_SIZE);
+    /* no thread-specific data */
+    memset(t->specific, 0, sizeof(t->specific));
+    t->specific_table = NULL;
+}
 
-    /* push arguments on stack and adjust stack pointer */
-    t->sp = QT_SP(sto, MLTP_STKSIZE - QT_STKALIGN);
-    t->sp = QT_ARGS(t->sp, p0, t, (qt_userf_t *)func, mltp_only);
 
-    /* queue thread */
-    mltp_qput (&mltp_global_runq, t);
+/****************************************************************************
+*   Function   : mltp_stack_round
+*   Description: This function rounds a requested stack size up to the size
+*                that will be allocated.  Sizes up to MLTP_STACK_CLASS_MAX
+*                are rounded to a power of two, so they fall in a size
+*                class.  Larger sizes are rounded to whole pages.  Only
+*                touched pages are committed, so rounding up costs address
+*                space but not memory.
+*   Parameters : stksize - requested bytes of stack, 0 for MLTP_STKSIZE
+*   Effects    : None
+*   Returned   : Usable bytes of stack to allocate
+****************************************************************************/
+static size_t mltp_stack_round(size_t stksize)
+{
+    size_t size;
 
-    return t;
+    if (stksize == 0)
+    {
+        return MLTP_STKSIZE;
+    }
+
+    if (stksize > MLTP_STACK_CLASS_MAX)
+    {
+        return ROUND(stksize, mltp_page_size);
+    }
+
+    for (size = MLTP_STACK_MIN; size < stksize; size <<= 1)
+    {
+        /* find the smallest class that fits */
+    }
+
+    return size;
 }
 
 
 /****************************************************************************
-*   Function   : mltp_vcreate
-*   Description: This function creates a variable parameter thread,
-*                allocating and initializing it's stack, state, and private
-*                storage.
-*   Parameters : func - thread's main function
-*                nbytes - number of bytes of parameter
-*   Effects    : creates thread and makes it runnable.
-*   Returned   : pointer to thread
+*   Function   : mltp_stack_class
+*   Description: This function finds the size class of a stack.
+*   Parameters : stksize - usable bytes of stack
+*   Effects    : None
+*   Returned   : Index into mltp_stack_classes, or -1 if stacks of stksize
+*                aren't pooled.
 ****************************************************************************/
-mltp_t *mltp_vcreate(mltp_vuserf_t *func, int nbytes, ...)
+static int mltp_stack_class(size_t stksize)
+{
+    size_t size;
+    int cls;
+
+    size = MLTP_STACK_MIN;
+
+    for (cls = 0; cls < MLTP_STACK_CLASSES; cls++)
+    {
+        if (size == stksize)
+        {
+            return cls;
+        }
+
+        size <<= 1;
+    }
+
+    return -1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_stack_get
+*   Description: This function allocates a stack.
+*   Parameters : stksize - usable bytes of stack, a multiple of the page
+*                          size
+*   Effects    : A stack is taken from the pool or mapped.
+*   Returned   : Pointer to the lowest usable byte of the stack
+****************************************************************************/
+static void *mltp_stack_get(size_t stksize)
 {
-    mltp_t *t;
-    va_list ap;
     void *sto;
 
-    t = xmalloc(sizeof(mltp_t));
+    mltp_stack_get_n(stksize, &sto, 1);
+    return sto;
+}
 
-    /* assign thread next available ID */
-    t->thrid = thr_num;
-    thr_num++;
-    uthreads++;
-    t->type = MLTP_THREAD_UNBOUND;
-    t->state = mltpReady;
 
-    /* allocate stack */
-    t->sto = xmalloc(MLTP_STKSIZE);
-    sto = MLTP_STKALIGN(t->sto, QT_STKALIGN);
+/****************************************************************************
+*   Function   : mltp_stack_get_n
+*   Description: This function allocates stacks of the same size.  Stacks
+*                in a size class are reused from the class's pool when
+*                available, preferring recently released stacks, whose
+*                pages are still committed.  The pool lock is taken once
+*                and the stacks the pool can't supply are mapped together.
+*   Parameters : stksize - usable bytes of stack, a multiple of the page
+*                          size
+*                stos - set to the lowest usable byte of each stack
+*                n - number of stacks wanted
+*   Effects    : Stacks are taken from the pool or mapped.
+*   Returned   : None
+****************************************************************************/
+static void mltp_stack_get_n(size_t stksize, void **stos, int n)
+{
+    mltp_stack_class_t *cls;
+    void *sto;
+    int i, got;
 
-    /* allocate and zero private memory section */
-    t->private = xmalloc(MLTP_PRIVATE_SIZE);
-    memset(t->private, 0, MLTP_PRIVATE_SIZE);
+    i = mltp_stack_class(stksize);
+    got = 0;
 
-    /* adjust stack pointer */
-    t->sp = QT_SP(sto, MLTP_STKSIZE - QT_STKALIGN);
+    if (i >= 0)
+    {
+        cls = &mltp_stack_classes[i];
+        mltp_spinlock_lock(&(cls->lock));
 
-    /* get arguements and push them on the stack */
-    va_start(ap, nbytes);
-    t->sp = QT_VARGS(t->sp, nbytes, ap, t, mltp_thread_start,
-                     (qt_vuserf_t *)func, mltp_thread_cleanup);
-    va_end(ap);
+        while ((got < n) && (cls->dirty != NULL))
+        {
+            sto = cls->dirty;
+            cls->dirty = *(void **)sto;
+            cls->ndirty--;
+            stos[got++] = sto;
+        }
 
-    mltp_qput(&mltp_global_runq, t);
+        while ((got < n) && (cls->pool != NULL))
+        {
+            sto = cls->pool;
+            cls->pool = *(void **)sto;
+            cls->pooled--;
+            stos[got++] = sto;
+        }
 
-    return t;
+        mltp_spinlock_unlock(&(cls->lock));
+    }
+
+    if (got < n)
+    {
+        mltp_stack_map_n(stksize, stos + got, n - got);
+    }
 }
 
 
 /****************************************************************************
-*   Function   : mltp_create_bound
-*   Description: This function creates a (kernel) thread bound to a process,
-*                allocating and initializing it's stack, state, and private
-*                storage.
-*   Parameters : func - thread's main function
-*                p0 - parameter used by func and term
-*                stacksz - size of stack
-*                term - function called upon thread termination.  This
-*                       function runs in the context of the main thread's
-*                       signal handler
-*   Effects    : creates and starts bound thread.
-*   Returned   : pointer to thread.  Only thrid field has any meaning.
+*   Function   : mltp_stack_put
+*   Description: This function releases a stack allocated by
+*                mltp_stack_get.  Stacks in a size class are kept for
+*                reuse.  When MLTP_STACK_TRIM_BATCH of a class have been
+*                released, their pages are returned to the kernel together
+*                and they join the class's pool.  Stacks beyond
+*                MLTP_STACK_POOL_MAX in a class, and stacks larger than
+*                MLTP_STACK_CLASS_MAX, are unmapped.
+*   Parameters : sto - stack being released
+*                stksize - usable bytes of stack
+*   Effects    : sto is added to the pool or unmapped.
+*   Returned   : None
 ****************************************************************************/
-mltp_t *mltp_create_bound(mltp_buserf_t *func, void *p0, int stacksz,
-                          mltp_buserf_t *term)
+static void mltp_stack_put(void *sto, size_t stksize)
 {
-    mltp_t *t;
+    mltp_stack_class_t *cls;
+    void *trim;
+    int i;
 
-    t = (mltp_t *)xmalloc(sizeof(mltp_t));
-    t->thrid = jkthread_create(func, p0, stacksz, term);
-    t->type = MLTP_THREAD_BOUND;
+    i = mltp_stack_class(stksize);
 
-    return t;
+    if (i < 0)
+    {
+        mltp_stack_unmap(sto, stksize);
+        return;
+    }
+
+    cls = &mltp_stack_classes[i];
+    trim = NULL;
+    mltp_spinlock_lock(&(cls->lock));
+
+    if ((cls->pooled + cls->ndirty) < MLTP_STACK_POOL_MAX)
+    {
+        *(void **)sto = cls->dirty;
+        cls->dirty = sto;
+        cls->ndirty++;
+        sto = NULL;
+
+        if (cls->ndirty >= MLTP_STACK_TRIM_BATCH)
+        {
+            /* take the batch, madvise is too slow to call holding the lock */
+            trim = cls->dirty;
+            cls->dirty = NULL;
+            cls->ndirty = 0;
+            cls->pooled += MLTP_STACK_TRIM_BATCH;
+        }
+    }
+
+    mltp_spinlock_unlock(&(cls->lock));
+
+    if (sto != NULL)
+    {
+        mltp_stack_unmap(sto, stksize);
+    }
+
+    if (trim != NULL)
+    {
+        mltp_stack_trim(cls, trim, stksize);
+    }
 }
 
 
 /****************************************************************************
-*   Function   : mltp_join_bound
-*   Description: This function joins a process with a bound thread.
-*   Parameters : thread - thread structure containing ID of thread being
-*                         joined with.
-*   Effects    : Yields calling process until specified bound thread
-*                terminates.
+*   Function   : mltp_stack_trim
+*   Description: This function returns the pages of a list of unused
+*                stacks to the kernel and adds the stacks to their size
+*                class's clean pool.  The page holding each stack's link is
+*                kept.  The pool count was already raised by the caller.
+*   Parameters : cls - size class the stacks belong to
+*                list - stacks linked through their first word
+*                stksize - usable bytes of each stack
+*   Effects    : The stacks' pages are released, the stacks are pooled.
 *   Returned   : None
-*
-*   NOTE: This funtion sleeps the calling process.  If it is called by an
-*         unbound thread, the VP running the thread will sleep, and not
-*         be able to run other threads.  A unbound thread friendly version
-*         may be made.  It requires checking the list of active jkthreads
-*         and blocking just the unbound thread.  Other tricks can be used
-*         where the bound thread's terminate function calls conditional
-*         broadcast which release all threads waiting on the join condition.
-*   OTHER NOTE: If this function is to be called by a non-parent process,
-*         replace jkthread_join with jkthread_join_any.
 ****************************************************************************/
-void mltp_join_bound(mltp_t thread)
+static void mltp_stack_trim(mltp_stack_class_t *cls, void *list,
+    size_t stksize)
 {
-    jkthread_join(thread.thrid);
+    void *sto, *last;
+
+    last = list;
+
+    for (sto = list; sto != NULL; sto = *(void **)sto)
+    {
+        madvise((char *)sto + mltp_page_size, stksize - mltp_page_size,
+            MADV_DONTNEED);
+        last = sto;
+    }
+
+    mltp_spinlock_lock(&(cls->lock));
+    *(void **)last = cls->pool;
+    cls->pool = list;
+    mltp_spinlock_unlock(&(cls->lock));
 }
 
 
 /****************************************************************************
-*   Function   : mltp_only
-*   Description: This function makes a thread runable, starts its main task,
-*                waits for it's termination and stops the thread.
-*   Parameters : func - thread's main function
-*                pu - parameter to func
-*                pt - pointer to thread
-*   Effects    : Runs threads main function.
-*   Returned   : This function never returns
+*   Function   : mltp_stack_map_n
+*   Description: This function reserves stacks with a single mmap.  The
+*                kernel only commits pages as a stack grows into them.  A
+*                PROT_NONE guard page is placed past the end each stack
+*                grows toward, so an overflow faults instead of corrupting
+*                whatever is mapped beyond it.  Each stack and its guard
+*                page may later be unmapped on its own.
+*   Parameters : stksize - usable bytes of stack, a multiple of the page
+*                          size
+*                stos - set to the lowest usable byte of each stack
+*                n - number of stacks wanted
+*   Effects    : n times stksize plus one page of address space is mapped.
+*   Returned   : None
+****************************************************************************/
+static void mltp_stack_map_n(size_t stksize, void **stos, int n)
+{
+    char *map, *sto, *guard;
+    size_t span;
+    int i;
+
+    span = stksize + mltp_page_size;
+
+    map = (char *)mmap(NULL, span * n, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (map == (char *)MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++, map += span)
+    {
+#ifdef QT_GROW_DOWN
+        guard = map;
+        sto = map + mltp_page_size;
+#else
+        sto = map;
+        guard = map + stksize;
+#endif
+
+        if (mprotect(guard, mltp_page_size, PROT_NONE) != 0)
+        {
+            perror("mprotect");
+            exit(1);
+        }
+
+        stos[i] = sto;
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_stack_unmap
+*   Description: This function unmaps a stack mapped by mltp_stack_map_n,
+*                along with its guard page.
+*   Parameters : sto - lowest usable byte of the stack
+*                stksize - usable bytes of stack
+*   Effects    : The stack's address space is released.
+*   Returned   : None
+****************************************************************************/
+static void mltp_stack_unmap(void *sto, size_t stksize)
+{
+#ifdef QT_GROW_DOWN
+    munmap((char *)sto - mltp_page_size, stksize + mltp_page_size);
+#else
+    munmap(sto, stksize + mltp_page_size);
+#endif
+}
+
+
+/****************************************************************************
+*   Function   : mltp_private_alloc
+*   Description: This function allocates and zeros a thread's private
+*                storage.  It's called by mltp_get_private the first time
+*                a thread asks for the storage.
+*   Parameters : thread - calling thread
+*   Effects    : thread's private storage is allocated, unless its size
+*                is 0.
+*   Returned   : Pointer to the private storage or NULL if there is none.
+****************************************************************************/
+void *mltp_private_alloc(mltp_t *thread)
+{
+    if ((thread->private_data == NULL) && (thread->private_size != 0))
+    {
+        thread->private_data = xmalloc(thread->private_size);
+        memset(thread->private_data, 0, thread->private_size);
+    }
+
+    return thread->private_data;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_key_create
+*   Description: This function creates a thread-specific data key.  Every
+*                thread's value for the new key is NULL.
+*   Parameters : key - set to the new key
+*                destructor - called with a thread's non-NULL value when
+*                             the thread exits, may be NULL
+*   Effects    : A key slot is taken.
+*   Returned   : 0 for success, -1 if MLTP_KEYS_MAX keys already exist.
+****************************************************************************/
+int mltp_key_create(mltp_key_t *key, mltp_key_destructor_t *destructor)
+{
+    unsigned int i;
+
+    mltp_spinlock_lock(&mltp_key_lock);
+
+    for (i = 0; i < MLTP_KEYS_MAX; i++)
+    {
+        if ((mltp_keys[i].seq & 1) == 0)
+        {
+            /* destructor must be visible before the key is in use */
+            mltp_keys[i].destructor = destructor;
+            mltp_atomic_fetch_add(&(mltp_keys[i].seq), 1, MLTP_RELEASE);
+            mltp_spinlock_unlock(&mltp_key_lock);
+
+            *key = i;
+            return 0;
+        }
+    }
+
+    mltp_spinlock_unlock(&mltp_key_lock);
+    return -1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_key_delete
+*   Description: This function deletes a thread-specific data key.  The
+*                values threads hold for it are dropped without calling
+*                the destructor.
+*   Parameters : key - key being deleted
+*   Effects    : key's slot is freed for reuse.
+*   Returned   : 0 for success, -1 if key doesn't exist.
+****************************************************************************/
+int mltp_key_delete(mltp_key_t key)
+{
+    int result;
+
+    if (key >= MLTP_KEYS_MAX)
+    {
+        return -1;
+    }
+
+    result = -1;
+    mltp_spinlock_lock(&mltp_key_lock);
+
+    if (mltp_keys[key].seq & 1)
+    {
+        mltp_atomic_fetch_add(&(mltp_keys[key].seq), 1, MLTP_RELEASE);
+        mltp_keys[key].destructor = NULL;
+        result = 0;
+    }
+
+    mltp_spinlock_unlock(&mltp_key_lock);
+    return result;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_specific_slot
+*   Description: This function finds where a thread keeps its value for a
+*                key.
+*   Parameters : t - thread
+*                key - key whose value is wanted, less than MLTP_KEYS_MAX
+*                create - non-zero to allocate t's table of values for
+*                         keys past MLTP_KEYS_INLINE if it doesn't have one
+*   Effects    : t's table may be allocated.
+*   Returned   : Pointer to t's value for key, or NULL if the table is
+*                needed and create is 0.
+****************************************************************************/
+static mltp_specific_t *mltp_specific_slot(mltp_t *t, mltp_key_t key,
+    int create)
+{
+    size_t size;
+
+    if (key < MLTP_KEYS_INLINE)
+    {
+        return &(t->specific[key]);
+    }
+
+    if (t->specific_table == NULL)
+    {
+        if (!create)
+        {
+            return NULL;
+        }
+
+        size = (MLTP_KEYS_MAX - MLTP_KEYS_INLINE) * sizeof(mltp_specific_t);
+        t->specific_table = (mltp_specific_t *)xmalloc(size);
+        memset(t->specific_table, 0, size);
+    }
+
+    return &(t->specific_table[key - MLTP_KEYS_INLINE]);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_getspecific
+*   Description: This function gets the calling thread's value for a
+*                thread-specific data key.
+*   Parameters : key - key whose value is wanted
+*   Effects    : None
+*   Returned   : The value, or NULL if none has been set, key doesn't
+*                exist, or the caller isn't an unbound thread.
+****************************************************************************/
+void *mltp_getspecific(mltp_key_t key)
+{
+    mltp_specific_t *slot;
+    mltp_t *self;
+
+    if (key >= MLTP_KEYS_MAX)
+    {
+        return NULL;
+    }
+
+    self = mltp_self();
+
+    if ((self == NULL) || (self->type != MLTP_THREAD_UNBOUND))
+    {
+        return NULL;
+    }
+
+    slot = mltp_specific_slot(self, key, 0);
+
+    if ((slot == NULL) ||
+        (slot->seq != mltp_atomic_load_acquire(&(mltp_keys[key].seq))))
+    {
+        /* never set, or set for a key that has since been deleted */
+        return NULL;
+    }
+
+    return slot->value;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_setspecific
+*   Description: This function sets the calling thread's value for a
+*                thread-specific data key.
+*   Parameters : key - key whose value is being set
+*                value - new value
+*   Effects    : The calling thread's value for key is set.
+*   Returned   : 0 for success, -1 if key doesn't exist or the caller isn't
+*                an unbound thread.
+****************************************************************************/
+int mltp_setspecific(mltp_key_t key, const void *value)
+{
+    mltp_specific_t *slot;
+    mltp_t *self;
+    unsigned int seq;
+
+    if (key >= MLTP_KEYS_MAX)
+    {
+        return -1;
+    }
+
+    seq = mltp_atomic_load_acquire(&(mltp_keys[key].seq));
+    self = mltp_self();
+
+    if (((seq & 1) == 0) || (self == NULL) ||
+        (self->type != MLTP_THREAD_UNBOUND))
+    {
+        return -1;
+    }
+
+    slot = mltp_specific_slot(self, key, 1);
+    slot->value = (void *)value;
+    slot->seq = seq;
+
+    return 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_key_destroy
+*   Description: This function calls the destructors for an exiting
+*                thread's thread-specific data.  Destructors may set new
+*                values, so the keys are swept until a sweep calls no
+*                destructors or MLTP_KEY_ITERATIONS sweeps have been made.
+*   Parameters : t - exiting thread, the caller
+*   Effects    : Destructors are called and t's values are cleared.
+*   Returned   : None
+****************************************************************************/
+static void mltp_key_destroy(mltp_t *t)
+{
+    mltp_specific_t *slot;
+    mltp_key_destructor_t *destructor;
+    void *value;
+    mltp_key_t key;
+    int sweep, called;
+
+    for (sweep = 0; sweep < MLTP_KEY_ITERATIONS; sweep++)
+    {
+        called = 0;
+
+        for (key = 0; key < MLTP_KEYS_MAX; key++)
+        {
+            slot = mltp_specific_slot(t, key, 0);
+
+            if (slot == NULL)
+            {
+                /* no table, the rest of the keys have no values */
+                break;
+            }
+
+            if ((slot->value == NULL) || (slot->seq != mltp_keys[key].seq))
+            {
+                continue;
+            }
+
+            value = slot->value;
+            slot->value = NULL;
+            destructor = mltp_keys[key].destructor;
+
+            if (destructor != NULL)
+            {
+                destructor(value);
+                called = 1;
+            }
+        }
+
+        if (!called)
+        {
+            break;
+        }
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_id_slot
+*   Description: This function finds an entry in the thread ID table.
+*                Pages of the table are allocated as they're needed and
+*                installed with compare and swap, so readers never lock.
+*   Parameters : slot - index of the entry
+*                create - non-zero to allocate the entry's page if needed
+*   Effects    : A page of the table may be allocated.
+*   Returned   : Pointer to the entry, or NULL if its page doesn't exist
+*                and create is 0.
+****************************************************************************/
+static mltp_id_slot_t *mltp_id_slot(unsigned int slot, int create)
+{
+    mltp_id_slot_t *page;
+    unsigned int index;
+
+    index = slot / MLTP_ID_PAGE_SLOTS;
+
+    if (index >= MLTP_ID_PAGES)
+    {
+        if (create)
+        {
+            fprintf(stderr, "Only %d threads may exist at once.\n",
+                MLTP_ID_PAGES * MLTP_ID_PAGE_SLOTS);
+            exit(1);
+        }
+
+        return NULL;
+    }
+
+    page = mltp_atomic_load_acquire(&mltp_id_pages[index]);
+
+    if ((page == NULL) && create)
+    {
+        page = (mltp_id_slot_t *)xmalloc(MLTP_ID_PAGE_SLOTS *
+            sizeof(mltp_id_slot_t));
+        memset(page, 0, MLTP_ID_PAGE_SLOTS * sizeof(mltp_id_slot_t));
+
+        if (!mltp_atomic_cas(&mltp_id_pages[index], NULL, page))
+        {
+            /* another VP beat us to it */
+            free(page);
+            page = mltp_atomic_load_acquire(&mltp_id_pages[index]);
+        }
+    }
+
+    return (page == NULL) ? NULL : &page[slot % MLTP_ID_PAGE_SLOTS];
+}
+
+
+/****************************************************************************
+*   Function   : mltp_id_alloc
+*   Description: This function assigns an ID to a new thread or task.
+*                Callers on a VP take a slot from the VP's own free list or
+*                block, so they rarely touch shared data.  Other callers
+*                take one from the shared free list.
+*   Parameters : t - thread getting the ID
+*   Effects    : A slot in the ID table is set to t.
+*   Returned   : t's ID
+****************************************************************************/
+static mltp_id_t mltp_id_alloc(mltp_t *t)
+{
+    mltp_vp_local_t *vp;
+    mltp_id_slot_t *entry;
+    unsigned int slot;
+
+    /* the VP's ID cache is only ours until we're preempted */
+    MLTP_PREEMPT_OFF();
+    vp = (mltp_vp_local_t *)jkthread_getlocal();
+
+    if (vp != NULL)
+    {
+        if ((vp->id_free == MLTP_ID_NONE) && (vp->id_next == vp->id_end))
+        {
+            mltp_id_refill(vp);
+        }
+
+        if (vp->id_free != MLTP_ID_NONE)
+        {
+            slot = vp->id_free;
+            vp->id_free = mltp_id_slot(slot, 0)->next;
+            vp->id_nfree--;
+        }
+        else
+        {
+            slot = vp->id_next++;
+        }
+    }
+    else
+    {
+        mltp_spinlock_lock(&mltp_id_lock);
+        slot = mltp_id_free;
+
+        if (slot != MLTP_ID_NONE)
+        {
+            mltp_id_free = mltp_id_slot(slot, 0)->next;
+            mltp_id_nfree--;
+        }
+
+        mltp_spinlock_unlock(&mltp_id_lock);
+
+        if (slot == MLTP_ID_NONE)
+        {
+            slot = mltp_atomic_fetch_add(&mltp_id_fresh, 1, MLTP_RELAXED);
+        }
+    }
+
+    MLTP_PREEMPT_ON();
+
+    entry = mltp_id_slot(slot, 1);
+    mltp_atomic_store_release(&(entry->thread), t);
+
+    return MLTP_ID_MAKE(entry->gen, slot);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_id_refill
+*   Description: This function gives a VP a block of ID slots, from the
+*                shared free list if it has a block's worth, otherwise
+*                never used ones.
+*   Parameters : vp - VP whose free list and block are empty
+*   Effects    : vp's free list or block is refilled.
+*   Returned   : None
+****************************************************************************/
+static void mltp_id_refill(mltp_vp_local_t *vp)
+{
+    unsigned int last;
+    int i;
+
+    mltp_spinlock_lock(&mltp_id_lock);
+
+    if (mltp_id_nfree >= MLTP_ID_BLOCK)
+    {
+        /* take the first block of the shared list */
+        vp->id_free = mltp_id_free;
+        last = mltp_id_free;
+
+        for (i = 1; i < MLTP_ID_BLOCK; i++)
+        {
+            last = mltp_id_slot(last, 0)->next;
+        }
+
+        mltp_id_free = mltp_id_slot(last, 0)->next;
+        mltp_id_slot(last, 0)->next = MLTP_ID_NONE;
+        mltp_id_nfree -= MLTP_ID_BLOCK;
+        vp->id_nfree = MLTP_ID_BLOCK;
+    }
+
+    mltp_spinlock_unlock(&mltp_id_lock);
+
+    if (vp->id_free == MLTP_ID_NONE)
+    {
+        vp->id_next = mltp_atomic_fetch_add(&mltp_id_fresh, MLTP_ID_BLOCK,
+            MLTP_RELAXED);
+        vp->id_end = vp->id_next + MLTP_ID_BLOCK;
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_id_release
+*   Description: This function frees the ID of a thread that has exited.
+*                The slot's generation is bumped first, so lookups of the
+*                old ID fail from then on.
+*   Parameters : id - ID being freed
+*   Effects    : The ID's slot is put on a free list.  If the calling VP's
+*                list has grown past two blocks, a block is moved to the
+*                shared list.
+*   Returned   : None
+****************************************************************************/
+static void mltp_id_release(mltp_id_t id)
+{
+    mltp_vp_local_t *vp;
+    mltp_id_slot_t *entry;
+    unsigned int slot;
+
+    slot = MLTP_ID_SLOT(id);
+    entry = mltp_id_slot(slot, 0);
+    entry->thread = NULL;
+    mltp_atomic_fetch_add(&(entry->gen), 1, MLTP_RELEASE);
+
+    MLTP_PREEMPT_OFF();
+    vp = (mltp_vp_local_t *)jkthread_getlocal();
+
+    if (vp != NULL)
+    {
+        entry->next = vp->id_free;
+        vp->id_free = slot;
+        vp->id_nfree++;
+
+        if (vp->id_nfree > (2 * MLTP_ID_BLOCK))
+        {
+            mltp_id_give_back(vp, MLTP_ID_BLOCK);
+        }
+    }
+    else
+    {
+        mltp_spinlock_lock(&mltp_id_lock);
+        entry->next = mltp_id_free;
+        mltp_id_free = slot;
+        mltp_id_nfree++;
+        mltp_spinlock_unlock(&mltp_id_lock);
+    }
+
+    MLTP_PREEMPT_ON();
+}
+
+
+/****************************************************************************
+*   Function   : mltp_id_give_back
+*   Description: This function moves ID slots from a VP to the shared free
+*                list.  Slots are taken from the VP's free list first, then
+*                from the unused part of its block.
+*   Parameters : vp - VP giving up slots
+*                count - number of slots to move, no more than the VP has
+*   Effects    : The slots are moved to the shared free list.
+*   Returned   : None
+****************************************************************************/
+static void mltp_id_give_back(mltp_vp_local_t *vp, unsigned int count)
+{
+    mltp_id_slot_t *entry;
+    unsigned int first, last, slot, n;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    /* chain the slots being given back */
+    first = MLTP_ID_NONE;
+    last = MLTP_ID_NONE;
+
+    for (n = 0; n < count; n++)
+    {
+        if (vp->id_free != MLTP_ID_NONE)
+        {
+            slot = vp->id_free;
+            entry = mltp_id_slot(slot, 0);
+            vp->id_free = entry->next;
+            vp->id_nfree--;
+        }
+        else
+        {
+            slot = vp->id_next++;
+            entry = mltp_id_slot(slot, 1);
+        }
+
+        entry->next = first;
+        first = slot;
+
+        if (last == MLTP_ID_NONE)
+        {
+            last = slot;
+        }
+    }
+
+    mltp_spinlock_lock(&mltp_id_lock);
+    mltp_id_slot(last, 0)->next = mltp_id_free;
+    mltp_id_free = first;
+    mltp_id_nfree += count;
+    mltp_spinlock_unlock(&mltp_id_lock);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_lookup
+*   Description: This function finds the thread or task with an ID.  The
+*                slot's generation is read before and after its thread, so
+*                a slot freed and reused while it's being read isn't
+*                mistaken for the thread with the ID.
+*   Parameters : id - ID of thread wanted
+*   Effects    : None
+*   Returned   : Pointer to the thread, or NULL if it has exited.
+****************************************************************************/
+mltp_t *mltp_lookup(mltp_id_t id)
+{
+    mltp_id_slot_t *entry;
+    mltp_t *t;
+    unsigned int slot, gen;
+
+    if (id <= 0)
+    {
+        return NULL;
+    }
+
+    slot = MLTP_ID_SLOT(id);
+    entry = mltp_id_slot(slot, 0);
+
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    gen = mltp_atomic_load_acquire(&(entry->gen));
+
+    if (MLTP_ID_MAKE(gen, slot) != id)
+    {
+        return NULL;
+    }
+
+    t = mltp_atomic_load_acquire(&(entry->thread));
+
+    if (mltp_atomic_load_acquire(&(entry->gen)) != gen)
+    {
+        return NULL;
+    }
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_stack_fill
+*   Description: This function fills a stack with MLTP_STACK_CANARY, so
+*                mltp_stack_depth can later find how much was used.
+*   Parameters : sto - lowest usable byte of the stack
+*                stksize - usable bytes of stack
+*   Effects    : Every word of the stack is set, committing its pages.
+*   Returned   : None
+****************************************************************************/
+static void mltp_stack_fill(void *sto, size_t stksize)
+{
+    unsigned long *word, *end;
+
+    end = (unsigned long *)((char *)sto + stksize);
+
+    for (word = (unsigned long *)sto; word < end; word++)
+    {
+        *word = MLTP_STACK_CANARY;
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_stack_depth
+*   Description: This function finds the high-water mark of a stack filled
+*                by mltp_stack_fill.  It scans from the end the stack grows
+*                toward for the first word that isn't the canary.
+*   Parameters : sto - lowest usable byte of the stack
+*                stksize - usable bytes of stack
+*   Effects    : None
+*   Returned   : Most bytes of the stack that have been used
+****************************************************************************/
+static size_t mltp_stack_depth(void *sto, size_t stksize)
+{
+    unsigned long *word, *start, *end;
+
+    start = (unsigned long *)sto;
+    end = (unsigned long *)((char *)sto + stksize);
+
+#ifdef QT_GROW_DOWN
+    for (word = start; (word < end) && (*word == MLTP_STACK_CANARY); word++);
+    return (char *)end - (char *)word;
+#else
+    for (word = end; (word > start) && (word[-1] == MLTP_STACK_CANARY);
+        word--);
+    return (char *)word - (char *)start;
+#endif
+}
+
+
+/****************************************************************************
+*   Function   : mltp_stack_record
+*   Description: This function adds the stack use of an exiting profiled
+*                thread to the histogram for its main function.
+*   Parameters : t - thread whose stack is being measured
+*   Effects    : The thread's main function's histogram is updated.  If
+*                the function is new and the table is full, the thread is
+*                counted in mltp_stack_unprofiled instead.
+*   Returned   : None
+****************************************************************************/
+static void mltp_stack_record(mltp_t *t)
+{
+    mltp_stack_profile_t *prof;
+    size_t used, size;
+    int i, cls;
+
+    used = mltp_stack_depth(t->sto, t->stksize);
+
+    /* smallest class the thread would have fit in */
+    size = MLTP_STACK_MIN;
+
+    for (cls = 0; (cls < MLTP_STACK_CLASSES) && (size < used); cls++)
+    {
+        size <<= 1;
+    }
+
+    mltp_spinlock_lock(&mltp_profile_lock);
+
+    prof = NULL;
+
+    for (i = 0; i < mltp_stack_nprofiles; i++)
+    {
+        if (mltp_stack_profiles[i].func == t->main_func)
+        {
+            prof = &mltp_stack_profiles[i];
+            break;
+        }
+    }
+
+    if ((prof == NULL) && (mltp_stack_nprofiles < MLTP_PROFILE_FUNCS))
+    {
+        prof = &mltp_stack_profiles[mltp_stack_nprofiles];
+        mltp_stack_nprofiles++;
+        memset(prof, 0, sizeof(mltp_stack_profile_t));
+        prof->func = t->main_func;
+    }
+
+    if (prof == NULL)
+    {
+        mltp_stack_unprofiled++;
+    }
+    else
+    {
+        if ((prof->name == NULL) && (t->name != NULL))
+        {
+            prof->name = t->name;
+        }
+
+        prof->threads++;
+        prof->classes[cls]++;
+
+        if (used > prof->max_used)
+        {
+            prof->max_used = used;
+        }
+    }
+
+    mltp_spinlock_unlock(&mltp_profile_lock);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_set_stack_profile
+*   Description: This function turns stack profiling on or off.  Turning
+*                it on clears the histograms from earlier runs.
+*   Parameters : on - non-zero to fill and measure the stacks of threads
+*                     created from now on
+*   Effects    : Profiling is turned on or off.
+*   Returned   : None
+****************************************************************************/
+void mltp_set_stack_profile(int on)
+{
+    if (on)
+    {
+        mltp_spinlock_lock(&mltp_profile_lock);
+        mltp_stack_nprofiles = 0;
+        mltp_stack_unprofiled = 0;
+        mltp_spinlock_unlock(&mltp_profile_lock);
+    }
+
+    mltp_stack_profiling = (on != 0);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_stack_used
+*   Description: This function measures the stack use of a profiled thread
+*                while it's still alive.
+*   Parameters : thread - thread being measured.  It must not have exited.
+*   Effects    : None
+*   Returned   : Most bytes of stack thread has used so far, or 0 if it
+*                isn't being profiled.
+****************************************************************************/
+size_t mltp_stack_used(mltp_t *thread)
+{
+    if ((thread->type != MLTP_THREAD_UNBOUND) || !thread->stack_profiled)
+    {
+        return 0;
+    }
+
+    return mltp_stack_depth(thread->sto, thread->stksize);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_stack_report
+*   Description: This function writes the stack use histogram of each
+*                profiled main function to stdout.  The recommended stack
+*                is the smallest size class holding the deepest use seen
+*                plus 1/MLTP_PROFILE_HEADROOM for paths the run missed.
+*   Parameters : None
+*   Effects    : The report is written to stdout.
+*   Returned   : None
+****************************************************************************/
+void mltp_stack_report(void)
+{
+    mltp_stack_profile_t *prof;
+    size_t size;
+    int i, cls;
+
+    mltp_spinlock_lock(&mltp_profile_lock);
+
+    printf("Stack use by thread main function:\n");
+    printf("%-18s %8s %10s", "function", "threads", "max used");
+
+    for (cls = 0, size = MLTP_STACK_MIN; cls < MLTP_STACK_CLASSES; cls++)
+    {
+        printf(" %6luK", (unsigned long)(size / 1024));
+        size <<= 1;
+    }
+
+    printf(" %7s %10s\n", "larger", "recommend");
+
+    for (i = 0; i < mltp_stack_nprofiles; i++)
+    {
+        prof = &mltp_stack_profiles[i];
+
+        if (prof->name != NULL)
+        {
+            printf("%-18s", prof->name);
+        }
+        else
+        {
+            printf("%-18p", prof->func);
+        }
+
+        printf(" %8ld %10lu", prof->threads, (unsigned long)prof->max_used);
+
+        for (cls = 0; cls <= MLTP_STACK_CLASSES; cls++)
+        {
+            printf(" %7ld", prof->classes[cls]);
+        }
+
+        size = mltp_stack_round(prof->max_used +
+            (prof->max_used / MLTP_PROFILE_HEADROOM) + 1);
+        printf(" %10lu\n", (unsigned long)size);
+    }
+
+    if (mltp_stack_unprofiled != 0)
+    {
+        printf("%ld threads of other functions weren't profiled\n",
+            mltp_stack_unprofiled);
+    }
+
+    mltp_spinlock_unlock(&mltp_profile_lock);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_create
+*   Description: This function creates a single parameter thread, allocating
+*                and initializing it's stack, state, and private storage.
+*   Parameters : func - thread's main function
+*                p0 - parameter to func
+*   Effects    : creates thread and makes it runnable.
+*   Returned   : pointer to thread
+****************************************************************************/
+mltp_t *mltp_create(mltp_userf_t *func, void *p0)
+{
+    mltp_t *t;
+    void *area;
+
+    t = mltp_create_reserve(0, &area);
+    mltp_create_start(t, func, p0);
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_create_reserve
+*   Description: This function allocates a single parameter thread and sets
+*                aside space at the top of its stack, where the caller may
+*                keep data used by the thread (a closure for example).  The
+*                thread isn't runnable until mltp_create_start is called.
+*   Parameters : nbytes - number of bytes to set aside, no more than
+*                         MLTP_RESERVE_MAX
+*                area - set to the MLTP_RESERVE_ALIGN aligned space
+*   Effects    : Thread is allocated.  It counts as a running thread, so
+*                mltp_create_start must be called before mltp_start.
+*   Returned   : Pointer to thread, or NULL if nbytes is too large.
+****************************************************************************/
+mltp_t *mltp_create_reserve(int nbytes, void **area)
+{
+    return mltp_reserve(NULL, nbytes, area);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_create_sized
+*   Description: This function creates a single parameter thread with a
+*                stack of the requested size.  Stack pages are only
+*                committed as they're used, so large stacks cost address
+*                space but not memory until the thread needs them.
+*   Parameters : func - thread's main function
+*                p0 - parameter to func
+*                stksize - bytes of stack, 0 for MLTP_STKSIZE.  It is
+*                          rounded up as described for mltp_create_attr.
+*   Effects    : creates thread and makes it runnable.
+*   Returned   : pointer to thread
+****************************************************************************/
+mltp_t *mltp_create_sized(mltp_userf_t *func, void *p0, size_t stksize)
+{
+    mltp_attr_t attr;
+
+    mltp_attr_init(&attr);
+    attr.stksize = stksize;
+
+    return mltp_create_attr(&attr, func, p0);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_attr_init
+*   Description: This function sets a thread attribute object to the
+*                attributes of threads created by mltp_create.
+*   Parameters : attr - attribute object being initialized
+*   Effects    : attr holds the default attributes.
+*   Returned   : None
+****************************************************************************/
+void mltp_attr_init(mltp_attr_t *attr)
+{
+    static const mltp_attr_t defaults = MLTP_ATTR_INITIALIZER;
+
+    *attr = defaults;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_create_attr
+*   Description: This function creates a single parameter thread with the
+*                stack size, private storage, priority, home VP, detach
+*                state, and name given by an attribute object.
+*   Parameters : attr - thread attributes, NULL for the defaults
+*                func - thread's main function
+*                p0 - parameter to func
+*   Effects    : creates thread and makes it runnable.
+*   Returned   : pointer to thread.  It may not be referenced after the
+*                thread runs if attr->detached is set.
+****************************************************************************/
+mltp_t *mltp_create_attr(const mltp_attr_t *attr, mltp_userf_t *func,
+    void *p0)
+{
+    mltp_t *t;
+    void *area;
+
+    t = mltp_reserve(attr, 0, &area);
+    mltp_create_start(t, func, p0);
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_create_n
+*   Description: This function creates n single parameter threads running
+*                the same function, with the defaults of mltp_create.  The
+*                stacks are taken from the pool under one lock acquisition
+*                and the rest are mapped together.  The user thread count
+*                is raised with one atomic add, and the threads are queued
+*                as one list, so each run queue lock is taken once.
+*   Parameters : n - number of threads to create
+*                func - threads' main function
+*                args - args[i] is passed to func by thread i, NULL passes
+*                       NULL to every thread
+*                out - out[i] is set to thread i.  Each is freed with free,
+*                      the same as threads from mltp_create.
+*   Effects    : creates the threads and makes them runnable.
+*   Returned   : 0 for success, -1 if n is less than 1.
+****************************************************************************/
+int mltp_create_n(int n, mltp_userf_t *func, void **args, mltp_t **out)
+{
+    mltp_t *t;
+    void **stos;
+    char *sto;
+    int i;
+
+    if (n < 1)
+    {
+        return -1;
+    }
+
+    stos = (void **)xmalloc(n * sizeof(void *));
+    mltp_stack_get_n(MLTP_STKSIZE, stos, n);
+
+    mltp_live_add(n, 0);
+
+    for (i = 0; i < n; i++)
+    {
+        t = (mltp_t *)xmalloc(sizeof(mltp_t));
+        t->sto = stos[i];
+        t->thrid = mltp_id_alloc(t);
+        mltp_tinit(t, MLTP_STKSIZE, MLTP_PRIVATE_SIZE);
+        t->main_func = (void *)func;
+
+        /* push arguments on stack and adjust stack pointer */
+        sto = (char *)MLTP_STKALIGN(t->sto, QT_STKALIGN);
+        t->sp = QT_SP(sto, MLTP_STKSIZE - QT_STKALIGN);
+        t->sp = QT_ARGS(t->sp, (args == NULL) ? NULL : args[i], t,
+            (qt_userf_t *)func, mltp_only);
+
+        /* chain the threads for the queue */
+        if (i > 0)
+        {
+            out[i - 1]->next = t;
+        }
+
+        out[i] = t;
+    }
+
+    free(stos);
+
+    /* queue them all at once */
+    mltp_sched_put(out[0], out[n - 1], MLTP_SCHED_NEW);
+
+    return 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_reserve
+*   Description: This function does the work of mltp_create_reserve for a
+*                thread with any attributes.
+*   Parameters : attr - thread attributes, NULL for the defaults
+*                nbytes - number of bytes to set aside, no more than
+*                         MLTP_RESERVE_MAX
+*                area - set to the MLTP_RESERVE_ALIGN aligned space
+*   Effects    : Thread is allocated.
+*   Returned   : Pointer to thread, or NULL if nbytes is too large.
+****************************************************************************/
+static mltp_t *mltp_reserve(const mltp_attr_t *attr, int nbytes,
+    void **area)
+{
+    mltp_t *t;
+    char *sto, *top;
+    size_t stksize;
+
+    if ((nbytes < 0) || (nbytes > MLTP_RESERVE_MAX))
+    {
+        return NULL;
+    }
+
+    if (attr == NULL)
+    {
+        stksize = MLTP_STKSIZE;
+        t = mltp_talloc(stksize, MLTP_PRIVATE_SIZE);
+    }
+    else
+    {
+        stksize = mltp_stack_round(attr->stksize);
+        t = mltp_talloc(stksize, attr->private_size);
+        t->priority = attr->priority;
+        t->home_vp = attr->vp;
+        t->name = attr->name;
+        t->detached = (attr->detached != 0);
+    }
+
+    sto = (char *)MLTP_STKALIGN(t->sto, QT_STKALIGN);
+
+#ifdef QT_GROW_DOWN
+    /* reserved area is above the first frame */
+    top = sto + stksize - QT_STKALIGN - nbytes;
+    top = (char *)((qt_word_t)top & ~(qt_word_t)(MLTP_RESERVE_ALIGN - 1));
+    *area = top;
+    t->sp = QT_SP(sto, top - sto);
+#else
+    /* reserved area is below the first frame */
+    *area = sto;
+    top = (char *)MLTP_STKALIGN(sto + nbytes, MLTP_RESERVE_ALIGN);
+    t->sp = QT_SP(top, stksize - QT_STKALIGN - (top - sto));
+#endif
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_create_start
+*   Description: This function makes a thread allocated by
+*                mltp_create_reserve runnable.
+*   Parameters : thread - thread from mltp_create_reserve
+*                func - thread's main function
+*                p0 - parameter to func
+*   Effects    : Arguments are pushed on thread's stack and it is queued.
+*   Returned   : None
+****************************************************************************/
+void mltp_create_start(mltp_t *thread, mltp_userf_t *func, void *p0)
+{
+    thread->main_func = (void *)func;
+
+    /* push arguments on stack and adjust stack pointer */
+    thread->sp = QT_ARGS(thread->sp, p0, thread, (qt_userf_t *)func,
+        mltp_only);
+
+    /* queue thread */
+    mltp_sched_put(thread, thread, MLTP_SCHED_NEW);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_vcreate
+*   Description: This function creates a variable parameter thread,
+*                allocating and initializing it's stack, state, and private
+*                storage.
+*   Parameters : func - thread's main function
+*                nbytes - number of bytes of parameter
+*   Effects    : creates thread and makes it runnable.
+*   Returned   : pointer to thread
+****************************************************************************/
+mltp_t *mltp_vcreate(mltp_vuserf_t *func, int nbytes, ...)
+{
+    mltp_t *t;
+    va_list ap;
+    void *sto;
+
+    t = mltp_talloc(MLTP_STKSIZE, MLTP_PRIVATE_SIZE);
+    sto = MLTP_STKALIGN(t->sto, QT_STKALIGN);
+
+    /* adjust stack pointer */
+    t->sp = QT_SP(sto, MLTP_STKSIZE - QT_STKALIGN);
+
+    t->main_func = (void *)func;
+
+    /* get arguements and push them on the stack */
+    va_start(ap, nbytes);
+    t->sp = QT_VARGS(t->sp, nbytes, ap, t, mltp_thread_start,
+                     (qt_vuserf_t *)func, mltp_thread_cleanup);
+    va_end(ap);
+
+    mltp_sched_put(t, t, MLTP_SCHED_NEW);
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_create_bound
+*   Description: This function creates a (kernel) thread bound to a process,
+*                allocating and initializing it's stack, state, and private
+*                storage.
+*   Parameters : func - thread's main function
+*                p0 - parameter used by func and term
+*                stacksz - size of stack
+*                term - function called upon thread termination.  This
+*                       function runs in the context of the main thread's
+*                       signal handler
+*   Effects    : creates and starts bound thread.
+*   Returned   : pointer to thread.  Only thrid field has any meaning.
+****************************************************************************/
+mltp_t *mltp_create_bound(mltp_buserf_t *func, void *p0, int stacksz,
+                          mltp_buserf_t *term)
+{
+    mltp_t *t;
+
+    t = (mltp_t *)xmalloc(sizeof(mltp_t));
+    t->thrid = jkthread_create(func, p0, stacksz, term);
+    t->type = MLTP_THREAD_BOUND;
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_join_bound
+*   Description: This function joins a process with a bound thread.
+*   Parameters : thread - thread structure containing ID of thread being
+*                         joined with.
+*   Effects    : Yields calling process until specified bound thread
+*                terminates.
+*   Returned   : None
+*
+*   NOTE: This funtion sleeps the calling process.  If it is called by an
+*         unbound thread, the VP running the thread will sleep, and not
+*         be able to run other threads.  A unbound thread friendly version
+*         may be made.  It requires checking the list of active jkthreads
+*         and blocking just the unbound thread.  Other tricks can be used
+*         where the bound thread's terminate function calls conditional
+*         broadcast which release all threads waiting on the join condition.
+*   OTHER NOTE: If this function is to be called by a non-parent process,
+*         replace jkthread_join with jkthread_join_any.
+****************************************************************************/
+void mltp_join_bound(mltp_t thread)
+{
+    jkthread_join(thread.thrid);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_join
+*   Description: This function waits for an unbound thread to exit and
+*                returns the thread's return value.  Unbound callers are
+*                parked on the completion queue of the thread being joined,
+*                any other caller yields its process until the thread exits.
+*   Parameters : thread - thread being joined with
+*                retval - where to store thread's return value (may be NULL)
+*   Effects    : Calling thread is blocked until thread exits.
+*   Returned   : 0 for success, -1 if thread may not be joined.
+*
+*   NOTE: The joined thread's descriptor is not freed.  Like descriptors of
+*         threads that are never joined, it is up to the caller to free it.
+****************************************************************************/
+int mltp_join(mltp_t *thread, void **retval)
+{
+    mltp_t *old, *mainthread;
+    mltp_vp_local_t *mltp_vp_local;
+
+    if ((thread->type != MLTP_THREAD_UNBOUND) || thread->detached)
+    {
+        return -1;
+    }
+
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    if (mltp_vp_local == NULL)
+    {
+        /* not an unbound thread, there's no thread to park */
+        while (thread->state != mltpExited)
+        {
+            sched_yield();
+        }
+    }
+    else if (thread->state != mltpExited)
+    {
+        if (thread == mltp_vp_local->vp_curr)
+        {
+            /* joining self would never return */
+            MLTP_PREEMPT_ON();
+            return -1;
+        }
+
+        /* make current thread blocked and switch to main thread */
+        mainthread = &(mltp_vp_local->vp_main);
+        old = mltp_vp_local->vp_curr;
+        old->state = mltpBlock;
+        mltp_vp_local->vp_curr = mainthread;
+        mainthread->state = mltpRunning;
+
+        /* block old thread on joined thread's completion queue */
+        QT_BLOCK(mltp_joinhelp, old, thread, mainthread->sp);
+    }
+
+    MLTP_PREEMPT_ON();
+
+    /* exiting thread may still hold the join lock, wait for it to let go */
+    mltp_spinlock_lock(&(thread->join_lock));
+    mltp_spinlock_unlock(&(thread->join_lock));
+
+    if (retval != NULL)
+    {
+        *retval = thread->retval;
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_joinhelp
+*   Description: This function handles the stack save and parking of a
+*                joining thread.  If the thread being joined has already
+*                exited, the joining thread is made runnable again.
+*   Parameters : sp - quick threads handle of the joining thread
+*                old - the joining thread
+*                thread - the thread being joined
+*   Effects    : The joining thread is placed on thread's completion queue
+*                or the end of the run queue.
+*   Returned   : None
+****************************************************************************/
+static void *mltp_joinhelp(qt_t *sp, void *old, void *thread)
+{
+    mltp_t *t;
+
+    t = (mltp_t *)thread;
+    ((mltp_t *)old)->sp = sp;
+    mltp_sched_block((mltp_t *)old);
+
+    mltp_spinlock_lock(&(t->join_lock));
+
+    if (t->state == mltpExited)
+    {
+        /* exited before we could park */
+        mltp_spinlock_unlock(&(t->join_lock));
+        mltp_wake((mltp_t *)old);
+    }
+    else
+    {
+        ((mltp_t *)old)->next = t->joiners;
+        t->joiners = (mltp_t *)old;
+        mltp_spinlock_unlock(&(t->join_lock));
+    }
+
+    return (old);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_detach
+*   Description: This function marks an unbound thread as detached, so that
+*                its descriptor is freed as soon as it exits.
+*   Parameters : thread - thread being detached
+*   Effects    : thread is marked detached.  If it has already exited, its
+*                descriptor is freed.
+*   Returned   : 0 for success, -1 if thread may not be detached.
+*
+*   NOTE: thread may not be referenced after it has been detached.
+****************************************************************************/
+int mltp_detach(mltp_t *thread)
+{
+    if ((thread->type != MLTP_THREAD_UNBOUND) || thread->detached)
+    {
+        return -1;
+    }
+
+    mltp_spinlock_lock(&(thread->join_lock));
+
+    if (thread->state == mltpExited)
+    {
+        /* already gone, recycle the descriptor now */
+        mltp_spinlock_unlock(&(thread->join_lock));
+        free(thread);
+    }
+    else
+    {
+        thread->detached = 1;
+        mltp_spinlock_unlock(&(thread->join_lock));
+    }
+
+    return 0;
+}
+
+/****************************************************************************
+*   Function   : mltp_only
+*   Description: This function makes a thread runable, starts its main task,
+*                waits for it's termination and stops the thread.
+*   Parameters : func - thread's main function
+*                pu - parameter to func
+*                pt - pointer to thread
+*   Effects    : Runs threads main function.
+*   Returned   : This function never returns
+****************************************************************************/
+static void mltp_only(void *pu, void *pt, qt_userf_t *f)
+{
+    /* VP main thread switched to us with preemption off */
+    MLTP_PREEMPT_ON();
+
+    /* set thread's state to running */
+    ((mltp_t*)pt)->state = mltpRunning;
+
+    /* call thread's main function and store return value */
+    ((mltp_t*)pt)->retval = (*(mltp_userf_t *)f)(pu);
+
+    /* thread function must exit to get here */
+    ((mltp_t*)pt)->state = mltpDone;
+
+     mltp_abort();
+    /* abort should replace return */
+}
+
+
+/****************************************************************************
+*   Function   : mltp_thread_start
+*   Description: This function makes a variable arguement thread runable.
+*   Parameters : pt - pointer to thread
+*   Effects    : Makes thread runnable
+*   Returned   : This function never returns
+****************************************************************************/
+static void mltp_thread_start(void *pt)
+{
+    /* VP main thread switched to us with preemption off */
+    MLTP_PREEMPT_ON();
+
+    /* set thread's state to running */
+    ((mltp_t*)pt)->state = mltpRunning;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_thread_cleanup
+*   Description: The function waits for a thread to return from its main
+*                function, marks it done, and saves the return value.
+*   Parameters : pt - pointer to thread
+*                vuser_retval - value returned
+*   Effects    : handles a thread's termination.
+*   Returned   : This function never returns
+****************************************************************************/
+static void mltp_thread_cleanup(void *pt, void *vuserf_retval)
+{
+    /* thread function must exit to get here */
+    ((mltp_t*)pt)->state = mltpDone;
+
+    /* save the return value */
+    ((mltp_t*)pt)->retval = vuserf_retval;
+
+     mltp_abort();
+    /* abort should replace return */
+}
+
+
+/****************************************************************************
+*   Function   : mltp_abort
+*   Description: This function aborts the current thread.
+*   Parameters : None
+*   Effects    : The current running thread is aborted and the next thread
+*                is made the current running thread.
+*   Returned   : None
+****************************************************************************/
+void mltp_abort(void)
+{
+    mltp_t *old, *mainthread;
+    mltp_vp_local_t *mltp_vp_local;
+
+    /* destructors run as the thread, before it's switched out for good */
+    old = mltp_self();
+
+    if (old != NULL)
+    {
+        mltp_key_destroy(old);
+    }
+
+    /* VP main thread expects preemption to be off */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    /* make current thread done and switch to main thread */
+    mainthread = &(mltp_vp_local->vp_main);
+    old = mltp_vp_local->vp_curr;
+    old->state = mltpDone;
+    mltp_vp_local->vp_curr = mainthread;
+    mainthread->state = mltpRunning;
+
+    /* count the exit on this VP */
+    mltp_live_add(0, 1);
+
+    /* abort old thread */
+    QT_ABORT (mltp_aborthelp, old, (void *)NULL, mainthread->sp);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_aborthelp
+*   Description: This function is a helper function which is used for an
+*                abort call.
+*   Parameters : sp - quick threads handle of main thread
+*                old - the thread being aborted
+*                null - unused parameter, needed for QT_ABORT
+*   Effects    : old's stack, private section, and descriptor (if it's
+*                detached) are put on the VP's zombie list.  Any threads
+*                joining old are made runnable.
+*   Returned   : None
+****************************************************************************/
+static void *mltp_aborthelp(qt_t *sp, void *old, void *null)
+{
+    mltp_t *t, *joiner, *last;
+    mltp_vp_local_t *mltp_vp_local;
+    mltp_zombie_t *zombie;
+    int detached;
+
+    t = (mltp_t *)old;
+    mltp_id_release(t->thrid);          /* lookups no longer find it */
+
+    if (t->stack_profiled)
+    {
+        mltp_stack_record(t);           /* measure before it's reused */
+    }
+
+    /* storage is reclaimed later, off the path back to the scheduler */
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+    zombie = (mltp_zombie_t *)t->sto;
+    zombie->stksize = t->stksize;
+    zombie->private_data = t->private_data;
+    zombie->specific_table = t->specific_table;
+    zombie->descriptor = NULL;
+    zombie->next = mltp_vp_local->zombies;
+    mltp_vp_local->zombies = zombie;
+    mltp_vp_local->nzombies++;
+
+    /* mark the thread exited and take the list of joining threads */
+    mltp_spinlock_lock(&(t->join_lock));
+    t->state = mltpExited;
+    joiner = t->joiners;
+    t->joiners = NULL;
+    detached = t->detached;
+    mltp_spinlock_unlock(&(t->join_lock));
+
+    /* t may be freed by a joiner from here on, don't touch it */
+    if (joiner != NULL)
+    {
+        for (last = joiner; last->next != NULL; last = last->next);
+        mltp_wake_list(joiner, last);
+    }
+
+    if (detached)
+    {
+        zombie->descriptor = t;     /* nobody can join, recycle descriptor */
+    }
+
+    return NULL;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_zombie_reap
+*   Description: This function reclaims the storage of the threads on a
+*                VP's zombie list.  Stacks go back to their pool, private
+*                sections, thread-specific data, and detached descriptors
+*                go back to the heap.
+*   Parameters : vp - VP whose zombie list is reclaimed
+*   Effects    : vp's zombie list is emptied.
+*   Returned   : None
+****************************************************************************/
+static void mltp_zombie_reap(mltp_vp_local_t *vp)
+{
+    mltp_zombie_t *zombie, *next;
+
+    zombie = vp->zombies;
+    vp->zombies = NULL;
+    vp->nzombies = 0;
+
+    while (zombie != NULL)
+    {
+        next = zombie->next;
+        free(zombie->private_data);
+        free(zombie->specific_table);
+        free(zombie->descriptor);
+
+        /* the entry is part of the stack, it's gone after this */
+        mltp_stack_put(zombie, zombie->stksize);
+        zombie = next;
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_yield
+*   Description: This function blocks the current thread.
+*   Parameters : None
+*   Effects    : The current running thread is blocked and put at the end of
+*                the queue and next thread is made the current running
+*                thread.
+*   Returned   : None
+****************************************************************************/
+void mltp_yield()
+{
+    mltp_t *old, *mainthread;
+    mltp_vp_local_t *mltp_vp_local;
+
+    /* don't get moved to another VP while switching */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    /* make current thread done and switch to main thread */
+    mainthread = &(mltp_vp_local->vp_main);
+    old = mltp_vp_local->vp_curr;
+    old->state = mltpBlock;
+    mltp_vp_local->vp_curr = mainthread;
+    mainthread->state = mltpRunning;
+
+    /* block old thread */
+    QT_BLOCK(mltp_yieldhelp, old, (void *)MLTP_SCHED_YIELD,
+        mainthread->sp);
+    MLTP_PREEMPT_ON();
+}
+
+
+/****************************************************************************
+*   Function   : mltp_yieldhelp
+*   Description: This function handles the requeuing and stack save of a
+*                yielding thread.
+*   Parameters : sp - quick threads handle of the yielding thread
+*                old - the yielding thread
+*                why - MLTP_SCHED_YIELD or MLTP_SCHED_YIELD_FIRST
+*   Effects    : The yielding thread is handed back to the scheduling
+*                policy and its stack pointer is saved.
+*   Returned   : None
+****************************************************************************/
+static void *mltp_yieldhelp(qt_t *sp, void *old, void *why)
+{
+  ((mltp_t *)old)->sp = sp;
+  mltp_sched_put((mltp_t *)old, (mltp_t *)old, (mltp_sched_why_t)(long)why);
+  return (old);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_yield_to_first
+*   Description: This function blocks the current thread putting it at the
+*                front of the queue.
+*   Parameters : None
+*   Effects    : The current running thread is blocked and put at the head
+*                of the queue and next thread is made the current running
+*                thread.
+*   Returned   : None
+****************************************************************************/
+void mltp_yield_to_first()
+{
+    mltp_t *old, *mainthread;
+    mltp_vp_local_t *mltp_vp_local;
+
+    /* don't get moved to another VP while switching */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    /* make current thread done and switch to main thread */
+    mainthread = &(mltp_vp_local->vp_main);
+    old = mltp_vp_local->vp_curr;
+    old->state = mltpBlock;
+    mltp_vp_local->vp_curr = mainthread;
+    mainthread->state = mltpRunning;
+
+    /* block old thread */
+    QT_BLOCK(mltp_yieldhelp, old, (void *)MLTP_SCHED_YIELD_FIRST,
+        mainthread->sp);
+    MLTP_PREEMPT_ON();
+}
+
+
+/****************************************************************************
+*   Function   : mltp_yield_to
+*   Description: This function hands the calling thread's VP directly to a
+*                thread that has been made runnable by the calling VP and
+*                hasn't been moved to the run queue yet, usually because
+*                the caller just woke it.  The switch goes straight from
+*                one thread to the other without passing through the VP's
+*                main thread or the run queue.
+*   Parameters : thread - thread to run next
+*   Effects    : If thread is waiting in the calling VP's wakeup inbox, the
+*                calling thread is put on the run queue and thread runs in
+*                its place.  Other threads in the inbox are moved to the
+*                run queue.
+*   Returned   : 0 if thread was switched to, -1 if thread wasn't waiting
+*                to run on the caller's VP, in which case the caller keeps
+*                running.
+****************************************************************************/
+int mltp_yield_to(mltp_t *thread)
+{
+    mltp_t *old;
+    mltp_vp_local_t *mltp_vp_local;
+
+    /* don't get moved to another VP while switching */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    if ((mltp_vp_local == NULL) || !mltp_vp_local->alive ||
+        (thread == mltp_vp_local->vp_curr) ||
+        (thread->type != MLTP_THREAD_UNBOUND) ||
+        !mltp_inbox_take(mltp_vp_local, thread))
+    {
+        MLTP_PREEMPT_ON();
+        return -1;
+    }
+
+    if (mltp_sched->on_wake != NULL)
+    {
+        mltp_sched->on_wake(mltp_vp_local->vp_id, thread);
+    }
+
+    /* thread is starting a new quantum */
+    mltp_quantum_start(mltp_vp_local, thread);
+
+    /* make current thread blocked and switch to the new one */
+    old = mltp_vp_local->vp_curr;
+    old->state = mltpBlock;
+    mltp_vp_local->vp_curr = thread;
+    thread->state = mltpRunning;
+
+    /* old thread is requeued from thread's stack */
+    QT_BLOCK(mltp_yieldhelp, old, (void *)MLTP_SCHED_YIELD, thread->sp);
+    MLTP_PREEMPT_ON();
+
+    return 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_coro_create
+*   Description: This function creates a coroutine.  A coroutine is a
+*                function with its own stack that runs on behalf of the
+*                thread resuming it, switching stacks without involving the
+*                scheduler.
+*   Parameters : func - coroutine's main function
+*                arg - parameter to func
+*   Effects    : Coroutine and its stack are allocated.  func doesn't run
+*                until the first mltp_coro_resume.
+*   Returned   : Pointer to coroutine
+****************************************************************************/
+mltp_coro_t *mltp_coro_create(mltp_corof_t *func, void *arg)
+{
+    mltp_coro_t *coro;
+    void *sto;
+
+    coro = (mltp_coro_t *)xmalloc(sizeof(mltp_coro_t));
+    coro->caller = NULL;
+    coro->outer = NULL;
+    coro->value = NULL;
+    coro->done = 0;
+
+    coro->sto = mltp_stack_get(MLTP_STKSIZE);
+    sto = MLTP_STKALIGN(coro->sto, QT_STKALIGN);
+
+    /* push arguments on stack and adjust stack pointer */
+    coro->sp = QT_SP(sto, MLTP_STKSIZE - QT_STKALIGN);
+    coro->sp = QT_ARGS(coro->sp, arg, coro, (qt_userf_t *)func,
+        mltp_coro_only);
+
+    return coro;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_coro_destroy
+*   Description: This function frees a coroutine and returns its stack to
+*                the stack pool.  A coroutine that hasn't finished is
+*                discarded where it last yielded.
+*   Parameters : coro - coroutine being destroyed
+*   Effects    : coro is freed.
+*   Returned   : None
+****************************************************************************/
+void mltp_coro_destroy(mltp_coro_t *coro)
+{
+    mltp_stack_put(coro->sto, MLTP_STKSIZE);
+    free(coro);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_coro_resume
+*   Description: This function switches from the calling thread to a
+*                coroutine, which runs until it yields or returns.  Only
+*                unbound threads may resume coroutines.
+*   Parameters : coro - coroutine being resumed
+*                value - returned to the coroutine by mltp_coro_yield.  The
+*                        value passed to the first resume is dropped.
+*   Effects    : coro runs on behalf of the calling thread until it yields
+*                or returns.
+*   Returned   : Value passed to mltp_coro_yield, or returned by the
+*                coroutine's main function.  NULL if coro has already
+*                finished.
+****************************************************************************/
+void *mltp_coro_resume(mltp_coro_t *coro, void *value)
+{
+    mltp_vp_local_t *mltp_vp_local;
+    mltp_t *self;
+
+    if (coro->done)
+    {
+        return NULL;
+    }
+
+    /* the coroutine and its caller must share a VP while switching */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    if (mltp_vp_local == NULL)
+    {
+        MLTP_PREEMPT_ON();
+        fprintf(stderr, "Coroutine resumed by a non-unbound thread.\n");
+        return NULL;
+    }
+
+    /* coroutines resumed from inside coroutines nest */
+    self = mltp_vp_local->vp_curr;
+    coro->outer = self->coro;
+    self->coro = coro;
+    coro->value = value;
+    mltp_run_bounds(mltp_vp_local, self);
+
+    QT_BLOCK(mltp_corohelp, &(coro->caller), NULL, coro->sp);
+    MLTP_PREEMPT_ON();
+
+    return coro->value;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_coro_yield
+*   Description: This function switches from the coroutine the calling
+*                thread is running in back to whoever resumed it.
+*   Parameters : value - returned by the mltp_coro_resume that ran the
+*                        coroutine
+*   Effects    : The coroutine is suspended until it is resumed again.
+*   Returned   : Value passed to the mltp_coro_resume that continued the
+*                coroutine.  NULL if the caller isn't running in a
+*                coroutine.
+****************************************************************************/
+void *mltp_coro_yield(void *value)
+{
+    mltp_vp_local_t *mltp_vp_local;
+    mltp_coro_t *coro;
+    mltp_t *self;
+
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    /* not running in a coroutine, nothing to yield */
+    if ((mltp_vp_local == NULL) || (mltp_vp_local->vp_curr->coro == NULL))
+    {
+        MLTP_PREEMPT_ON();
+        return NULL;
+    }
+
+    self = mltp_vp_local->vp_curr;
+    coro = self->coro;
+
+    /* the resumer is back in its own code */
+    self->coro = coro->outer;
+    coro->value = value;
+    mltp_run_bounds(mltp_vp_local, self);
+
+    QT_BLOCK(mltp_corohelp, &(coro->sp), NULL, coro->caller);
+    MLTP_PREEMPT_ON();
+
+    return coro->value;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_coro_only
+*   Description: This function is the first thing run on a coroutine's
+*                stack.  It calls the coroutine's main function and passes
+*                its return value back to the last resume.
+*   Parameters : pu - parameter to func
+*                pcoro - pointer to coroutine
+*                f - coroutine's main function
+*   Effects    : Runs coroutine's main function, then marks it done.
+*   Returned   : This function never returns
+****************************************************************************/
+static void mltp_coro_only(void *pu, void *pcoro, qt_userf_t *f)
+{
+    mltp_vp_local_t *mltp_vp_local;
+    mltp_coro_t *coro;
+
+    /* mltp_coro_resume switched to us with preemption off */
+    MLTP_PREEMPT_ON();
+
+    coro = (mltp_coro_t *)pcoro;
+    coro->value = (*(mltp_corof_t *)f)(pu);
+
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+    mltp_vp_local->vp_curr->coro = coro->outer;
+    mltp_run_bounds(mltp_vp_local, mltp_vp_local->vp_curr);
+    coro->done = 1;
+
+    /* nothing on this stack is needed again */
+    QT_ABORT(mltp_corohelp, NULL, NULL, coro->caller);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_corohelp
+*   Description: This function saves the stack pointer of the side of a
+*                coroutine switch that is being suspended.
+*   Parameters : sp - quick threads handle of the suspended side
+*                save - where to store sp (NULL if it isn't needed)
+*                null - unused parameter, needed for QT_BLOCK
+*   Effects    : sp is stored in save.
+*   Returned   : None
+****************************************************************************/
+static void *mltp_corohelp(qt_t *sp, void *save, void *null)
+{
+    if (save != NULL)
+    {
+        *(qt_t **)save = sp;
+    }
+
+    return NULL;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_set_priority
+*   Description: This function sets the priority used when scheduling a
+*                thread with mltp_sched_priority.
+*   Parameters : thread - thread whose priority is being set
+*                priority - new priority, larger values run first
+*   Effects    : thread's priority is changed.  The change takes effect the
+*                next time the thread is made runnable.
+*   Returned   : None
+****************************************************************************/
+void mltp_set_priority(mltp_t *thread, int priority)
+{
+    thread->priority = priority;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_wait_until
+*   Description: This function blocks the calling thread until the value
+*                at addr is no longer old.  Unbound threads are parked on
+*                the watch list of their VP, which checks the value each
+*                time it looks for a thread to run.  The thread isn't
+*                switched back in until the value has changed.  Threads
+*                that aren't unbound spin with sched_yield.
+*   Parameters : addr - address of the word being waited on
+*                old - value the word must change from
+*   Effects    : The calling thread doesn't run until *addr != old.
+*   Returned   : None
+****************************************************************************/
+void mltp_wait_until(volatile unsigned int *addr, unsigned int old)
+{
+    mltp_watch_wait(addr, old, 0);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_watch_wait
+*   Description: This function is mltp_wait_until with a choice of where
+*                the thread is queued once the value has changed.
+*   Parameters : addr - address of the word being waited on
+*                old - value the word must change from
+*                front - non-zero to run the thread ahead of other queued
+*                        threads, like mltp_yield_to_first
+*   Effects    : The calling thread doesn't run until *addr != old.
+*   Returned   : None
+****************************************************************************/
+static void mltp_watch_wait(volatile unsigned int *addr, unsigned int old,
+    int front)
+{
+    mltp_watch_t watch;
+    mltp_t *self;
+
+    if (*addr != old)
+    {
+        /* already changed */
+        return;
+    }
+
+    self = mltp_self();
+
+    if (self == NULL)
+    {
+        /* not an unbound thread, there's no thread to park */
+        while (*addr == old)
+        {
+            sched_yield();
+        }
+
+        return;
+    }
+
+    watch.thread = self;
+    watch.addr = addr;
+    watch.old = old;
+    watch.set = 0;
+    watch.cas = 0;
+    watch.front = front;
+    watch.deadline = 0;
+    watch.next = NULL;
+
+    mltp_block(mltp_watch_park, &watch);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_watch_park
+*   Description: This function is called on the VP main stack to park a
+*                thread blocked by mltp_wait_until on the VP's watch list.
+*                The value is checked once more, in case it changed while
+*                the thread was being switched out.
+*   Parameters : t - thread being parked
+*                watch - the thread's watch list entry
+*   Effects    : t is either added to the VP's watch list or made runnable.
+*   Returned   : None
+****************************************************************************/
+static void mltp_watch_park(mltp_t *t, void *watch)
+{
+    mltp_vp_local_t *mltp_vp_local;
+    mltp_watch_t *w;
+    long long now;
+
+    w = (mltp_watch_t *)watch;
+    now = 0;
+
+    if (mltp_watch_ready(w, &now))
+    {
+        mltp_sched_put(t, t, MLTP_SCHED_WAKE);
+        return;
+    }
+
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+    mltp_watch_add(mltp_vp_local, w);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_watch_add
+*   Description: This function adds an entry to a VP's watch list.  It must
+*                only be called by the VP that owns the list.
+*   Parameters : vp - local structure of calling VP
+*                w - entry being added
+*   Effects    : w is added to vp's watch list.
+*   Returned   : None
+****************************************************************************/
+static void mltp_watch_add(mltp_vp_local_t *vp, mltp_watch_t *w)
+{
+    mltp_spinlock_lock(&(vp->watch_lock));
+    w->next = vp->watch;
+    vp->watch = w;
+    mltp_spinlock_unlock(&(vp->watch_lock));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_watch_scan
+*   Description: This function makes every thread on a VP's watch list
+*                whose wait has been satisfied runnable.  It may be called
+*                by any VP.  The list is skipped if another VP is already
+*                checking it.
+*   Parameters : vp - local structure of VP whose list is checked
+*   Effects    : Threads with satisfied waits are removed from the watch
+*                list and handed to the scheduling policy on the calling
+*                VP.  Entries with front set are queued as if they yielded
+*                to the first thread.
+*   Returned   : Non-zero if any thread was made runnable.
+****************************************************************************/
+static int mltp_watch_scan(mltp_vp_local_t *vp)
+{
+    mltp_watch_t **link;
+    mltp_watch_t *w;
+    mltp_t *t;
+    long long now;
+    int found;
+
+    if (!mltp_spinlock_trylock(&(vp->watch_lock)))
+    {
+        /* somebody else is looking */
+        return 0;
+    }
+
+    link = &(vp->watch);
+    now = 0;
+    found = 0;
+
+    while ((w = *link) != NULL)
+    {
+        if (!mltp_watch_ready(w, &now))
+        {
+            link = &(w->next);
+            continue;
+        }
+
+        /* w is on t's stack, don't touch it once t is runnable */
+        t = w->thread;
+        *link = w->next;
+
+        if (w->front)
+        {
+            /* still a wakeup as far as the policy is concerned */
+            if (mltp_sched->on_wake != NULL)
+            {
+                mltp_sched->on_wake(mltp_vp_id(), t);
+            }
+
+            mltp_sched_put(t, t, MLTP_SCHED_YIELD_FIRST);
+        }
+        else
+        {
+            mltp_sched_put(t, t, MLTP_SCHED_WAKE);
+        }
+
+        found = 1;
+    }
+
+    mltp_spinlock_unlock(&(vp->watch_lock));
+    return found;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_watch_adopt
+*   Description: This function is called by an idle VP to check the watch
+*                lists of the other running VPs.  Their owners only check
+*                them between threads, so a waiter would otherwise wait
+*                for a long running thread on its VP.
+*   Parameters : self - local structure of calling VP
+*   Effects    : Threads with satisfied waits are made runnable on the
+*                calling VP.
+*   Returned   : Non-zero if any thread was made runnable.
+****************************************************************************/
+static int mltp_watch_adopt(mltp_vp_local_t *self)
+{
+    mltp_vp_local_t *vp;
+    int i, count, found;
+
+    count = mltp_vp_count;
+    found = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        vp = mltp_vps[i];
+
+        if ((vp == NULL) || (vp == self) || !vp->alive ||
+            (vp->watch == NULL))
+        {
+            continue;
+        }
+
+        found |= mltp_watch_scan(vp);
+    }
+
+    return found;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_watch_ready
+*   Description: This function checks if the wait described by a watch
+*                list entry has been satisfied.  Entries that swap the
+*                watched word take it when they're satisfied.
+*   Parameters : w - watch list entry
+*                now - current time in nanoseconds, or 0 if it hasn't been
+*                      read yet.  It's read at most once per caller.
+*   Effects    : For cas entries, *addr may be swapped to set.
+*   Returned   : Non-zero if the waiter may run.
+****************************************************************************/
+static int mltp_watch_ready(mltp_watch_t *w, long long *now)
+{
+    struct timespec ts;
+
+    if (w->addr == NULL)
+    {
+        /* timed wait */
+        if (*now == 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            *now = ((long long)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+        }
+
+        return (*now >= w->deadline);
+    }
+
+    if (w->cas)
+    {
+        return mltp_atomic_cas_acquire(w->addr, w->old, w->set);
+    }
+
+    return (*(w->addr) != w->old);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_barrier_init
+*   Description: This function must be called prior to the first use of a
+*                specific barrier.  It insures that the barrier will
+*                function properly when used.
+*   Parameters : barrier - barrier to be initialized
+*   Effects    : zeros out all barrier fields
+*   Returned   : None
+****************************************************************************/
+void mltp_barrier_init(mltp_barrier_t *barrier)
+{
+    barrier->waiters = 0;
+    barrier->episode = 0;
+    mltp_spinlock_init(&(barrier->lock));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_barrier
+*   Description: This function provides the functionality of a barrier
+*                primative.  It blocks all threads that enter it, until the
+*                specified number have entered it.
+*   Parameters : barrier - barrier structure to block on
+*                count - number of threads required to enter the barrier
+*                        this episode.
+*   Effects    : Blocks all threads that enter until the specified number
+*                have entered the barrier.  barrier->episode will be
+*                incremented when the last thread enters the barrier.
+*   Returned   : None
+****************************************************************************/
+void mltp_barrier(mltp_barrier_t *barrier, unsigned int count)
+{
+    unsigned int episode;
+
+    /* obtain barrier lock */
+    mltp_spinlock_lock(&(barrier->lock));
+    episode = barrier->episode;
+
+    /* increment number of threads waiting on this barrier */
+    barrier->waiters++;
+
+    if (barrier->waiters == count)
+    {
+        /* this is the last thread required to enter the barrier */
+        /* start new episode */
+        barrier->episode++;
+        barrier->waiters = 0;
+
+        mltp_spinlock_unlock(&(barrier->lock));
+    }
+    else
+    {
+        mltp_spinlock_unlock(&(barrier->lock));
+
+        /* wait until each thread hits the barrier */
+        mltp_wait_until(&(barrier->episode), episode);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_cond_init
+*   Description: This function initializes the queues used for conditional
+*                waiting.
+*   Parameters : cond - queue for threads waiting on a condition
+*   Effects    : Head, tail, and next position in the conditional queue all
+*                point to each other, and conditional lock is initialized.
+*   Returned   : None
+****************************************************************************/
+void mltp_cond_init(mltp_cond_t *cond)
+{
+    mltp_qinit(&(cond->q));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_cond_wait
+*   Description: This function places the currently executing user level
+*                thread in a conditional wait queue where it will stay until
+*                a signal has been provided to the conditional queue.  This
+*                function is only valid when called from an unbound thread.
+*   Parameters : cond - queue for threads waiting on a condition
+*   Effects    : Currently executing user thread is blocked.  The next
+*                runnable thread will take over use of executing VP.
+*   Returned   : None
+****************************************************************************/
+void mltp_cond_wait(mltp_cond_t *cond)
+{
+    mltp_t *old, *mainthread;
+    mltp_vp_local_t *mltp_vp_local;
+
+    /* don't get moved to another VP while switching */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    /* make current thread done and switch to main thread */
+    mainthread = &(mltp_vp_local->vp_main);
+    old = mltp_vp_local->vp_curr;
+    old->state = mltpBlock;
+    mltp_vp_local->vp_curr = mainthread;
+    mainthread->state = mltpRunning;
+
+    /* block old thread */
+    QT_BLOCK(mltp_condhelp, old, &(cond->q), mainthread->sp);
+    MLTP_PREEMPT_ON();
+}
+
+
+/****************************************************************************
+*   Function   : mltp_condhelp
+*   Description: This function handles the queuing and stack save of a
+*                thread waiting on a conditional.
+*   Parameters : sp - quick threads handle of the waiting thread
+*                old - the waiting thread
+*                blockq - the conditional's queue
+*   Effects    : The waiting thread is placed at the end of the conditional
+*                queue and its stack pointer is saved.
+*   Returned   : None
+****************************************************************************/
+static void *mltp_condhelp(qt_t *sp, void *old, void *blockq)
+{
+  ((mltp_t *)old)->sp = sp;
+  mltp_sched_block((mltp_t *)old);
+  mltp_qput((mltp_q_t *)blockq, (mltp_t *)old);
+  return (old);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_cond_signal
+*   Description: This function signals that the first user level thread in a
+*                conditional wait queue is runnable.
+*   Parameters : cond - queue for threads waiting on a condition
+*   Effects    : The head of the contional queue will be placed on the
+*                global run queue.
+*   Returned   : None
+****************************************************************************/
+void mltp_cond_signal(mltp_cond_t *cond)
+{
+    mltp_t *t;                       /* thread from conditional */
+
+    /* get next thread from conditional queue */
+    t = mltp_qget(&(cond->q));
+
+    if (t != NULL)
+    {
+        mltp_wake(t);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_cond_broadcast
+*   Description: This function signals that all the user level threads in a
+*                conditional wait queue are runnable.
+*   Parameters : cond - queue for threads waiting on a condition
+*   Effects    : All of the threads in the contional queue will be pushed
+*                into a VP's wakeup inbox as a single list.
+*   Returned   : None
+****************************************************************************/
+void mltp_cond_broadcast(mltp_cond_t *cond)
+{
+    mltp_t *thread, *tail;                  /* head and tail of cond queue */
+
+    /* lock cond and remove all threads */
+    mltp_spinlock_lock(&(cond->q.lock));   /* aquire the cond lock */
+
+    /* head of queue and adjust queue mark queue empty */
+    thread = cond->q.t.next;
+    tail = cond->q.tail;
+    cond->q.t.next = cond->q.tail = &(cond->q.t);
+
+    mltp_spinlock_unlock(&(cond->q.lock)); /* release the cond lock */
+
+    if (thread != &(cond->q.t))
+    {
+        /* now make all these threads runnable */
+        mltp_wake_list(thread, tail);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_block
+*   Description: This function blocks the current thread and has a function
+*                park it once it has been switched out.  Parking after the
+*                switch means that the thread's stack pointer is saved
+*                before anybody can find the thread and make it runnable.
+*                This function is only valid when called from an unbound
+*                thread.
+*   Parameters : func - function called on the VP main stack to park the
+*                       blocked thread
+*                arg - argument passed to func
+*   Effects    : Currently executing user thread is blocked.  The next
+*                runnable thread will take over use of executing VP.
+*   Returned   : None
+****************************************************************************/
+static void mltp_block(mltp_blockf_t *func, void *arg)
+{
+    mltp_t *old, *mainthread;
+    mltp_vp_local_t *mltp_vp_local;
+    mltp_block_t block;
+
+    /* don't get moved to another VP while switching */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    /* block lives on this stack, which isn't touched until we're resumed */
+    block.func = func;
+    block.arg = arg;
+
+    /* make current thread blocked and switch to main thread */
+    mainthread = &(mltp_vp_local->vp_main);
+    old = mltp_vp_local->vp_curr;
+    old->state = mltpBlock;
+    mltp_vp_local->vp_curr = mainthread;
+    mainthread->state = mltpRunning;
+
+    QT_BLOCK(mltp_blockhelp, old, &block, mainthread->sp);
+    MLTP_PREEMPT_ON();
+}
+
+
+/****************************************************************************
+*   Function   : mltp_blockhelp
+*   Description: This function handles the stack save of a thread blocked by
+*                mltp_block and calls the function that parks it.
+*   Parameters : sp - quick threads handle of the blocked thread
+*                old - the blocked thread
+*                block - block function and its argument
+*   Effects    : Blocked thread's stack pointer is saved and thread is
+*                parked.
+*   Returned   : None
+****************************************************************************/
+static void *mltp_blockhelp(qt_t *sp, void *old, void *block)
+{
+    ((mltp_t *)old)->sp = sp;
+    mltp_sched_block((mltp_t *)old);
+    ((mltp_block_t *)block)->func((mltp_t *)old, ((mltp_block_t *)block)->arg);
+    return (old);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_waiter_link
+*   Description: This function adds a waiter to the end of a waiter list.
+*                The lock protecting the list must be held by the caller.
+*   Parameters : list - pointer to the head of the waiter list
+*                w - waiter being added
+*   Effects    : w is linked into list.
+*   Returned   : None
+****************************************************************************/
+static void mltp_waiter_link(mltp_waiter_t **list, mltp_waiter_t *w)
+{
+    if (*list == NULL)
+    {
+        /* only waiter, it is the head and tail */
+        w->next = w->prev = w;
+        *list = w;
+    }
+    else
+    {
+        /* head's prev is the tail */
+        w->next = *list;
+        w->prev = (*list)->prev;
+        (*list)->prev->next = w;
+        (*list)->prev = w;
+    }
+
+    w->linked = 1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_waiter_unlink
+*   Description: This function removes a waiter from a waiter list.  The
+*                lock protecting the list must be held by the caller.
+*   Parameters : list - pointer to the head of the waiter list
+*                w - waiter being removed
+*   Effects    : w is unlinked from list.
+*   Returned   : None
+****************************************************************************/
+static void mltp_waiter_unlink(mltp_waiter_t **list, mltp_waiter_t *w)
+{
+    if (w->next == w)
+    {
+        /* last waiter */
+        *list = NULL;
+    }
+    else
+    {
+        w->prev->next = w->next;
+        w->next->prev = w->prev;
+
+        if (*list == w)
+        {
+            *list = w->next;
+        }
+    }
+
+    w->linked = 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_waiter_claim
+*   Description: This function tries to claim the wait a waiter belongs to.
+*                Only the first waiter of a wait to be claimed succeeds.
+*                The claimer must call mltp_wait_arrive once it is done
+*                with the waiter.
+*   Parameters : w - waiter being claimed
+*   Effects    : If the wait hasn't been claimed it is claimed by w.
+*   Returned   : 1 if w claimed the wait, otherwise 0.
+****************************************************************************/
+static int mltp_waiter_claim(mltp_waiter_t *w)
+{
+    mltp_wait_t *wait;
+
+    wait = w->wait;
+
+    if ((wait->claimed) || !mltp_atomic_cas(&(wait->claimed), 0, 1))
+    {
+        /* another object beat us to it */
+        return 0;
+    }
+
+    wait->fired = w->index;
+    return 1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_waiter_fire
+*   Description: This function tries to claim the wait a waiter belongs to.
+*                The first waiter of a wait to be fired makes the waiting
+*                thread runnable, the rest do nothing.
+*   Parameters : w - waiter being fired
+*   Effects    : If the wait hasn't been claimed it is claimed by w and the
+*                waiting thread is made runnable.
+*   Returned   : 1 if w claimed the wait, otherwise 0.
+****************************************************************************/
+static int mltp_waiter_fire(mltp_waiter_t *w)
+{
+    if (!mltp_waiter_claim(w))
+    {
+        return 0;
+    }
+
+    mltp_wait_arrive(w->wait);
+    return 1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_wait_arrive
+*   Description: This function is called once by whatever claims a wait and
+*                once by the block function parking the waiting thread when
+*                it is done linking waiters.  The second arrival makes the
+*                waiting thread runnable, so a thread can't be resumed while
+*                its waiters are still being linked.
+*   Parameters : wait - wait being arrived at
+*   Effects    : wait's arrival count is incremented.  The waiting thread
+*                is made runnable on the second arrival.
+*   Returned   : None
+****************************************************************************/
+static void mltp_wait_arrive(mltp_wait_t *wait)
+{
+    int arrived;
+
+    /* the second arrival must see everything the first did */
+    arrived = mltp_atomic_fetch_add(&(wait->arrived), 1, MLTP_ACQ_REL);
+
+    if (arrived == 1)
+    {
+        /* we're second */
+        mltp_wake(wait->thread);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_future_init
+*   Description: This function initializes a future so that it may be set
+*                and waited on.
+*   Parameters : future - future being initialized
+*   Effects    : future is unset and has no waiters or continuations.
+*   Returned   : None
+****************************************************************************/
+void mltp_future_init(mltp_future_t *future)
+{
+    future->ready = 0;
+    future->value = NULL;
+    future->waiters = NULL;
+    future->conts = NULL;
+    future->conts_tail = NULL;
+    mltp_spinlock_init(&(future->lock));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_future_set
+*   Description: This function sets the value of a future.  Threads waiting
+*                on the future are made runnable and the future's
+*                continuations are spawned as tasks by the setting thread.
+*   Parameters : future - future being set
+*                value - value of the future
+*   Effects    : future is set, its waiters are made runnable, and its
+*                continuations are made runnable.
+*   Returned   : 0 for success, -1 if the future was already set.
+****************************************************************************/
+int mltp_future_set(mltp_future_t *future, void *value)
+{
+    mltp_waiter_t *w;
+    mltp_cont_t *cont, *next;
+
+    mltp_spinlock_lock(&(future->lock));
+
+    if (future->ready)
+    {
+        mltp_spinlock_unlock(&(future->lock));
+        return -1;
+    }
+
+    future->value = value;
+    future->ready = 1;
+
+    /*************************************************************************
+    * Waiters are fired with the lock held.  A thread waiting on more than
+    * one future takes each future's lock before it lets its stack (and
+    * the waiters on it) go, so it can't return while a waiter is being
+    * fired.
+    *************************************************************************/
+    while ((w = future->waiters) != NULL)
+    {
+        mltp_waiter_unlink(&(future->waiters), w);
+        mltp_waiter_fire(w);
+    }
+
+    cont = future->conts;
+    future->conts = NULL;
+    future->conts_tail = NULL;
+
+    mltp_spinlock_unlock(&(future->lock));
+
+    /* spawn continuations in the order they were registered */
+    while (cont != NULL)
+    {
+        next = cont->next;
+        mltp_cont_spawn(cont, value);
+        cont = next;
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_future_get
+*   Description: This function waits for a future to be set.
+*   Parameters : future - future being waited on
+*   Effects    : Calling thread is blocked until future is set.
+*   Returned   : Value of the future.
+****************************************************************************/
+void *mltp_future_get(mltp_future_t *future)
+{
+    if (!future->ready)
+    {
+        mltp_future_wait(&future, 1);
+    }
+
+    return future->value;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_future_then
+*   Description: This function registers a continuation with a future.
+*   Parameters : future - future the continuation waits on
+*                func - continuation function
+*                arg - argument passed to func along with the future value
+*   Effects    : If future is already set, func is spawned as a task
+*                immediately.  Otherwise it will be spawned by the thread
+*                that sets the future.
+*   Returned   : None
+****************************************************************************/
+void mltp_future_then(mltp_future_t *future, mltp_contf_t *func, void *arg)
+{
+    mltp_cont_t *cont;
+
+    cont = (mltp_cont_t *)xmalloc(sizeof(mltp_cont_t));
+    cont->func = func;
+    cont->arg = arg;
+    cont->next = NULL;
+
+    mltp_spinlock_lock(&(future->lock));
+
+    if (future->ready)
+    {
+        /* value is already there, don't bother queueing */
+        mltp_spinlock_unlock(&(future->lock));
+        mltp_cont_spawn(cont, future->value);
+        return;
+    }
+
+    /* append to keep continuations in registration order */
+    if (future->conts == NULL)
+    {
+        future->conts = cont;
+    }
+    else
+    {
+        future->conts_tail->next = cont;
+    }
+
+    future->conts_tail = cont;
+    mltp_spinlock_unlock(&(future->lock));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_cont_spawn
+*   Description: This function spawns a continuation as a task, so it runs
+*                on a VP's main stack instead of the stack of the thread
+*                that set the future.  Continuations spawned by a VP go on
+*                that VP's run queue under mltp_sched_steal.
+*   Parameters : cont - continuation being spawned
+*                value - value of the future
+*   Effects    : cont is made runnable.
+*   Returned   : None
+****************************************************************************/
+static void mltp_cont_spawn(mltp_cont_t *cont, void *value)
+{
+    cont->value = value;
+    mltp_task_init(&(cont->task), mltp_cont_run, cont);
+    mltp_task_spawn(&(cont->task));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_cont_run
+*   Description: This function is the task function of a continuation.  It
+*                calls the continuation, then frees it.
+*   Parameters : arg - continuation being run
+*   Effects    : The continuation is called, its task is finished and it
+*                is freed.
+*   Returned   : None
+****************************************************************************/
+static void mltp_cont_run(void *arg)
+{
+    mltp_cont_t *cont;
+
+    cont = (mltp_cont_t *)arg;
+    cont->func(cont->value, cont->arg);
+
+    /* VPs don't touch a task once its function returns */
+    mltp_task_done(&(cont->task));
+    free(cont);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_future_when_all
+*   Description: This function waits for all of the futures in a list to be
+*                set.  Since every future must be set, waiting on each in
+*                turn is as good as waiting on all of them at once and
+*                requires no more than a single waiter at a time.
+*   Parameters : futures - array of futures being waited on
+*                n - number of futures in the array
+*   Effects    : Calling thread is blocked until all futures are set.
+*   Returned   : None
+****************************************************************************/
+void mltp_future_when_all(mltp_future_t **futures, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (!futures[i]->ready)
+        {
+            mltp_future_wait(&futures[i], 1);
+        }
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_future_when_any
+*   Description: This function waits for any of the futures in a list to be
+*                set.
+*   Parameters : futures - array of futures being waited on
+*                n - number of futures in the array
+*   Effects    : Calling thread is blocked until a future is set.
+*   Returned   : Index of a future that has been set, or -1 if n < 1.
+****************************************************************************/
+int mltp_future_when_any(mltp_future_t **futures, int n)
+{
+    int i;
+
+    if (n < 1)
+    {
+        /* no future could ever be set */
+        return -1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (futures[i]->ready)
+        {
+            return i;
+        }
+    }
+
+    return mltp_future_wait(futures, n);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_future_wait
+*   Description: This function waits until one of a list of futures is set.
+*                Unbound threads link a waiter into each future and are
+*                parked until a future claims them.  Other callers yield
+*                their process while polling the futures.  Up to
+*                MLTP_WAIT_INLINE waiters are kept on the caller's stack,
+*                which may be small, more are allocated.
+*   Parameters : futures - array of futures being waited on
+*                n - number of futures in the array, at least 1
+*   Effects    : Calling thread is blocked until a future is set.
+*   Returned   : Index of the future that was set.
+****************************************************************************/
+static int mltp_future_wait(mltp_future_t **futures, int n)
+{
+    mltp_t *self;
+    mltp_waiter_t local[MLTP_WAIT_INLINE], *waiters;
+    mltp_future_wait_t fwait;
+    mltp_wait_t wait;
+    int i;
+
+    self = mltp_self();
+
+    if (self == NULL)
+    {
+        /* not an unbound thread, there's no thread to park */
+        for (;;)
+        {
+            for (i = 0; i < n; i++)
+            {
+                if (futures[i]->ready)
+                {
+                    return i;
+                }
+            }
+
+            sched_yield();
+        }
+    }
+
+    wait.thread = self;
+    wait.claimed = 0;
+    wait.fired = -1;
+    wait.arrived = 0;
+
+    if (n <= MLTP_WAIT_INLINE)
+    {
+        waiters = local;
+    }
+    else
+    {
+        waiters = (mltp_waiter_t *)xmalloc(n * sizeof(mltp_waiter_t));
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        waiters[i].wait = &wait;
+        waiters[i].index = i;
+        waiters[i].linked = 0;
+        waiters[i].data = NULL;
+    }
+
+    fwait.futures = futures;
+    fwait.waiters = waiters;
+    fwait.n = n;
+    fwait.linked = 0;
+
+    mltp_block(mltp_future_park, &fwait);
+
+    /*************************************************************************
+    * Take back waiters that the other futures haven't fired.  Every lock is
+    * taken, even for waiters that look unlinked, since a setter may still
+    * be firing its waiter with the lock held.
+    *************************************************************************/
+    for (i = 0; i < fwait.linked; i++)
+    {
+        mltp_spinlock_lock(&(futures[i]->lock));
+
+        if (waiters[i].linked)
+        {
+            mltp_waiter_unlink(&(futures[i]->waiters), &waiters[i]);
+        }
+
+        mltp_spinlock_unlock(&(futures[i]->lock));
+    }
+
+    if (waiters != local)
+    {
+        free(waiters);
+    }
+
+    return wait.fired;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_future_park
+*   Description: This function is the block function used by threads
+*                waiting on futures.  It links a waiter into each future,
+*                stopping early if it finds a future that has been set.
+*   Parameters : t - thread being parked
+*                fwait - futures and waiters used by the wait
+*   Effects    : Waiters are linked into futures.  If a future is already
+*                set, the wait is claimed.  t is made runnable when the
+*                wait is claimed.
+*   Returned   : None
+****************************************************************************/
+static void mltp_future_park(mltp_t *t, void *fwait)
+{
+    mltp_future_wait_t *fw;
+    mltp_future_t *future;
+    int i;
+
+    fw = (mltp_future_wait_t *)fwait;
+
+    for (i = 0; i < fw->n; i++)
+    {
+        future = fw->futures[i];
+        mltp_spinlock_lock(&(future->lock));
+
+        if (future->ready)
+        {
+            /* no need to look any further */
+            mltp_spinlock_unlock(&(future->lock));
+            mltp_waiter_fire(&(fw->waiters[i]));
+            break;
+        }
+
+        mltp_waiter_link(&(future->waiters), &(fw->waiters[i]));
+        fw->linked = i + 1;
+        mltp_spinlock_unlock(&(future->lock));
+    }
+
+    /* done with the waiters, t may run once it's claimed */
+    mltp_wait_arrive(fw->waiters[0].wait);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_init
+*   Description: This function initializes a channel so that messages may
+*                be sent and received on it.
+*   Parameters : chan - channel being initialized
+*                elem_size - size of a message in bytes
+*                capacity - number of messages that may be buffered, 0 for
+*                           an unbuffered channel, or MLTP_CHAN_UNBOUNDED
+*   Effects    : chan is empty and open.  Bounded channels have their
+*                buffer allocated.
+*   Returned   : 0 for success, -1 for bad parameters.
+****************************************************************************/
+int mltp_chan_init(mltp_chan_t *chan, int elem_size, int capacity)
+{
+    if ((elem_size <= 0) || (capacity < MLTP_CHAN_UNBOUNDED))
+    {
+        return -1;
+    }
+
+    chan->elem_size = elem_size;
+    chan->capacity = capacity;
+    chan->count = 0;
+    chan->head = 0;
+    chan->closed = 0;
+    chan->recvq = NULL;
+    chan->sendq = NULL;
+    mltp_spinlock_init(&(chan->lock));
+
+    if (capacity > 0)
+    {
+        chan->size = capacity;
+        chan->buffer = (char *)xmalloc(capacity * elem_size);
+    }
+    else
+    {
+        /* unbuffered or grown on the first send */
+        chan->size = 0;
+        chan->buffer = NULL;
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_destroy
+*   Description: This function frees the resources used by a channel.
+*   Parameters : chan - channel being destroyed
+*   Effects    : chan's buffer is freed.
+*   Returned   : None
+****************************************************************************/
+void mltp_chan_destroy(mltp_chan_t *chan)
+{
+    if (chan->buffer != NULL)
+    {
+        free(chan->buffer);
+        chan->buffer = NULL;
+    }
+
+    chan->size = 0;
+    chan->count = 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_close
+*   Description: This function closes a channel.  Waiting senders and
+*                receivers are released with an error.
+*   Parameters : chan - channel being closed
+*   Effects    : chan is closed and its waiters are made runnable.
+*   Returned   : None
+****************************************************************************/
+void mltp_chan_close(mltp_chan_t *chan)
+{
+    mltp_waiter_t *w;
+
+    mltp_spinlock_lock(&(chan->lock));
+
+    chan->closed = 1;
+
+    /* receivers only wait on an empty channel, so none will get a message */
+    while ((w = chan->recvq) != NULL)
+    {
+        mltp_waiter_unlink(&(chan->recvq), w);
+        w->status = -1;
+        mltp_waiter_fire(w);
+    }
+
+    while ((w = chan->sendq) != NULL)
+    {
+        mltp_waiter_unlink(&(chan->sendq), w);
+        w->status = -1;
+        mltp_waiter_fire(w);
+    }
+
+    mltp_spinlock_unlock(&(chan->lock));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_send
+*   Description: This function sends a message on a channel, waiting until
+*                there is room for it or a receiver to take it.
+*   Parameters : chan - channel message is sent on
+*                msg - message being sent
+*   Effects    : msg is copied into chan's buffer or to a waiting receiver.
+*   Returned   : 0 for success, -1 if chan is closed.
+****************************************************************************/
+int mltp_chan_send(mltp_chan_t *chan, const void *msg)
+{
+    mltp_select_t c;
+
+    c.chan = chan;
+    c.op = MLTP_CHAN_SEND;
+    c.msg = (void *)msg;
+
+    mltp_select(&c, 1, 1);
+    return c.status;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_recv
+*   Description: This function receives a message from a channel, waiting
+*                until there is one to receive.
+*   Parameters : chan - channel message is received from
+*                msg - buffer message is received into
+*   Effects    : The oldest message in chan is copied into msg.
+*   Returned   : 0 for success, -1 if chan is closed and empty.
+****************************************************************************/
+int mltp_chan_recv(mltp_chan_t *chan, void *msg)
+{
+    mltp_select_t c;
+
+    c.chan = chan;
+    c.op = MLTP_CHAN_RECV;
+    c.msg = msg;
+
+    mltp_select(&c, 1, 1);
+    return c.status;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_trysend
+*   Description: This function sends a message on a channel if it can be
+*                done without waiting.
+*   Parameters : chan - channel message is sent on
+*                msg - message being sent
+*   Effects    : msg is copied into chan's buffer or to a waiting receiver
+*                if there's room.
+*   Returned   : 0 for success, -1 if chan is closed, 1 if it would block.
+****************************************************************************/
+int mltp_chan_trysend(mltp_chan_t *chan, const void *msg)
+{
+    mltp_select_t c;
+
+    c.chan = chan;
+    c.op = MLTP_CHAN_SEND;
+    c.msg = (void *)msg;
+
+    if (mltp_select(&c, 1, 0) < 0)
+    {
+        return 1;
+    }
+
+    return c.status;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_tryrecv
+*   Description: This function receives a message from a channel if it can
+*                be done without waiting.
+*   Parameters : chan - channel message is received from
+*                msg - buffer message is received into
+*   Effects    : The oldest message in chan is copied into msg if there is
+*                one.
+*   Returned   : 0 for success, -1 if chan is closed, 1 if it would block.
+****************************************************************************/
+int mltp_chan_tryrecv(mltp_chan_t *chan, void *msg)
+{
+    mltp_select_t c;
+
+    c.chan = chan;
+    c.op = MLTP_CHAN_RECV;
+    c.msg = msg;
+
+    if (mltp_select(&c, 1, 0) < 0)
+    {
+        return 1;
+    }
+
+    return c.status;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_select
+*   Description: This function performs one of a list of channel
+*                operations.  The operations are tried in order, if none of
+*                them can be performed and block is non-zero, the calling
+*                thread waits on all of the channels until one can be.
+*                Up to MLTP_WAIT_INLINE waiters are kept on the caller's
+*                stack, which may be small, more are allocated.
+*   Parameters : cases - array of channel operations
+*                n - number of operations in the array
+*                block - non-zero if the caller may wait
+*   Effects    : One operation is performed and its status set.
+*   Returned   : Index of the operation performed or -1 if no operation
+*                could be performed without waiting, or if n < 1.
+****************************************************************************/
+int mltp_select(mltp_select_t *cases, int n, int block)
+{
+    mltp_t *self;
+    mltp_waiter_t local[MLTP_WAIT_INLINE], *waiters;
+    mltp_chan_t *local_chans[MLTP_WAIT_INLINE], **chans;
+    mltp_select_wait_t swait;
+    mltp_wait_t wait;
+    mltp_chan_t *chan;
+    int i, j;
+
+    if (n < 1)
+    {
+        /* nothing could ever be performed */
+        return -1;
+    }
+
+    /* fast path, nothing is parked so channels may be locked one by one */
+    for (i = 0; i < n; i++)
+    {
+        if (mltp_select_try(&cases[i]))
+        {
+            return i;
+        }
+    }
+
+    if (!block)
+    {
+        return -1;
+    }
+
+    self = mltp_self();
+
+    if (self == NULL)
+    {
+        /* not an unbound thread, there's no thread to park */
+        for (;;)
+        {
+            sched_yield();
+
+            for (i = 0; i < n; i++)
+            {
+                if (mltp_select_try(&cases[i]))
+                {
+                    return i;
+                }
+            }
+        }
+    }
+
+    if (n <= MLTP_WAIT_INLINE)
+    {
+        waiters = local;
+        chans = local_chans;
+    }
+    else
+    {
+        /* one allocation holds the waiters followed by the channels */
+        waiters = (mltp_waiter_t *)xmalloc(n *
+            (sizeof(mltp_waiter_t) + sizeof(mltp_chan_t *)));
+        chans = (mltp_chan_t **)(waiters + n);
+    }
+
+    /* sort distinct channels by address, so they're always locked in order */
+    swait.nchans = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        chan = cases[i].chan;
+
+        for (j = swait.nchans; (j > 0) && (chans[j - 1] > chan); j--)
+        {
+            chans[j] = chans[j - 1];
+        }
+
+        if ((j > 0) && (chans[j - 1] == chan))
+        {
+            /* duplicate, undo the shift */
+            for (; j < swait.nchans; j++)
+            {
+                chans[j] = chans[j + 1];
+            }
+
+            continue;
+        }
+
+        chans[j] = chan;
+        swait.nchans++;
+    }
+
+    wait.thread = self;
+    wait.claimed = 0;
+    wait.fired = -1;
+    wait.arrived = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        waiters[i].wait = &wait;
+        waiters[i].index = i;
+        waiters[i].linked = 0;
+        waiters[i].status = 0;
+        waiters[i].data = cases[i].msg;
+    }
+
+    swait.cases = cases;
+    swait.waiters = waiters;
+    swait.chans = chans;
+    swait.n = n;
+    swait.linked = 0;
+
+    mltp_block(mltp_select_park, &swait);
+
+    /*************************************************************************
+    * Take back waiters on the channels that didn't fire.  Every channel is
+    * locked, even if its waiters look unlinked, since the channel that
+    * fired may still be claiming a waiter with its lock held.
+    *************************************************************************/
+    if (swait.linked)
+    {
+        for (j = 0; j < swait.nchans; j++)
+        {
+            chan = chans[j];
+            mltp_spinlock_lock(&(chan->lock));
+
+            for (i = 0; i < n; i++)
+            {
+                if ((cases[i].chan == chan) && waiters[i].linked)
+                {
+                    mltp_waiter_unlink((cases[i].op == MLTP_CHAN_SEND) ?
+                        &(chan->sendq) : &(chan->recvq), &waiters[i]);
+                }
+            }
+
+            mltp_spinlock_unlock(&(chan->lock));
+        }
+    }
+
+    cases[wait.fired].status = waiters[wait.fired].status;
+
+    if (waiters != local)
+    {
+        free(waiters);
+    }
+
+    return wait.fired;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_select_try
+*   Description: This function tries to perform a channel operation without
+*                waiting.
+*   Parameters : c - channel operation
+*   Effects    : If the operation can be performed, it is and its status is
+*                set.
+*   Returned   : Non-zero if the operation was performed.
+****************************************************************************/
+static int mltp_select_try(mltp_select_t *c)
+{
+    int result;
+
+    mltp_spinlock_lock(&(c->chan->lock));
+
+    if (c->op == MLTP_CHAN_SEND)
+    {
+        result = mltp_chan_send_locked(c->chan, c->msg);
+    }
+    else
+    {
+        result = mltp_chan_recv_locked(c->chan, c->msg);
+    }
+
+    mltp_spinlock_unlock(&(c->chan->lock));
+
+    if (result == 0)
+    {
+        return 0;
+    }
+
+    c->status = (result > 0) ? 0 : -1;
+    return 1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_select_park
+*   Description: This function is the block function used by threads
+*                selecting from channel operations.  With every channel
+*                locked it tries the operations once more, if none can be
+*                performed a waiter is linked into each channel.  Holding
+*                every lock means none of the waiters can be fired until
+*                all of them are linked.
+*   Parameters : t - thread being parked
+*                swait - operations, waiters, and channels used by select
+*   Effects    : An operation is performed or waiters are linked.  t is
+*                made runnable once an operation has been performed.
+*   Returned   : None
+****************************************************************************/
+static void mltp_select_park(mltp_t *t, void *swait)
+{
+    mltp_select_wait_t *sw;
+    mltp_select_t *c;
+    mltp_wait_t *wait;
+    int i, result;
+
+    sw = (mltp_select_wait_t *)swait;
+    wait = sw->waiters[0].wait;
+
+    for (i = 0; i < sw->nchans; i++)
+    {
+        mltp_spinlock_lock(&(sw->chans[i]->lock));
+    }
+
+    for (i = 0; i < sw->n; i++)
+    {
+        c = &(sw->cases[i]);
+
+        if (c->op == MLTP_CHAN_SEND)
+        {
+            result = mltp_chan_send_locked(c->chan, c->msg);
+        }
+        else
+        {
+            result = mltp_chan_recv_locked(c->chan, c->msg);
+        }
+
+        if (result != 0)
+        {
+            /* nobody else can see our waiters, claim the wait ourselves */
+            sw->waiters[i].status = (result > 0) ? 0 : -1;
+            wait->claimed = 1;
+            wait->fired = i;
+            break;
+        }
+    }
+
+    if (i == sw->n)
+    {
+        /* nothing could be done, wait on all of the channels */
+        for (i = 0; i < sw->n; i++)
+        {
+            c = &(sw->cases[i]);
+            mltp_waiter_link((c->op == MLTP_CHAN_SEND) ?
+                &(c->chan->sendq) : &(c->chan->recvq), &(sw->waiters[i]));
+        }
+
+        sw->linked = 1;
+    }
+
+    for (i = 0; i < sw->nchans; i++)
+    {
+        mltp_spinlock_unlock(&(sw->chans[i]->lock));
+    }
+
+    if (!sw->linked)
+    {
+        /* we claimed the wait, arrive for the claimer */
+        mltp_wait_arrive(wait);
+    }
+
+    /* done with the waiters, t may run once it's claimed */
+    mltp_wait_arrive(wait);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_init
+*   Description: This function initializes a stackless task.  Running the
+*                task calls func(arg) on the main stack of a VP.
+*   Parameters : task - task descriptor, usually part of the task's frame
+*                func - function that resumes the task
+*                arg - argument passed to func
+*   Effects    : task is initialized and the number of user threads is
+*                incremented, so VPs keep running until it's done.
+*   Returned   : None
+****************************************************************************/
+void mltp_task_init(mltp_t *task, mltp_taskf_t *func, void *arg)
+{
+    task->thrid = mltp_id_alloc(task);
+    task->state = mltpReady;
+    task->sp = NULL;
+    task->sto = NULL;
+    task->stksize = 0;
+    task->type = MLTP_THREAD_TASK;
+    task->retval = NULL;
+    task->private_data = NULL;
+    task->private_size = 0;
+    memset(task->specific, 0, sizeof(task->specific));
+    task->specific_table = NULL;
+    task->next = NULL;
+    task->priority = 0;
+    task->home_vp = MLTP_VP_ANY;
+    task->name = NULL;
+    task->main_func = NULL;
+    task->stack_profiled = 0;
+    task->coro = NULL;
+    task->task_func = func;
+    task->task_arg = arg;
+    task->detached = 1;
+    task->joiners = NULL;
+    mltp_spinlock_init(&(task->join_lock));
+
+    /* tasks may be spawned by running threads and tasks */
+    mltp_live_add(1, 0);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_spawn
+*   Description: This function makes a newly initialized task runnable.
+*   Parameters : task - task being spawned
+*   Effects    : task is handed to the scheduling policy.
+*   Returned   : None
+****************************************************************************/
+void mltp_task_spawn(mltp_t *task)
+{
+    mltp_sched_put(task, task, MLTP_SCHED_NEW);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_done
+*   Description: This function is called when a task finishes.  The task
+*                must not be run again.
+*   Parameters : task - task that finished
+*   Effects    : The number of user threads is decremented and task's ID
+*                is released.
+*   Returned   : None
+****************************************************************************/
+void mltp_task_done(mltp_t *task)
+{
+    task->state = mltpDone;
+    mltp_id_release(task->thrid);
+    mltp_live_add(0, 1);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_yield
+*   Description: This function puts a running task back on the run queue.
+*                The task must have saved its state, it may be run by
+*                another VP before this function returns.
+*   Parameters : task - task yielding
+*   Effects    : task is handed to the scheduling policy.
+*   Returned   : None
+****************************************************************************/
+void mltp_task_yield(mltp_t *task)
+{
+    task->state = mltpBlock;
+    mltp_sched_put(task, task, MLTP_SCHED_YIELD);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_watch_task
+*   Description: This function parks a task on the watch list of the VP
+*                running it, unless its wait is already satisfied.
+*   Parameters : task - task waiting
+*                w - filled in watch list entry
+*   Effects    : task may be added to the VP's watch list.
+*   Returned   : Non-zero if task was parked.
+****************************************************************************/
+static int mltp_watch_task(mltp_t *task, mltp_watch_t *w)
+{
+    mltp_vp_local_t *mltp_vp_local;
+    long long now;
+
+    now = 0;
+    w->thread = task;
+    w->next = NULL;
+
+    if (mltp_watch_ready(w, &now))
+    {
+        return 0;
+    }
+
+    /* tasks only run on VP main stacks, so there's always a VP */
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+    task->state = mltpBlock;
+    mltp_sched_block(task);
+    mltp_watch_add(mltp_vp_local, w);
+
+    return 1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_wait_until
+*   Description: This function parks a task until the value at addr is no
+*                longer old.
+*   Parameters : task - task waiting
+*                w - watch list entry, valid until task runs again
+*                addr - address of the word being waited on
+*                old - value the word must change from
+*   Effects    : task may be added to the VP's watch list.
+*   Returned   : Non-zero if task was parked, 0 if *addr != old already.
+****************************************************************************/
+int mltp_task_wait_until(mltp_t *task, mltp_watch_t *w,
+                         volatile unsigned int *addr, unsigned int old)
+{
+    w->addr = addr;
+    w->old = old;
+    w->set = 0;
+    w->cas = 0;
+    w->front = 0;
+    w->deadline = 0;
+
+    return mltp_watch_task(task, w);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_lock
+*   Description: This function gets a lock for a task.  If a blocking lock
+*                is held, the task is parked until the VP's watch list scan
+*                takes the lock for it.  Other classes of lock are obtained
+*                right away, so they may spin or sleep the VP.
+*   Parameters : task - task getting the lock
+*                w - watch list entry, valid until task runs again
+*                lock - lock being obtained
+*   Effects    : task holds lock, or will when it runs again.
+*   Returned   : Non-zero if task was parked, 0 if it holds the lock.
+****************************************************************************/
+int mltp_task_lock(mltp_t *task, mltp_watch_t *w, mltp_lock_t *lock)
+{
+    if ((lock->lock_class != MLTP_LOCK_BLOCK) &&
+        (lock->lock_class != MLTP_LOCK_BLOCK_FRONT))
+    {
+        mltp_lock(lock);
+        return 0;
+    }
+
+    w->addr = &(lock->now_serving);
+    w->old = 0;
+    w->set = 1;
+    w->cas = 1;
+    w->front = (lock->lock_class == MLTP_LOCK_BLOCK_FRONT);
+    w->deadline = 0;
+
+    return mltp_watch_task(task, w);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_sleep
+*   Description: This function parks a task for a period of time.
+*   Parameters : task - task sleeping
+*                w - watch list entry, valid until task runs again
+*                usec - time to sleep in microseconds
+*   Effects    : task may be added to the VP's watch list.
+*   Returned   : Non-zero if task was parked, 0 if usec has passed already.
+****************************************************************************/
+int mltp_task_sleep(mltp_t *task, mltp_watch_t *w, long usec)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    w->addr = NULL;
+    w->old = 0;
+    w->set = 0;
+    w->cas = 0;
+    w->front = 0;
+    w->deadline = ((long long)ts.tv_sec * 1000000000LL) + ts.tv_nsec +
+        ((long long)usec * 1000LL);
+
+    return mltp_watch_task(task, w);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_cond_wait
+*   Description: This function parks a task on a conditional's queue.
+*   Parameters : task - task waiting
+*                cond - conditional being waited on
+*   Effects    : task is placed at the end of the conditional queue.
+*   Returned   : Non-zero, task is always parked.
+****************************************************************************/
+int mltp_task_cond_wait(mltp_t *task, mltp_cond_t *cond)
+{
+    task->state = mltpBlock;
+    mltp_sched_block(task);
+    mltp_qput(&(cond->q), task);
+
+    return 1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_task_chan
+*   Description: This function performs a channel operation for a task.  If
+*                the operation can't be done right away the task is parked
+*                on the channel, the thread or task that completes the
+*                operation makes it runnable.
+*   Parameters : task - task performing the operation
+*                op - operation (op->sel), and room for the waiter.  op
+*                     must stay valid until task runs again.
+*   Effects    : Operation is performed or task is parked.
+*   Returned   : Non-zero if task was parked.  In either case the result
+*                of the operation (0 or -1 if the channel is closed) is in
+*                op->waiter.status once task runs.
+****************************************************************************/
+int mltp_task_chan(mltp_t *task, mltp_task_chan_t *op)
+{
+    mltp_chan_t *chan;
+    int result;
+
+    chan = op->sel.chan;
+
+    op->wait.thread = task;
+    op->wait.claimed = 0;
+    op->wait.fired = -1;
+    op->wait.arrived = 0;
+
+    op->waiter.wait = &(op->wait);
+    op->waiter.index = 0;
+    op->waiter.linked = 0;
+    op->waiter.status = 0;
+    op->waiter.data = op->sel.msg;
+
+    mltp_spinlock_lock(&(chan->lock));
+
+    if (op->sel.op == MLTP_CHAN_SEND)
+    {
+        result = mltp_chan_send_locked(chan, op->sel.msg);
+    }
+    else
+    {
+        result = mltp_chan_recv_locked(chan, op->sel.msg);
+    }
+
+    if (result != 0)
+    {
+        mltp_spinlock_unlock(&(chan->lock));
+        op->waiter.status = (result > 0) ? 0 : -1;
+        return 0;
+    }
+
+    task->state = mltpBlock;
+    mltp_sched_block(task);
+    mltp_waiter_link((op->sel.op == MLTP_CHAN_SEND) ?
+        &(chan->sendq) : &(chan->recvq), &(op->waiter));
+    mltp_spinlock_unlock(&(chan->lock));
+
+    /* done with the waiter, task may run once it's claimed */
+    mltp_wait_arrive(&(op->wait));
+
+    return 1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_grow
+*   Description: This function doubles the size of an unbounded channel's
+*                buffer.  The channel's lock must be held by the caller.
+*   Parameters : chan - channel being grown
+*   Effects    : chan's buffer is reallocated with the messages in it moved
+*                to the start of the new buffer.
+*   Returned   : None
+****************************************************************************/
+static void mltp_chan_grow(mltp_chan_t *chan)
+{
+    char *buffer;
+    int size, first;
+
+    size = (chan->size == 0) ? 16 : (2 * chan->size);
+    buffer = (char *)xmalloc(size * chan->elem_size);
+
+    if (chan->count > 0)
+    {
+        /* copy from the head to the end, then anything that wrapped */
+        first = chan->size - chan->head;
+
+        if (first > chan->count)
+        {
+            first = chan->count;
+        }
+
+        memcpy(buffer, chan->buffer + (chan->head * chan->elem_size),
+            first * chan->elem_size);
+        memcpy(buffer + (first * chan->elem_size), chan->buffer,
+            (chan->count - first) * chan->elem_size);
+    }
+
+    if (chan->buffer != NULL)
+    {
+        free(chan->buffer);
+    }
+
+    chan->buffer = buffer;
+    chan->size = size;
+    chan->head = 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_send_locked
+*   Description: This function sends a message on a channel if it can be
+*                done without waiting.  A waiting receiver is handed the
+*                message directly.  The channel's lock must be held by the
+*                caller.
+*   Parameters : chan - channel message is sent on
+*                msg - message being sent
+*   Effects    : msg is copied to a waiting receiver or into chan's buffer.
+*   Returned   : 1 if the message was sent, 0 if sending would block, and
+*                -1 if chan is closed.
+****************************************************************************/
+static int mltp_chan_send_locked(mltp_chan_t *chan, const void *msg)
+{
+    mltp_waiter_t *w;
+    int tail;
+
+    if (chan->closed)
+    {
+        return -1;
+    }
+
+    /* hand the message straight to a waiting receiver */
+    while ((w = chan->recvq) != NULL)
+    {
+        mltp_waiter_unlink(&(chan->recvq), w);
+
+        if (mltp_waiter_claim(w))
+        {
+            memcpy(w->data, msg, chan->elem_size);
+            w->status = 0;
+            mltp_wait_arrive(w->wait);
+            return 1;
+        }
+    }
+
+    if ((chan->capacity != MLTP_CHAN_UNBOUNDED) &&
+        (chan->count >= chan->capacity))
+    {
+        /* no room */
+        return 0;
+    }
+
+    if (chan->count == chan->size)
+    {
+        mltp_chan_grow(chan);
+    }
+
+    tail = (chan->head + chan->count) % chan->size;
+    memcpy(chan->buffer + (tail * chan->elem_size), msg, chan->elem_size);
+    chan->count++;
+
+    return 1;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_chan_recv_locked
+*   Description: This function receives a message from a channel if it can
+*                be done without waiting.  If a sender is waiting for room,
+*                its message is moved into the space that was freed (or
+*                taken directly for unbuffered channels).  The channel's
+*                lock must be held by the caller.
+*   Parameters : chan - channel message is received from
+*                msg - buffer message is received into
+*   Effects    : The oldest message in chan is copied into msg.
+*   Returned   : 1 if a message was received, 0 if receiving would block,
+*                and -1 if chan is closed and empty.
+****************************************************************************/
+static int mltp_chan_recv_locked(mltp_chan_t *chan, void *msg)
+{
+    mltp_waiter_t *w;
+    int tail;
+
+    if (chan->count > 0)
+    {
+        memcpy(msg, chan->buffer + (chan->head * chan->elem_size),
+            chan->elem_size);
+        chan->head = (chan->head + 1) % chan->size;
+        chan->count--;
+
+        /* let a waiting sender have the space we just freed */
+        while ((w = chan->sendq) != NULL)
+        {
+            mltp_waiter_unlink(&(chan->sendq), w);
+
+            if (mltp_waiter_claim(w))
+            {
+                tail = (chan->head + chan->count) % chan->size;
+                memcpy(chan->buffer + (tail * chan->elem_size), w->data,
+                    chan->elem_size);
+                chan->count++;
+                w->status = 0;
+                mltp_wait_arrive(w->wait);
+                break;
+            }
+        }
+
+        return 1;
+    }
+
+    /* nothing buffered, take a message straight from a waiting sender */
+    while ((w = chan->sendq) != NULL)
+    {
+        mltp_waiter_unlink(&(chan->sendq), w);
+
+        if (mltp_waiter_claim(w))
+        {
+            memcpy(msg, w->data, chan->elem_size);
+            w->status = 0;
+            mltp_wait_arrive(w->wait);
+            return 1;
+        }
+    }
+
+    if (chan->closed)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_inbox_init
+*   Description: This function initializes a VP's wakeup inbox.  The inbox
+*                is an intrusive multiple-producer single-consumer queue.
+*                Producers push threads by swapping the head pointer, only
+*                the owning VP pops threads from the tail.  A stub thread
+*                keeps the queue from ever being truly empty.
+*   Parameters : vp - VP whose inbox is being initialized
+*   Effects    : vp's inbox is empty.
+*   Returned   : None
+****************************************************************************/
+static void mltp_inbox_init(mltp_vp_local_t *vp)
+{
+    vp->inbox_stub.next = NULL;
+    vp->inbox_stub.thrid = -32766;      /* give a thread ID for tracing */
+    vp->inbox_head = &(vp->inbox_stub);
+    vp->inbox_tail = &(vp->inbox_stub);
+    vp->inbox_busy = 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_inbox_push
+*   Description: This function pushes a list of threads into a VP's wakeup
+*                inbox.  It may be called by any thread and never locks.
+*   Parameters : vp - VP whose inbox is being pushed into
+*                first - first thread in the list
+*                last - last thread in the list
+*   Effects    : Threads from first to last are appended to vp's inbox.
+*   Returned   : None
+****************************************************************************/
+static void mltp_inbox_push(mltp_vp_local_t *vp, mltp_t *first, mltp_t *last)
+{
+    mltp_t *prev;
+
+    MLTP_INBOX_NEXT(last) = NULL;
+
+    /* swing the head to the end of the list */
+    prev = mltp_atomic_exchange(&(vp->inbox_head), last, MLTP_ACQ_REL);
+
+    /* the list is unreachable by the VP until this store */
+    MLTP_INBOX_NEXT(prev) = first;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_inbox_pop
+*   Description: This function pops the oldest thread from a VP's wakeup
+*                inbox.  It may only be called by the VP owning the inbox
+*                (or whoever holds inbox_busy after the VP has exited).
+*   Parameters : vp - VP whose inbox is being popped from
+*   Effects    : Oldest thread is removed from vp's inbox.
+*   Returned   : Pointer to thread or NULL if the inbox is empty, or a push
+*                is half finished.
+****************************************************************************/
+static mltp_t *mltp_inbox_pop(mltp_vp_local_t *vp)
+{
+    mltp_t *tail, *next;
+
+    tail = vp->inbox_tail;
+    next = MLTP_INBOX_NEXT(tail);
+
+    if (tail == &(vp->inbox_stub))
+    {
+        if (next == NULL)
+        {
+            /* empty */
+            return NULL;
+        }
+
+        /* skip over the stub */
+        vp->inbox_tail = next;
+        tail = next;
+        next = MLTP_INBOX_NEXT(next);
+    }
+
+    if (next != NULL)
+    {
+        vp->inbox_tail = next;
+        return tail;
+    }
+
+    if (tail != vp->inbox_head)
+    {
+        /* a push hasn't linked its list yet, get it next time */
+        return NULL;
+    }
+
+    /* tail is the last thread, push the stub behind it so it can go */
+    mltp_inbox_push(vp, &(vp->inbox_stub), &(vp->inbox_stub));
+    next = MLTP_INBOX_NEXT(tail);
+
+    if (next != NULL)
+    {
+        vp->inbox_tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_inbox_drain
+*   Description: This function moves every thread in a VP's wakeup inbox to
+*                the run queue.
+*   Parameters : vp - VP whose inbox is being drained
+*   Effects    : Threads popped from vp's inbox are handed to the
+*                scheduling policy as a single list.
+*   Returned   : None
+****************************************************************************/
+static void mltp_inbox_drain(mltp_vp_local_t *vp)
+{
+    mltp_inbox_take(vp, NULL);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_inbox_take
+*   Description: This function drains a VP's wakeup inbox like
+*                mltp_inbox_drain, but keeps one thread out of the run
+*                queue.
+*   Parameters : vp - VP whose inbox is being drained
+*                want - thread to hold back (may be NULL)
+*   Effects    : Threads popped from vp's inbox other than want are handed
+*                to the scheduling policy as a single list.
+*   Returned   : Non-zero if want was found in the inbox.
+****************************************************************************/
+static int mltp_inbox_take(mltp_vp_local_t *vp, mltp_t *want)
+{
+    mltp_t *first, *last, *t;
+    int found;
+
+    first = last = NULL;
+    found = 0;
+
+    while ((t = mltp_inbox_pop(vp)) != NULL)
+    {
+        if (t == want)
+        {
+            found = 1;
+            continue;
+        }
+
+        if (first == NULL)
+        {
+            first = t;
+        }
+        else
+        {
+            last->next = t;
+        }
+
+        last = t;
+    }
+
+    if (first != NULL)
+    {
+        mltp_sched_put(first, last, MLTP_SCHED_WAKE);
+    }
+
+    return found;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_inbox_adopt
+*   Description: This function drains the wakeup inboxes of VPs that have
+*                stopped dispatching threads.  A thread that picks a VP just
+*                before it exits may push into its inbox after the VP's last
+*                drain, the remaining VPs find those threads here.
+*   Parameters : None
+*   Effects    : Inboxes of exited VPs are drained into the run queue.
+*   Returned   : Non-zero if any inbox was drained.
+****************************************************************************/
+static int mltp_inbox_adopt(void)
+{
+    mltp_vp_local_t *vp;
+    int i, count, drained;
+
+    count = mltp_vp_count;
+    drained = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        vp = mltp_vps[i];
+
+        if ((vp == NULL) || vp->alive)
+        {
+            continue;
+        }
+
+        if (mltp_inbox_empty(vp))
+        {
+            continue;
+        }
+
+        /* only one VP may pop from an inbox at a time */
+        if (mltp_atomic_exchange(&(vp->inbox_busy), 1, MLTP_ACQUIRE) == 0)
+        {
+            mltp_inbox_drain(vp);
+            mltp_atomic_store_release(&(vp->inbox_busy), 0);
+            drained = 1;
+        }
+    }
+
+    return drained;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_inbox_empty
+*   Description: This function checks for threads in a VP's wakeup inbox
+*                without popping them.  It may be called by any thread, so
+*                the answer may be out of date by the time it's used.
+*   Parameters : vp - VP whose inbox is being checked
+*   Effects    : None
+*   Returned   : Non-zero if the inbox looks empty.
+****************************************************************************/
+static int mltp_inbox_empty(mltp_vp_local_t *vp)
+{
+    return ((vp->inbox_tail == &(vp->inbox_stub)) &&
+        (MLTP_INBOX_NEXT(&(vp->inbox_stub)) == NULL));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_wake
+*   Description: This function makes a thread that isn't on any queue
+*                runnable.
+*   Parameters : t - pointer to thread
+*   Effects    : See mltp_wake_list.
+*   Returned   : None
+****************************************************************************/
+static void mltp_wake(mltp_t *t)
+{
+    mltp_wake_list(t, t);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_wake_list
+*   Description: This function makes a list of threads that aren't on any
+*                queue runnable.  Unbound threads push the list into the
+*                inbox of the VP they're running on.  Other threads push
+*                into the inboxes of running VPs in turn, or use the run
+*                queue when no VPs are running.
+*   Parameters : first - first thread in the list
+*                last - last thread in the list
+*   Effects    : Threads from first to last are pushed into a VP's inbox or
+*                placed at the end of the run queue.
+*   Returned   : None
+****************************************************************************/
+static void mltp_wake_list(mltp_t *first, mltp_t *last)
+{
+    mltp_vp_local_t *vp;
+    int i, count;
+
+    vp = (mltp_vp_local_t *)jkthread_getlocal();
+
+    if ((vp == NULL) || !vp->alive)
+    {
+        /* bound or main thread, pick a running VP */
+        count = mltp_vp_count;
+        vp = NULL;
+
+        for (i = 0; i < count; i++)
+        {
+            vp = mltp_vps[mltp_wake_next++ % count];
+
+            if ((vp != NULL) && vp->alive)
+            {
+                break;
+            }
+
+            vp = NULL;
+        }
+
+        if (vp == NULL)
+        {
+            /* nothing is running, hand them straight to the policy */
+            mltp_sched_put(first, last, MLTP_SCHED_WAKE);
+            return;
+        }
+    }
+
+    mltp_inbox_push(vp, first, last);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_vp_id
+*   Description: This function returns the ID of the VP the caller is
+*                running on.
+*   Parameters : None
+*   Effects    : None
+*   Returned   : VP ID, or MLTP_SCHED_NO_VP if the caller isn't running on
+*                a VP that is dispatching threads.
+****************************************************************************/
+static int mltp_vp_id(void)
+{
+    mltp_vp_local_t *vp;
+
+    vp = (mltp_vp_local_t *)jkthread_getlocal();
+
+    if ((vp == NULL) || !vp->alive)
+    {
+        return MLTP_SCHED_NO_VP;
+    }
+
+    return vp->vp_id;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_live_add
+*   Description: This function counts threads created and exited by the
+*                caller.  Callers on a VP update that VP's counts with
+*                plain release stores.  Other callers share the last
+*                counts and update them atomically.
+*   Parameters : created - number of threads created
+*                exited - number of threads exited
+*   Effects    : The caller's live thread counts are incremented.
+*   Returned   : None
+****************************************************************************/
+static void mltp_live_add(unsigned long created, unsigned long exited)
+{
+    mltp_live_t *live;
+    int vp_id;
+
+    /* stay on the VP whose counts are being written */
+    MLTP_PREEMPT_OFF();
+    vp_id = mltp_vp_id();
+
+    if (vp_id == MLTP_SCHED_NO_VP)
+    {
+        live = &mltp_live[MLTP_MAX_VPS];
+
+        if (created)
+        {
+            mltp_atomic_fetch_add(&(live->created), created, MLTP_RELEASE);
+        }
+
+        if (exited)
+        {
+            mltp_atomic_fetch_add(&(live->exited), exited, MLTP_RELEASE);
+        }
+    }
+    else
+    {
+        live = &mltp_live[vp_id];
+
+        if (created)
+        {
+            mltp_atomic_store_release(&(live->created),
+                mltp_atomic_load(&(live->created), MLTP_RELAXED) + created);
+        }
+
+        if (exited)
+        {
+            mltp_atomic_store_release(&(live->exited),
+                mltp_atomic_load(&(live->exited), MLTP_RELAXED) + exited);
+        }
+    }
+
+    MLTP_PREEMPT_ON();
+}
+
+
+/****************************************************************************
+*   Function   : mltp_live_threads
+*   Description: This function returns the number of user threads alive,
+*                for deciding if a VP may exit.  All of the exited counts
+*                are read before any of the created counts.  A thread is
+*                counted as created before it can run, so any exit that's
+*                seen has its creation seen too, and the result is never
+*                less than the number of threads alive.  It may be more
+*                when a thread exits during the reads, which only keeps a
+*                VP running another pass.
+*   Parameters : None
+*   Effects    : None
+*   Returned   : Number of user threads that may still be alive
+****************************************************************************/
+static unsigned long mltp_live_threads(void)
+{
+    unsigned long created, exited;
+    int i, count;
+
+    count = mltp_live_vps;
+    exited = mltp_atomic_load_acquire(&(mltp_live[MLTP_MAX_VPS].exited));
+
+    for (i = 0; i < count; i++)
+    {
+        exited += mltp_atomic_load_acquire(&(mltp_live[i].exited));
+    }
+
+    created = mltp_atomic_load_acquire(&(mltp_live[MLTP_MAX_VPS].created));
+
+    for (i = 0; i < count; i++)
+    {
+        created += mltp_atomic_load_acquire(&(mltp_live[i].created));
+    }
+
+    return created - exited;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_sched_put
+*   Description: This function hands a list of threads that have become
+*                runnable to the scheduling policy.
+*   Parameters : first - first thread in the list
+*                last - last thread in the list
+*                why - reason threads are runnable
+*   Effects    : on_wake is called for woken threads, then the threads are
+*                enqueued by the policy.
+*   Returned   : None
+****************************************************************************/
+static void mltp_sched_put(mltp_t *first, mltp_t *last, mltp_sched_why_t why)
+{
+    mltp_t *t;
+    int vp;
+
+    /* stay on vp until the threads are queued */
+    MLTP_PREEMPT_OFF();
+    vp = mltp_vp_id();
+
+    if ((why == MLTP_SCHED_WAKE) && (mltp_sched->on_wake != NULL))
+    {
+        for (t = first; ; t = t->next)
+        {
+            mltp_sched->on_wake(vp, t);
+
+            if (t == last)
+            {
+                break;
+            }
+        }
+    }
+
+    mltp_sched->enqueue(vp, first, last, why);
+    MLTP_PREEMPT_ON();
+}
+
+
+/****************************************************************************
+*   Function   : mltp_sched_block
+*   Description: This function tells the scheduling policy that a thread
+*                has blocked.  It must be called before the thread is
+*                parked where it can be found and woken.
+*   Parameters : t - blocking thread
+*   Effects    : on_block is called for t.
+*   Returned   : None
+****************************************************************************/
+static void mltp_sched_block(mltp_t *t)
+{
+    if (mltp_sched->on_block != NULL)
+    {
+        mltp_sched->on_block(mltp_vp_id(), t);
+    }
+}
+
+
+/***************************************************************************
+*                          FIFO SCHEDULING POLICY
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : mltp_fifo_init
+*   Description: This function initializes the global run queue used by
+*                the FIFO, LIFO, and priority policies.
+*   Parameters : None
+*   Effects    : Global run queue is empty.
+*   Returned   : None
+****************************************************************************/
+static void mltp_fifo_init(void)
+{
+    mltp_qinit(&mltp_global_runq.q);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_fifo_enqueue
+*   Description: This function puts runnable threads at the end of the
+*                global run queue.  Threads yielding to the first thread
+*                are put second.
+*   Parameters : vp - unused
+*                first - first thread in the list
+*                last - last thread in the list
+*                why - reason threads are runnable
+*   Effects    : Threads are placed on the global run queue.
+*   Returned   : None
+****************************************************************************/
+static void mltp_fifo_enqueue(int vp, mltp_t *first, mltp_t *last,
+    mltp_sched_why_t why)
+{
+    if (why == MLTP_SCHED_YIELD_FIRST)
+    {
+        mltp_qput_second(&mltp_global_runq.q, first);
+    }
+    else
+    {
+        mltp_qput_list(&mltp_global_runq.q, first, last);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_fifo_dequeue
+*   Description: This function removes the thread at the head of the global
+*                run queue.  It is used by the FIFO, LIFO, and priority
+*                policies.
+*   Parameters : vp - unused
+*   Effects    : Head of global run queue is removed.
+*   Returned   : Pointer to thread or NULL if the queue is empty.
+****************************************************************************/
+static mltp_t *mltp_fifo_dequeue(int vp)
+{
+    return mltp_qget(&mltp_global_runq.q);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_fifo_waiting
+*   Description: This function checks for threads on the global run queue.
+*                It is used by the FIFO and LIFO policies.
+*   Parameters : vp - unused
+*   Effects    : None
+*   Returned   : Non-zero if the global run queue looked non-empty.
+****************************************************************************/
+static int mltp_fifo_waiting(int vp)
+{
+    return (mltp_atomic_load(&(mltp_global_runq.q.t.next), MLTP_RELAXED) !=
+        &(mltp_global_runq.q.t));
+}
+
+
+const mltp_sched_t mltp_sched_fifo =
+{
+    "fifo",
+    mltp_fifo_init,
+    mltp_fifo_enqueue,
+    mltp_fifo_dequeue,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    mltp_fifo_waiting
+};
+
+
+/***************************************************************************
+*                          LIFO SCHEDULING POLICY
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : mltp_lifo_enqueue
+*   Description: This function puts new and woken threads at the head of
+*                the global run queue, so they run while the data they were
+*                handed is still in cache.  Yielding threads still go to the
+*                end, otherwise a yield would never let anybody else run.
+*   Parameters : vp - unused
+*                first - first thread in the list
+*                last - last thread in the list
+*                why - reason threads are runnable
+*   Effects    : Threads are placed on the global run queue.
+*   Returned   : None
+****************************************************************************/
+static void mltp_lifo_enqueue(int vp, mltp_t *first, mltp_t *last,
+    mltp_sched_why_t why)
+{
+    switch (why)
+    {
+        case MLTP_SCHED_YIELD:
+            mltp_qput_list(&mltp_global_runq.q, first, last);
+            break;
+
+        case MLTP_SCHED_YIELD_FIRST:
+            mltp_qput_second(&mltp_global_runq.q, first);
+            break;
+
+        default:
+            mltp_qpush_list(&mltp_global_runq.q, first, last);
+            break;
+    }
+}
+
+
+const mltp_sched_t mltp_sched_lifo =
+{
+    "lifo",
+    mltp_fifo_init,
+    mltp_lifo_enqueue,
+    mltp_fifo_dequeue,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    mltp_fifo_waiting
+};
+
+
+/***************************************************************************
+*                        PRIORITY SCHEDULING POLICY
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : mltp_prio_init
+*   Description: This function initializes the per level run queues and
+*                bitmap used by the priority policy.
+*   Parameters : None
+*   Effects    : All levels are empty.
+*   Returned   : None
+****************************************************************************/
+static void mltp_prio_init(void)
+{
+    int i;
+
+    for (i = 0; i < MLTP_PRIO_LEVELS; i++)
+    {
+        mltp_qinit(&mltp_prio_runq[i].q);
+    }
+
+    mltp_prio.map = 0;
+    mltp_prio.gets = 0;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_prio_level
+*   Description: This function converts a thread's priority to the level
+*                it is queued at.  Level 0 holds the highest priority, so
+*                the lowest set bit of the bitmap is the level to run next.
+*   Parameters : t - pointer to thread
+*   Effects    : None
+*   Returned   : Level for t's priority
+****************************************************************************/
+static int mltp_prio_level(mltp_t *t)
+{
+    if (t->priority >= MLTP_PRIO_MAX)
+    {
+        return 0;
+    }
+
+    if (t->priority <= MLTP_PRIO_MIN)
+    {
+        return MLTP_PRIO_LEVELS - 1;
+    }
+
+    return MLTP_PRIO_MAX - t->priority;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_prio_put
+*   Description: This function puts a thread on the queue for a level.
+*                The level's bit is only changed while holding the level's
+*                lock, so a set bit always means a non-empty level once the
+*                lock is taken.
+*   Parameters : level - level being added to
+*                t - pointer to thread
+*                second - non-zero to put t behind just the head of the
+*                         level.
+*   Effects    : Thread t is added to level and the level's bit is set.
+*   Returned   : None
+****************************************************************************/
+static void mltp_prio_put(int level, mltp_t *t, int second)
+{
+    mltp_q_t *q;
+
+    q = &mltp_prio_runq[level].q;
+    mltp_spinlock_lock(&(q->lock));   /* aquire the level lock */
+
+    if (second && (q->t.next != &q->t))
+    {
+        /* place at second spot in queue */
+        t->next = q->t.next->next;
+        q->t.next->next = t;
+
+        if (t->next == &q->t)
+        {
+            q->tail = t;
+        }
+    }
+    else
+    {
+        q->tail->next = t;
+        t->next = &q->t;
+        q->tail = t;
+    }
+
+    if (!(mltp_prio.map & (1UL << level)))
+    {
+        mltp_test_and_set_bit(level, &(mltp_prio.map));
+    }
+
+    mltp_spinlock_unlock(&(q->lock)); /* release the level lock */
+}
+
+
+/****************************************************************************
+*   Function   : mltp_prio_get
+*   Description: This function removes the thread at the head of a level.
+*   Parameters : level - level being removed from
+*   Effects    : Head of level is removed.  The level's bit is cleared if
+*                the level is now empty.
+*   Returned   : Pointer to thread or NULL if the level is empty.
+****************************************************************************/
+static mltp_t *mltp_prio_get(int level)
+{
+    mltp_q_t *q;
+    mltp_t *t;
+
+    q = &mltp_prio_runq[level].q;
+    mltp_spinlock_lock(&(q->lock));   /* aquire the level lock */
+
+    t = q->t.next;
+
+    if (t == &q->t)
+    {
+        /* somebody emptied it since the bitmap was read */
+        t = NULL;
+    }
+    else
+    {
+        q->t.next = t->next;
+
+        if (t->next == &q->t)
+        {
+            /* level is empty now */
+            q->tail = &q->t;
+            mltp_test_and_clear_bit(level, &(mltp_prio.map));
+        }
+    }
+
+    mltp_spinlock_unlock(&(q->lock)); /* release the level lock */
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_prio_age
+*   Description: This function moves the thread that has waited longest at
+*                each level up to the next higher level.  Levels are aged
+*                from the top down, so no thread moves more than one level
+*                per call.  A thread goes back to the level for its own
+*                priority the next time it's queued.
+*   Parameters : None
+*   Effects    : Head of every non-empty level except the top moves up.
+*   Returned   : None
+****************************************************************************/
+static void mltp_prio_age(void)
+{
+    mltp_t *t;
+    int level;
+
+    for (level = 1; level < MLTP_PRIO_LEVELS; level++)
+    {
+        if (!(mltp_prio.map & (1UL << level)))
+        {
+            continue;
+        }
+
+        t = mltp_prio_get(level);
+
+        if (t != NULL)
+        {
+            mltp_prio_put(level - 1, t, 0);
+        }
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_prio_enqueue
+*   Description: This function puts runnable threads on the level for their
+*                priority.
+*   Parameters : vp - unused
+*                first - first thread in the list
+*                last - last thread in the list
+*                why - reason threads are runnable
+*   Effects    : Threads are placed at the end of their levels.  Threads
+*                yielding to the first thread go second in their level.
+*   Returned   : None
+****************************************************************************/
+static void mltp_prio_enqueue(int vp, mltp_t *first, mltp_t *last,
+    mltp_sched_why_t why)
+{
+    mltp_t *t, *next;
+
+    for (t = first; ; t = next)
+    {
+        next = t->next;
+        mltp_prio_put(mltp_prio_level(t), t,
+            (why == MLTP_SCHED_YIELD_FIRST));
+
+        if (t == last)
+        {
+            break;
+        }
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_prio_dequeue
+*   Description: This function removes the thread at the head of the
+*                highest priority non-empty level.  Every MLTP_PRIO_AGE
+*                dequeues the waiting threads are aged.
+*   Parameters : vp - unused
+*   Effects    : A thread is removed from its level.
+*   Returned   : Pointer to thread or NULL if all levels are empty.
+****************************************************************************/
+static mltp_t *mltp_prio_dequeue(int vp)
+{
+    mltp_t *t;
+    unsigned long map;
+
+    /* count is only a rough guide, so races on it don't matter */
+    if (++mltp_prio.gets >= MLTP_PRIO_AGE)
+    {
+        mltp_prio.gets = 0;
+        mltp_prio_age();
+    }
+
+    for (;;)
+    {
+        map = mltp_prio.map;
+
+        if (map == 0)
+        {
+            return NULL;
+        }
+
+        t = mltp_prio_get(mltp_find_first_bit(map));
+
+        if (t != NULL)
+        {
+            return t;
+        }
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_prio_waiting
+*   Description: This function checks for threads on any priority level.
+*   Parameters : vp - unused
+*   Effects    : None
+*   Returned   : Non-zero if any level looked non-empty.
+****************************************************************************/
+static int mltp_prio_waiting(int vp)
+{
+    return (mltp_prio.map != 0);
+}
+
+
+const mltp_sched_t mltp_sched_priority =
+{
+    "priority",
+    mltp_prio_init,
+    mltp_prio_enqueue,
+    mltp_prio_dequeue,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    mltp_prio_waiting
+};
+
+
+/***************************************************************************
+*                      WORK STEALING SCHEDULING POLICY
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : mltp_steal_init
+*   Description: This function initializes the per VP run queues and
+*                dispatch batches used by the work stealing policy.
+*   Parameters : None
+*   Effects    : All per VP run queues and batches are empty, and the
+*                dispatch counts are cleared.
+*   Returned   : None
+****************************************************************************/
+static void mltp_steal_init(void)
+{
+    int i;
+
+    for (i = 0; i <= MLTP_MAX_VPS; i++)
+    {
+        mltp_qinit(&mltp_vp_runq[i].q);
+        mltp_vp_runq[i].count = 0;
+    }
+
+    for (i = 0; i < MLTP_MAX_VPS; i++)
+    {
+        mltp_steal_batch[i].head = NULL;
+        mltp_steal_batch[i].locks = 0;
+        mltp_steal_batch[i].runs = 0;
+    }
+}
+
+
+/****************************************************************************
+*   Function   : mltp_steal_queue
+*   Description: This function returns the run queue belonging to a VP.
+*   Parameters : vp - VP ID or MLTP_SCHED_NO_VP
+*   Effects    : None
+*   Returned   : Pointer to vp's queue, or the shared queue if vp is
+*                MLTP_SCHED_NO_VP.
+****************************************************************************/
+static mltp_runq_t *mltp_steal_queue(int vp)
+{
+    if (vp == MLTP_SCHED_NO_VP)
+    {
+        return &mltp_vp_runq[MLTP_MAX_VPS];
+    }
+
+    return &mltp_vp_runq[vp];
+}
+
+
+/****************************************************************************
+*   Function   : mltp_steal_others_idle
+*   Description: This function checks if any VP other than the caller
+*                came up empty on its last dispatch.  It only reads a
+*                count that changes when VPs run dry or find work, so it's
+*                cheap enough to call on every dispatch.
+*   Parameters : vp - calling VP
+*   Effects    : None
+*   Returned   : Non-zero if another VP looks idle.
+****************************************************************************/
+static int mltp_steal_others_idle(int vp)
+{
+    int idle;
+
+    idle = mltp_atomic_load(&(mltp_counts.idle_vps), MLTP_RELAXED);
+
+    /* a VP refilling its batch may not have cleared its own idle flag */
+    if ((mltp_vps[vp] != NULL) && mltp_vps[vp]->idle)
+    {
+        idle--;
+    }
+
+    return (idle > 0);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_steal_put
+*   Description: This function puts a list of threads on a run queue and
+*                counts them.
+*   Parameters : rq - run queue
+*                first - first thread in the list
+*                last - last thread in the list
+*                n - number of threads in the list
+*                where - MLTP_STEAL_TAIL to put the threads at the end of
+*                        the queue, MLTP_STEAL_HEAD to put them at the
+*                        front, or MLTP_STEAL_SECOND to put a single thread
+*                        second, unless there is no first
+*   Effects    : The threads are placed on rq.
+*   Returned   : None
+****************************************************************************/
+static void mltp_steal_put(mltp_runq_t *rq, mltp_t *first, mltp_t *last,
+    int n, int where)
+{
+    mltp_q_t *q;
+
+    q = &(rq->q);
+    mltp_spinlock_lock(&(q->lock));
+
+    if ((where == MLTP_STEAL_HEAD) && (q->t.next != &q->t))
+    {
+        last->next = q->t.next;
+        q->t.next = first;
+    }
+    else if ((where == MLTP_STEAL_SECOND) && (q->t.next != &q->t))
+    {
+        last->next = q->t.next->next;
+        q->t.next->next = first;
+
+        if (last->next == &q->t)
+        {
+            q->tail = last;
+        }
+    }
+    else
+    {
+        q->tail->next = first;
+        last->next = &q->t;
+        q->tail = last;
+    }
+
+    rq->count += n;
+    mltp_spinlock_unlock(&(q->lock));
+}
+
+
+/****************************************************************************
+*   Function   : mltp_steal_take
+*   Description: This function takes half of the threads on a run queue,
+*                rounding up so a single thread can be taken.
+*   Parameters : rq - run queue
+*                max - most threads to take, 0 for no limit
+*                n - set to the number of threads taken
+*                locks - incremented if rq's lock is taken
+*   Effects    : Threads are removed from the head of rq.
+*   Returned   : The threads taken, linked through their next fields and
+*                ending with NULL, or NULL if rq was empty.
+****************************************************************************/
+static mltp_t *mltp_steal_take(mltp_runq_t *rq, int max, int *n,
+    unsigned long *locks)
+{
+    mltp_q_t *q;
+    mltp_t *first, *last;
+    int i, want;
+
+    q = &(rq->q);
+
+    /* don't bother locking a queue that looks empty */
+    if (mltp_atomic_load(&(rq->count), MLTP_RELAXED) == 0)
+    {
+        *n = 0;
+        return NULL;
+    }
+
+    mltp_spinlock_lock(&(q->lock));
+    (*locks)++;
+    want = (rq->count + 1) / 2;
+
+    if ((max > 0) && (want > max))
+    {
+        want = max;
+    }
+
+    first = q->t.next;
+    last = &(q->t);
+
+    for (i = 0; (i < want) && (last->next != &(q->t)); i++)
+    {
+        last = last->next;
+    }
+
+    if (i == 0)
+    {
+        first = NULL;
+    }
+    else
+    {
+        q->t.next = last->next;
+
+        if (q->t.next == &(q->t))
+        {
+            q->tail = &(q->t);
+        }
+
+        last->next = NULL;
+        rq->count -= i;
+    }
+
+    mltp_spinlock_unlock(&(q->lock));
+
+    *n = i;
+    return first;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_steal_enqueue
+*   Description: This function puts runnable threads at the end of the
+*                calling VP's run queue.  A new thread created with a home
+*                VP goes on the home VP's queue instead, if that VP is
+*                running.  Threads created before mltp_start go on the
+*                shared queue regardless.  A thread yielding to the first
+*                goes second in the VP's batch if the batch isn't empty.
+*   Parameters : vp - calling VP
+*                first - first thread in the list
+*                last - last thread in the list
+*                why - reason threads are runnable
+*   Effects    : Threads are placed on vp's run queue.
+*   Returned   : None
+****************************************************************************/
+static void mltp_steal_enqueue(int vp, mltp_t *first, mltp_t *last,
+    mltp_sched_why_t why)
+{
+    mltp_steal_batch_t *batch;
+    mltp_t *t;
+    int home, n;
+
+    if (why == MLTP_SCHED_YIELD_FIRST)
+    {
+        batch = (vp == MLTP_SCHED_NO_VP) ? NULL : &mltp_steal_batch[vp];
+
+        if ((batch != NULL) && (batch->head != NULL))
+        {
+            /* the batch is the front of the queue */
+            first->next = batch->head->next;
+            batch->head->next = first;
+        }
+        else
+        {
+            mltp_steal_put(mltp_steal_queue(vp), first, first, 1,
+                MLTP_STEAL_SECOND);
+        }
+
+        return;
+    }
+
+    home = first->home_vp;
+
+    /* VPs only steal from queues below mltp_vp_count */
+    if ((why == MLTP_SCHED_NEW) && (first == last) &&
+        (vp != MLTP_SCHED_NO_VP) && (home >= 0) && (home < mltp_vp_count))
+    {
+        vp = home;
+    }
+
+    for (n = 1, t = first; t != last; t = t->next)
+    {
+        n++;
+    }
+
+    mltp_steal_put(mltp_steal_queue(vp), first, last, n, MLTP_STEAL_TAIL);
+}
+
+
+/****************************************************************************
+*   Function   : mltp_steal_dequeue
+*   Description: This function removes the next thread from the calling
+*                VP's batch.  When the batch is empty it's refilled with
+*                half of the VP's run queue, up to MLTP_STEAL_BATCH
+*                threads, so deep queues are drained with few lock
+*                acquisitions and shallow queues leave work for thieves.
+*                While other VPs are idle only one thread is taken, so
+*                none are hidden from them.
+*   Parameters : vp - calling VP
+*   Effects    : Head of vp's batch is removed.
+*   Returned   : Pointer to thread or NULL if the queue is empty.
+****************************************************************************/
+static mltp_t *mltp_steal_dequeue(int vp)
+{
+    mltp_steal_batch_t *batch;
+    mltp_t *t;
+    int n, max;
+
+    batch = &mltp_steal_batch[vp];
+
+    if (batch->head == NULL)
+    {
+        max = mltp_steal_others_idle(vp) ? 1 : MLTP_STEAL_BATCH;
+        batch->head = mltp_steal_take(mltp_steal_queue(vp), max, &n,
+            &(batch->locks));
+
+        if (batch->head == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    t = batch->head;
+    batch->head = t->next;
+    batch->runs++;
+
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_steal_steal
+*   Description: This function takes half of the threads on the shared
+*                queue or on another VP's queue.  Other VPs are tried
+*                starting with the next VP, so thieves don't all pick on
+*                VP 0.  The first thread taken is run, the rest go on the
+*                thief's own queue, where other thieves can still reach
+*                them.
+*   Parameters : vp - calling VP
+*   Effects    : Threads may be moved from another queue to vp's.
+*   Returned   : Pointer to thread or NULL if all queues are empty.
+****************************************************************************/
+static mltp_t *mltp_steal_steal(int vp)
+{
+    mltp_steal_batch_t *batch;
+    mltp_t *t, *last;
+    int i, n, count, victim;
+
+    batch = &mltp_steal_batch[vp];
+    t = mltp_steal_take(mltp_steal_queue(MLTP_SCHED_NO_VP), 0, &n,
+        &(batch->locks));
+
+    count = mltp_vp_count;
+
+    for (i = 1; (t == NULL) && (i < count); i++)
+    {
+        victim = (vp + i) % count;
+        t = mltp_steal_take(mltp_steal_queue(victim), 0, &n,
+            &(batch->locks));
+    }
+
+    if (t == NULL)
+    {
+        return NULL;
+    }
+
+    if (n > 1)
+    {
+        for (last = t->next; last->next != NULL; last = last->next);
+        batch->locks++;
+        mltp_steal_put(mltp_steal_queue(vp), t->next, last, n - 1,
+            MLTP_STEAL_TAIL);
+    }
+
+    batch->runs++;
+    return t;
+}
+
+
+/****************************************************************************
+*   Function   : mltp_steal_tick
+*   Description: This function is called each time a VP regains control
+*                from a thread.  If other VPs went idle while the thread
+*                ran, the rest of the VP's batch is put back at the front
+*                of its run queue, where they can steal it.
+*   Parameters : vp - calling VP
+*   Effects    : vp's batch may be moved to its run queue.
+*   Returned   : None
 ****************************************************************************/
-static void mltp_only(void *pu, void *pt, qt_userf_t *f)
+static void mltp_steal_tick(int vp)
 {
+    mltp_steal_batch_t *batch;
+    mltp_t *last;
+    int n;
 
-    /* set thread's state to running */
-    ((mltp_t*)pt)->state = mltpRunning;
+    batch = &mltp_steal_batch[vp];
 
-    /* call thread's main function and store return value */
-    ((mltp_t*)pt)->retval = (*(mltp_userf_t *)f)(pu);
+    if ((batch->head == NULL) || !mltp_steal_others_idle(vp))
+    {
+        return;
+    }
 
-    /* thread function must exit to get here */
-    ((mltp_t*)pt)->state = mltpDone;
+    for (n = 1, last = batch->head; last->next != NULL; last = last->next)
+    {
+        n++;
+    }
 
-     mltp_abort();
-    /* abort should replace return */
+    batch->locks++;
+    mltp_steal_put(mltp_steal_queue(vp), batch->head, last, n,
+        MLTP_STEAL_HEAD);
+    batch->head = NULL;
 }
 
 
 /****************************************************************************
-*   Function   : mltp_thread_start
-*   Description: This function makes a variable arguement thread runable.
-*   Parameters : pt - pointer to thread
-*   Effects    : Makes thread runnable
-*   Returned   : This function never returns
+*   Function   : mltp_steal_waiting
+*   Description: This function checks for threads vp could run without
+*                stealing, in its batch, its run queue, or the shared
+*                queue.
+*   Parameters : vp - VP being checked
+*   Effects    : None
+*   Returned   : Non-zero if any of vp's queues looked non-empty.
 ****************************************************************************/
-static void mltp_thread_start(void *pt)
+static int mltp_steal_waiting(int vp)
 {
-    /* set thread's state to running */
-    ((mltp_t*)pt)->state = mltpRunning;
+    return ((mltp_atomic_load(&(mltp_steal_batch[vp].head), MLTP_RELAXED) !=
+        NULL) ||
+        (mltp_atomic_load(&(mltp_vp_runq[vp].count), MLTP_RELAXED) != 0) ||
+        (mltp_atomic_load(&(mltp_vp_runq[MLTP_MAX_VPS].count),
+            MLTP_RELAXED) != 0));
 }
 
 
 /****************************************************************************
-*   Function   : mltp_thread_cleanup
-*   Description: The function waits for a thread to return from its main
-*                function, marks it done, and saves the return value.
-*   Parameters : pt - pointer to thread
-*                vuser_retval - value returned
-*   Effects    : handles a thread's termination.
-*   Returned   : This function never returns
+*   Function   : mltp_steal_stats
+*   Description: This function reports how many run queue locks VPs took
+*                to dispatch threads under mltp_sched_steal, and how many
+*                threads they dispatched.  Locks taken to enqueue threads
+*                aren't counted.  The counts are cleared by
+*                mltp_init_sched(&mltp_sched_steal).
+*   Parameters : locks - set to the run queue locks taken by dispatching
+*                runs - set to the threads dispatched
+*   Effects    : None
+*   Returned   : None
 ****************************************************************************/
-static void mltp_thread_cleanup(void *pt, void *vuserf_retval)
+void mltp_steal_stats(unsigned long *locks, unsigned long *runs)
 {
-    /* thread function must exit to get here */
-    ((mltp_t*)pt)->state = mltpDone;
+    int i;
 
-    /* save the return value */
-    ((mltp_t*)pt)->retval = vuserf_retval;
+    *locks = 0;
+    *runs = 0;
 
-     mltp_abort();
-    /* abort should replace return */
+    for (i = 0; i < MLTP_MAX_VPS; i++)
+    {
+        *locks += mltp_steal_batch[i].locks;
+        *runs += mltp_steal_batch[i].runs;
+    }
 }
 
 
+const mltp_sched_t mltp_sched_steal =
+{
+    "steal",
+    mltp_steal_init,
+    mltp_steal_enqueue,
+    mltp_steal_dequeue,
+    mltp_steal_steal,
+    NULL,
+    NULL,
+    mltp_steal_tick,
+    mltp_steal_waiting
+};
+
+
 /****************************************************************************
-*   Function   : mltp_abort
-*   Description: This function aborts the current thread.
+*   Function   : mltp_self
+*   Description: This function returns the unbound thread calling it.
 *   Parameters : None
-*   Effects    : The current running thread is aborted and the next thread
-*                is made the current running thread.
-*   Returned   : None
+*   Effects    : None
+*   Returned   : Pointer to calling thread, or NULL if the caller is not an
+*                unbound thread.
 ****************************************************************************/
-void mltp_abort(void)
+static mltp_t *mltp_self(void)
 {
-    mltp_t *old, *mainthread;
     mltp_vp_local_t *mltp_vp_local;
-    volatile int newcount;
+    mltp_t *t;
 
+    /* the VP's current thread is only us until we're preempted */
+    MLTP_PREEMPT_OFF();
     mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+    t = (mltp_vp_local == NULL) ? NULL : mltp_vp_local->vp_curr;
+    MLTP_PREEMPT_ON();
 
-    /* make current thread done and switch to main thread */
-    mainthread = &(mltp_vp_local->vp_main);
-    old = mltp_vp_local->vp_curr;
-    old->state = mltpDone;
-    mltp_vp_local->vp_curr = mainthread;
-    mainthread->state = mltpRunning;
-
-    /* atomically decrement user thread count */
-    newcount = uthreads - 1;
-    while(!mltp_compare_and_swap(uthreads, newcount, &uthreads))
+    if ((t != NULL) && (t->type == MLTP_THREAD_TASK))
     {
-        newcount = uthreads - 1;
+        /* tasks can't be switched out like threads */
+        t = NULL;
     }
 
-    /* abort old thread */
-    QT_ABORT (mltp_aborthelp, old, (void *)NULL, mainthread->sp);
+    return t;
 }
 
 
 /****************************************************************************
-*   Function   : mltp_aborthelp
-*   Description: This function is a helper function which is used for an
-*                abort call.
-*   Parameters : sp - quick threads handle of main thread
-*                old - the thread being aborted
-*                null - unused parameter, needed for QT_ABORT
-*   Effects    : old is deallocated
+*   Function   : mltp_set_quantum
+*   Description: This function sets the time slice unbound threads may run
+*                before they are preempted.  It must not be called while
+*                mltp_start is running.
+*   Parameters : usec - time slice in microseconds, 0 disables preemption
+*   Effects    : VPs started by the next mltp_start will preempt threads
+*                that run for more than usec microseconds.
 *   Returned   : None
 ****************************************************************************/
-static void *mltp_aborthelp(qt_t *sp, void *old, void *null)
+void mltp_set_quantum(long usec)
 {
-    free(((mltp_t *)old)->sto);     /* free stack */
-    free(((mltp_t *)old)->private); /* free private section */
-
-    return NULL;
+    mltp_quantum = (usec > 0) ? usec : 0;
 }
 
 
 /****************************************************************************
-*   Function   : mltp_yield
-*   Description: This function blocks the current thread.
-*   Parameters : None
-*   Effects    : The current running thread is blocked and put at the end of
-*                the queue and next thread is made the current running
-*                thread.
-*   Returned   : None
+*   Function   : mltp_preempt_start
+*   Description: This function installs the preemption signal handler for
+*                the calling VP and creates a timer that sends the signal
+*                to the VP every quantum.  jkthreads VPs are processes that
+*                don't share signal handlers, so each VP installs its own.
+*   Parameters : timer - timer created for this VP
+*   Effects    : VP's running thread is preempted every quantum.
+*   Returned   : Non-zero if a timer was created
 ****************************************************************************/
-void mltp_yield()
+static int mltp_preempt_start(timer_t *timer)
 {
-    mltp_t *old, *mainthread;
-    mltp_vp_local_t *mltp_vp_local;
+    struct sigaction action;
+    struct sigevent event;
+    struct itimerspec spec;
 
-    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+    if (!mltp_quantum)
+    {
+        return 0;
+    }
 
-    /* make current thread done and switch to main thread */
-    mainthread = &(mltp_vp_local->vp_main);
-    old = mltp_vp_local->vp_curr;
-    old->state = mltpBlock;
-    mltp_vp_local->vp_curr = mainthread;
-    mainthread->state = mltpRunning;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = mltp_preempt_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(MLTP_PREEMPT_SIGNAL, &action, NULL);
+
+    /* signal just this VP */
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = MLTP_PREEMPT_SIGNAL;
+#ifdef sigev_notify_thread_id
+    event.sigev_notify_thread_id = getpid();
+#else
+    event._sigev_un._tid = getpid();
+#endif
 
-    /* block old thread */
-    QT_BLOCK(mltp_yieldhelp, old, &mltp_global_runq, mainthread->sp);
-}
+    if (timer_create(CLOCK_MONOTONIC, &event, timer) != 0)
+    {
+        perror("Failed to create VP preemption timer");
+        return 0;
+    }
 
+    spec.it_value.tv_sec = mltp_quantum / 1000000;
+    spec.it_value.tv_nsec = (mltp_quantum % 1000000) * 1000;
+    spec.it_interval = spec.it_value;
+    timer_settime(*timer, 0, &spec, NULL);
 
-/****************************************************************************
-*   Function   : mltp_yieldhelp
-*   Description: This function handles the requeuing and stack save of a
-*                yielding thread.
-*   Parameters : None
-*   Effects    : The yielding thread is placed at the end of the running
-*                queue and its stack pointer is saved.
-*   Returned   : None
-****************************************************************************/
-static void *mltp_yieldhelp(qt_t *sp, void *old, void *blockq)
-{
-  ((mltp_t *)old)->sp = sp;
-  mltp_qput((mltp_q_t *)blockq, (mltp_t *)old);
-  return (old);
+    return 1;
 }
 
 
 /****************************************************************************
-*   Function   : mltp_yield_to_first
-*   Description: This function blocks the current thread putting it at the
-*                front of the queue.
-*   Parameters : None
-*   Effects    : The current running thread is blocked and put at the head
-*                of the queue and next thread is made the current running
-*                thread.
+*   Function   : mltp_preempt_handler
+*   Description: This function is the VP preemption signal handler.  If
+*                the running thread is an unbound thread outside of a
+*                critical section, it is switched out just like a yield.
+*                Otherwise the signal is ignored and the next one will try
+*                again.
+*   Parameters : sig - unused
+*   Effects    : The running unbound thread may be switched out.  It
+*                returns from the handler when it is next run, on whichever
+*                VP picks it up.
 *   Returned   : None
 ****************************************************************************/
-void mltp_yield_to_first()
+static void mltp_preempt_handler(int sig)
 {
     mltp_t *old, *mainthread;
     mltp_vp_local_t *mltp_vp_local;
+    int *nopreempt;
 
+    nopreempt = jkthread_nopreempt();
+
+    if (*nopreempt)
+    {
+        /* scheduler, locks, malloc, or stdio */
+        return;
+    }
+
+    (*nopreempt)++;
     mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
 
-    /* make current thread done and switch to main thread */
+    /* make current thread blocked and switch to main thread */
     mainthread = &(mltp_vp_local->vp_main);
     old = mltp_vp_local->vp_curr;
     old->state = mltpBlock;
     mltp_vp_local->vp_curr = mainthread;
     mainthread->state = mltpRunning;
 
-    /* block old thread */
-    QT_BLOCK(mltp_yield_to_first_help, old, &mltp_global_runq,
-        mainthread->sp);
+    QT_BLOCK(mltp_preempthelp, old, NULL, mainthread->sp);
+    MLTP_PREEMPT_ON();
 }
 
 
 /****************************************************************************
-*   Function   : mltp_yield_to_first_help
+*   Function   : mltp_preempthelp
 *   Description: This function handles the requeuing and stack save of a
-*                yielding thread.
-*   Parameters : None
-*   Effects    : The yielding thread is placed at the head of the running
-*                queue and its stack pointer is saved.
+*                preempted thread.  The VP main thread never returns from
+*                the signal handler, so the signal the kernel blocked for
+*                the handler is unblocked here.
+*   Parameters : sp - quick threads handle of the preempted thread
+*                old - the preempted thread
+*                null - unused parameter, needed for QT_BLOCK
+*   Effects    : The preempted thread is handed back to the scheduling
+*                policy and the VP may be preempted again.
 *   Returned   : None
 ****************************************************************************/
-static void *mltp_yield_to_first_help(qt_t *sp, void *old, void *blockq)
+static void *mltp_preempthelp(qt_t *sp, void *old, void *null)
 {
-  ((mltp_t *)old)->sp = sp;
-  mltp_qput_second((mltp_q_t *)blockq, (mltp_t *)old);
-  return (old);
+    sigset_t set;
+
+    ((mltp_t *)old)->sp = sp;
+    mltp_sched_put((mltp_t *)old, (mltp_t *)old, MLTP_SCHED_YIELD);
+
+    sigemptyset(&set);
+    sigaddset(&set, MLTP_PREEMPT_SIGNAL);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+
+    return (old);
 }
 
 
 /****************************************************************************
-*   Function   : mltp_barrier_init
-*   Description: This function must be called prior to the first use of a
-*                specific barrier.  It insures that the barrier will
-*                function properly when used.
-*   Parameters : barrier - barrier to be initialized
-*   Effects    : zeros out all barrier fields
+*   Function   : mltp_set_yield_quantum
+*   Description: This function sets the time slice after which
+*                mltp_maybe_yield will yield.  It must not be called while
+*                mltp_start is running.
+*   Parameters : usec - time slice in microseconds, 0 makes mltp_maybe_yield
+*                       never yield
+*   Effects    : The next mltp_start will start a ticker process.
 *   Returned   : None
 ****************************************************************************/
-void mltp_barrier_init(mltp_barrier_t *barrier)
+void mltp_set_yield_quantum(long usec)
 {
-    barrier->waiters = 0;
-    barrier->episode = 0;
-    mltp_lock_init(&(barrier->lock), MLTP_LOCK_STD);
+    mltp_yield_quantum = (usec > 0) ? usec : 0;
 }
 
 
 /****************************************************************************
-*   Function   : mltp_barrier
-*   Description: This function provides the functionality of a barrier
-*                primative.  It blocks all threads that enter it, until the
-*                specified number have entered it.
-*   Parameters : barrier - barrier structure to block on
-*                count - number of threads required to enter the barrier
-*                        this episode.
-*   Effects    : Blocks all threads that enter until the specified number
-*                have entered the barrier.  barrier->episode will be
-*                incremented when the last thread enters the barrier.
+*   Function   : mltp_ticker
+*   Description: This function is the entry point for the ticker process.
+*                Every quantum it flags the VPs that have been running the
+*                same thread since the last tick, as long as there is other
+*                work for the VP to do.  There's other work if the VP's
+*                wakeup inbox isn't empty, or if the scheduling policy has
+*                threads the VP could run and no idle VP will take them.
+*   Parameters : unused - unused
+*   Effects    : VP yield flags and mltp_yield_request are set.
 *   Returned   : None
 ****************************************************************************/
-void mltp_barrier(mltp_barrier_t *barrier, unsigned int count)
+static void mltp_ticker(void *unused)
 {
-    int episode;
-
-    /* obtain barrier lock */
-    mltp_lock(&(barrier->lock));    /* may want to make this a spin lock */
-    episode = barrier->episode;
+    mltp_vp_local_t *vp;
+    struct timespec delay;
+    unsigned int slice;
+    int i, count, idle, waiting;
 
-    /* increment number of threads waiting on this barrier */
-    barrier->waiters++;
+    delay.tv_sec = mltp_yield_quantum / 1000000;
+    delay.tv_nsec = (mltp_yield_quantum % 1000000) * 1000;
 
-    if (barrier->waiters == count)
+    while (mltp_ticking)
     {
-        /* this is the last thread required to enter the barrier */
-        /* start new episode */
-        barrier->episode++;
-        barrier->waiters = 0;
+        nanosleep(&delay, NULL);
+        count = mltp_vp_count;
 
-        mltp_unlock(&(barrier->lock));
-    }
-    else
-    {
-        mltp_unlock(&(barrier->lock));
+        /* is anybody looking for work? */
+        idle = 0;
 
-        /* wait until each thread hits the barrier */
-        while (episode == barrier->episode)
+        for (i = 0; i < count; i++)
+        {
+            vp = mltp_vps[i];
+
+            if ((vp != NULL) && vp->alive && vp->idle)
+            {
+                idle = 1;
+                break;
+            }
+        }
+
+        for (i = 0; i < count; i++)
         {
-            mltp_yield();
+            vp = mltp_vps[i];
+
+            if ((vp == NULL) || !vp->alive || vp->idle)
+            {
+                continue;
+            }
+
+            slice = vp->slice;
+
+            /* idle VPs will take queued threads, but not the inbox's */
+            waiting = !mltp_inbox_empty(vp) || (!idle &&
+                ((mltp_sched->waiting == NULL) || mltp_sched->waiting(i)));
+
+            if ((slice == vp->ticker_slice) && waiting &&
+                mltp_atomic_cas(&(vp->yield_flag), 0, 1))
+            {
+                /* quantum is used up */
+                mltp_atomic_fetch_add(&mltp_yield_request, 1, MLTP_RELAXED);
+            }
+
+            vp->ticker_slice = slice;
         }
     }
 }
 
 
 /****************************************************************************
-*   Function   : mltp_cond_init
-*   Description: This function initializes the queues used for conditional
-*                waiting.
-*   Parameters : cond - queue for threads waiting on a condition
-*   Effects    : Head, tail, and next position in the conditional queue all
-*                point to each other, and conditional lock is initialized.
-*   Returned   : None
+*   Function   : mltp_yield_flag_clear
+*   Description: This function clears a VP's yield flag.
+*   Parameters : vp - VP whose flag is being cleared
+*   Effects    : vp's yield flag is cleared and mltp_yield_request is
+*                decremented if the flag was set.
+*   Returned   : Non-zero if the flag was set.
 ****************************************************************************/
-void mltp_cond_init(mltp_cond_t *cond)
+static int mltp_yield_flag_clear(mltp_vp_local_t *vp)
 {
-    mltp_qinit(&(cond->q));
+    if (vp->yield_flag && mltp_atomic_cas(&(vp->yield_flag), 1, 0))
+    {
+        mltp_atomic_fetch_sub(&mltp_yield_request, 1, MLTP_RELAXED);
+        return 1;
+    }
+
+    return 0;
 }
 
 
 /****************************************************************************
-*   Function   : mltp_cond_wait
-*   Description: This function places the currently executing user level
-*                thread in a conditional wait queue where it will stay until
-*                a signal has been provided to the conditional queue.  This
-*                function is only valid when called from an unbound thread.
-*   Parameters : cond - queue for threads waiting on a condition
-*   Effects    : Currently executing user thread is blocked.  The next
-*                runnable thread will take over use of executing VP.
+*   Function   : mltp_quantum_start
+*   Description: This function does the bookkeeping for a VP that is about
+*                to switch to a thread, whether from its main thread or
+*                handed over by mltp_yield_to.
+*   Parameters : vp - VP switching threads
+*                next - thread about to run
+*   Effects    : vp's slice is bumped, its yield flag is cleared, and its
+*                run bounds cover the stack next will run on.
 *   Returned   : None
 ****************************************************************************/
-void mltp_cond_wait(mltp_cond_t *cond)
+static void mltp_quantum_start(mltp_vp_local_t *vp, mltp_t *next)
 {
-    mltp_t *old, *mainthread;
-    mltp_vp_local_t *mltp_vp_local;
-
-    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
-
-    /* make current thread done and switch to main thread */
-    mainthread = &(mltp_vp_local->vp_main);
-    old = mltp_vp_local->vp_curr;
-    old->state = mltpBlock;
-    mltp_vp_local->vp_curr = mainthread;
-    mainthread->state = mltpRunning;
-
-    /* block old thread */
-    QT_BLOCK(mltp_yieldhelp, old, &(cond->q), mainthread->sp);
+    vp->slice++;
+    mltp_run_bounds(vp, next);
+    mltp_yield_flag_clear(vp);
 }
 
 
 /****************************************************************************
-*   Function   : mltp_cond_signal
-*   Description: This function signals that the first user level thread in a
-*                conditional wait queue is runnable.
-*   Parameters : cond - queue for threads waiting on a condition
-*   Effects    : The head of the contional queue will be placed on the
-*                global run queue.
+*   Function   : mltp_run_bounds
+*   Description: This function publishes the stack a VP's thread is running
+*                on, so mltp_maybe_yield_slow can find the VP.  A thread
+*                inside a coroutine runs on the coroutine's stack.
+*   Parameters : vp - VP running t
+*                t - thread running on vp
+*   Effects    : vp's run bounds cover t's current stack.
 *   Returned   : None
 ****************************************************************************/
-void mltp_cond_signal(mltp_cond_t *cond)
+static void mltp_run_bounds(mltp_vp_local_t *vp, mltp_t *t)
 {
-    mltp_t *t;                       /* thread from conditional */
-
-    /* get next thread from conditional queue */
-    t = mltp_qget(&(cond->q));
-
-    if (t != NULL)
+    if (t->coro != NULL)
+    {
+        vp->run_lo = (char *)t->coro->sto;
+        vp->run_hi = (char *)t->coro->sto + MLTP_STKSIZE;
+    }
+    else
     {
-        mltp_qput(&mltp_global_runq, t);
+        vp->run_lo = (char *)t->sto;
+        vp->run_hi = (char *)t->sto + t->stksize;
     }
 }
 
 
 /****************************************************************************
-*   Function   : mltp_cond_broadcast
-*   Description: This function signals that all the user level threads in a
-*                conditional wait queue are runnable.
-*   Parameters : cond - queue for threads waiting on a condition
-*   Effects    : All of the threads in the contional queue will be placed on
-*                the global run queue.
+*   Function   : mltp_maybe_yield_slow
+*   Description: This function is the part of mltp_maybe_yield that runs
+*                when some VP's thread should yield.  It yields if the VP
+*                is the calling thread's.  The VP is only looked up if the
+*                caller is running on the stack of a flagged VP's thread,
+*                so threads on other VPs don't make a system call.
+*   Parameters : None
+*   Effects    : Calling thread may yield.
 *   Returned   : None
 ****************************************************************************/
-void mltp_cond_broadcast(mltp_cond_t *cond)
+void mltp_maybe_yield_slow(void)
 {
-    mltp_t *thread, *tail;                  /* head and tail of cond queue */
+    mltp_vp_local_t *mltp_vp_local, *vp;
+    char here;
+    int i, count, yield;
 
-    /* lock cond and remove all threads */
-    mltp_lock(&(cond->q.lock));             /* aquire the cond lock */
+    count = mltp_vp_count;
+    yield = 0;
 
-    /* head of queue and adjust queue mark queue empty */
-    thread = cond->q.t.next;
-    tail = cond->q.tail;
-    cond->q.t.next = cond->q.tail = &(cond->q.t);
+    for (i = 0; i < count; i++)
+    {
+        vp = mltp_vps[i];
 
-    mltp_unlock(&(cond->q.lock));           /* release the cond lock */
+        if ((vp != NULL) && vp->yield_flag && (&here >= vp->run_lo) &&
+            (&here < vp->run_hi))
+        {
+            yield = 1;
+            break;
+        }
+    }
 
-    /* now put all these threads in the run queue */
-    mltp_lock(&mltp_global_runq.lock);      /* aquire run queue lock */
+    if (!yield)
+    {
+        /* not a flagged VP's thread */
+        return;
+    }
 
-    /* add conditionals to the head of the queue */
-    mltp_global_runq.tail->next = thread;
-    tail->next = &mltp_global_runq.t;
-    mltp_global_runq.tail = tail;
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+    yield = (mltp_vp_local != NULL) && mltp_vp_local->alive &&
+        mltp_yield_flag_clear(mltp_vp_local);
+    MLTP_PREEMPT_ON();
 
-    mltp_unlock(&mltp_global_runq.lock);    /* release run queue lock */
+    if (yield)
+    {
+        mltp_yield();
+    }
 }
@@ -36,8 +36,15 @@
 ***************************************************************************/
 #include "qt/qt.h"
 #include "mltpmd.h"
+#include "mltpatom.h"
 #include "jkthreads/jkcthread.h"
 #include <sched.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
 
 /***************************************************************************
 *                              THREAD TYPES
@@ -45,9 +52,71 @@
 typedef enum
 {
     MLTP_THREAD_UNBOUND,    /* Unbound threads (truely user-level) */
-    MLTP_THREAD_BOUND       /* Threads bound to a process */
+    MLTP_THREAD_BOUND,      /* Threads bound to a process */
+    MLTP_THREAD_TASK        /* Stackless tasks run on the VP main stack */
 } mltp_type_t;
 
+/***************************************************************************
+*                           LOCKS AND BARRIERS
+***************************************************************************/
+
+/* Lock classes.  BLOCK locks may not be used by bound processes. */
+typedef enum
+{
+    MLTP_LOCK_SPIN,
+    MLTP_LOCK_BLOCK,
+    MLTP_LOCK_BLOCK_FRONT,
+    MLTP_LOCK_SEMAPHORE
+} mltp_lock_class_t;
+
+/* Standard lock type */
+#define MLTP_LOCK_STD   MLTP_LOCK_SPIN
+
+typedef struct
+{
+    volatile unsigned int   next_available; /* next number for waiting */
+    volatile unsigned int   now_serving;    /* value required to enter lock */
+    jksem                   *sem;           /* semaphore for semaphore lock */
+    mltp_lock_class_t       lock_class;     /* class of lock */
+
+    /***********************************************************************
+    * NOTE: Blocking locks use the now_serving field to hold lock
+    *       lock availability information.
+    ***********************************************************************/  
+} mltp_lock_t;
+
+/***************************************************************************
+* Statically typed locks.  Their class is fixed by their type, so their
+* uncontended lock and unlock are inline functions (see LOCKING FUNCTIONS)
+* using compiler atomics.  Only waiting is done out of line.
+*
+* mltp_spinlock_t - ticket spin lock, preemption is deferred while held.
+*                   May be used by bound and unbound threads.
+* mltp_mutex_t    - blocking lock, unbound waiters wait on their VP's
+*                   watch list (see mltp_wait_until).
+***************************************************************************/
+typedef struct
+{
+    volatile unsigned int   next_available; /* next ticket handed out */
+    volatile unsigned int   now_serving;    /* ticket holding the lock */
+} mltp_spinlock_t;
+
+typedef struct
+{
+    volatile unsigned int   locked;         /* 1 while held, otherwise 0 */
+} mltp_mutex_t;
+
+#define MLTP_SPINLOCK_INITIALIZER   {0, 0}
+#define MLTP_MUTEX_INITIALIZER      {0}
+
+typedef struct
+{
+    volatile unsigned int   waiters;    /* threads currently waiting */
+    volatile unsigned int   episode;    /* episode of this barrier */
+    mltp_spinlock_t         lock;       /* prevents miscounts */
+} mltp_barrier_t;
+
+
 /***************************************************************************
 *                          THREAD CONTROL TYPES
 ***************************************************************************/
@@ -58,12 +127,41 @@ typedef enum
 * (re)initialization.
 * Queue stuff: next thread in the queue (next).
 ***************************************************************************/
+/* resumes a task, arg was given to mltp_task_init */
+typedef void (mltp_taskf_t)(void *arg);
+
+/***************************************************************************
+* A thread's value for a thread-specific data key.  seq is the key's
+* sequence number when the value was set, so values set for a deleted key
+* aren't seen through a new key reusing its slot.  The values of the first
+* MLTP_KEYS_INLINE keys are kept in the thread descriptor, the rest in a
+* table allocated the first time one is set.
+***************************************************************************/
+#define MLTP_KEYS_MAX       (128)   /* keys that may exist at once */
+#define MLTP_KEYS_INLINE    (4)     /* keys with values in mltp_t */
+
+typedef struct
+{
+    void *value;
+    unsigned int seq;
+} mltp_specific_t;
+
+/***************************************************************************
+* Unbound threads and tasks are given IDs that are unique among the
+* threads that haven't exited.  The low 32 bits select a slot in the ID
+* table, the high bits are the slot's generation, which changes each time
+* the slot is reused.  IDs are always positive, negative IDs are used for
+* VP main threads and queue heads.  Bound threads' IDs are their
+* jkthread IDs.
+***************************************************************************/
+typedef long long mltp_id_t;
+
 typedef struct mltp_t
 {
-    short thrid;            /* Thread Id */
+    mltp_id_t thrid;        /* Thread Id */
     short state;            /* thread state */
     qt_t *sp;               /* QuickThreads handle */
-    void *sto;              /* malloc allocated stack */
+    void *sto;              /* mmap allocated stack */
 
     /***********************************************************************
     * The positions of the fields above matters to ensure that the calls to
@@ -72,8 +170,29 @@ typedef struct mltp_t
     ***********************************************************************/
     mltp_type_t type;       /* bound or unbound thread */
     void *retval;           /* pointer to the user handle */
-    void *private;          /* thread-specific private data area */
+    void *private_data;     /* thread-specific private data area */
+    size_t private_size;    /* bytes of private_data, allocated on use */
     struct mltp_t *next;
+    int priority;           /* used by priority scheduling, larger first */
+    int home_vp;            /* preferred VP or MLTP_VP_ANY */
+    const char *name;       /* name for debugging or NULL, not copied */
+    void *main_func;        /* function the thread was created to run */
+    int stack_profiled;     /* stack was filled with the profiling canary */
+    struct mltp_coro_t *coro;   /* innermost coroutine being run */
+    size_t stksize;             /* usable bytes of stack at sto */
+
+    /* stackless task support */
+    mltp_taskf_t *task_func;    /* called by a VP to run the task */
+    void *task_arg;             /* argument passed to task_func */
+
+    /* join and detach support */
+    volatile int detached;  /* descriptor is freed when the thread exits */
+    struct mltp_t *joiners; /* threads waiting for this thread to exit */
+    mltp_spinlock_t join_lock;  /* protects joiners, detached, exit state */
+
+    /* thread-specific data key values */
+    mltp_specific_t specific[MLTP_KEYS_INLINE];
+    mltp_specific_t *specific_table;    /* keys past MLTP_KEYS_INLINE */
 } mltp_t;
 
 /***************************************************************************
@@ -86,10 +205,151 @@ typedef void *(mltp_userf_t)(void *p0);
 typedef void *(mltp_vuserf_t)(int arg0, ...);
 typedef void (mltp_buserf_t)(void *p0);
 
+/***************************************************************************
+* A coroutine runs on its own stack on behalf of the unbound thread that
+* resumes it.  Switching between the two never involves the scheduler or
+* the VP's main thread.
+***************************************************************************/
+typedef void *(mltp_corof_t)(void *arg);
+
+typedef struct mltp_coro_t
+{
+    qt_t *sp;                   /* QuickThreads handle of coroutine */
+    qt_t *caller;               /* handle of the resumer while running */
+    void *sto;                  /* stack from the stack pool */
+    struct mltp_coro_t *outer;  /* coroutine the resumer was running in */
+    void *value;                /* value passed by last resume or yield */
+    volatile int done;          /* non-zero once main function returns */
+} mltp_coro_t;
+
+/***************************************************************************
+*                           SCHEDULING POLICIES
+*
+* A scheduling policy decides which runnable unbound thread a VP runs
+* next.  The policy owns the run queue(s), the rest of the package only
+* hands it threads through enqueue and asks for them back through dequeue.
+*
+* VP arguments are the ID of the VP making the call, or MLTP_SCHED_NO_VP
+* when the caller isn't running on a VP (the main thread, bound threads,
+* threads created before mltp_start).
+*
+* init     - called by mltp_init_sched to set up the policy's queues.
+* enqueue  - makes the list of threads from first to last (linked through
+*            their next fields) runnable.  why tells the policy how the
+*            threads became runnable.  MLTP_SCHED_YIELD_FIRST is only ever
+*            passed a single thread.
+* dequeue  - returns the next thread vp should run or NULL.
+* steal    - returns a thread queued for another VP or NULL.  It's called
+*            when dequeue comes up empty.  May be NULL.
+* on_block - called when a thread blocks on something other than the run
+*            queue (conditions, joins, futures, channels).  May be NULL.
+* on_wake  - called for each blocked thread as it is made runnable, before
+*            it is passed to enqueue.  May be NULL.
+* tick     - called by a VP each time it regains control from a thread.
+*            May be NULL.
+* waiting  - returns non-zero if threads are queued that vp could run.
+*            It's called by the ticker process without locks, so it's only
+*            a hint.  May be NULL, then threads are assumed to be waiting.
+***************************************************************************/
+#define MLTP_SCHED_NO_VP    (-1)
+
+typedef enum
+{
+    MLTP_SCHED_NEW,         /* thread was just created */
+    MLTP_SCHED_YIELD,       /* thread called mltp_yield */
+    MLTP_SCHED_YIELD_FIRST, /* thread called mltp_yield_to_first */
+    MLTP_SCHED_WAKE         /* thread was blocked and has been woken */
+} mltp_sched_why_t;
+
+typedef struct
+{
+    const char *name;       /* name of policy for reports */
+    void (*init)(void);
+    void (*enqueue)(int vp, mltp_t *first, mltp_t *last,
+                    mltp_sched_why_t why);
+    mltp_t *(*dequeue)(int vp);
+    mltp_t *(*steal)(int vp);
+    void (*on_block)(int vp, mltp_t *t);
+    void (*on_wake)(int vp, mltp_t *t);
+    void (*tick)(int vp);
+    int (*waiting)(int vp);
+} mltp_sched_t;
+
+/***************************************************************************
+* Policies provided by mltp:
+*
+* mltp_sched_fifo     - single global FIFO queue.  This is the default.
+* mltp_sched_lifo     - single global queue where new and woken threads
+*                       run first, while their data is still in cache.
+*                       Yielding threads still go to the end.
+* mltp_sched_priority - a FIFO queue per priority level and a bitmap of
+*                       non-empty levels, so finding the highest priority
+*                       thread takes constant time.  Threads that have
+*                       waited a while are moved up a level (aged) so low
+*                       priority threads aren't starved.
+* mltp_sched_steal    - a FIFO queue per VP.  Threads made runnable by a VP
+*                       go on its own queue, idle VPs steal half of
+*                       another's.  VPs take threads from their queue in
+*                       batches of up to half the queue, so each lock
+*                       acquisition dispatches several threads.  Threads
+*                       in a batch can't be stolen, so while other VPs
+*                       are idle a VP takes one thread at a time, and a VP
+*                       gives its batch back when it regains control and
+*                       finds other VPs idle.  A thread that runs for a
+*                       long time without yielding (see mltp_maybe_yield
+*                       and mltp_set_quantum) still delays the rest of
+*                       its VP's batch.
+*
+* mltp_steal_stats - sets locks to the run queue locks taken by VPs
+*                    dispatching under mltp_sched_steal and runs to the
+*                    threads dispatched, since the policy was selected.
+***************************************************************************/
+extern const mltp_sched_t mltp_sched_fifo;
+extern const mltp_sched_t mltp_sched_lifo;
+extern const mltp_sched_t mltp_sched_priority;
+extern const mltp_sched_t mltp_sched_steal;
+
+extern void mltp_steal_stats(unsigned long *locks, unsigned long *runs);
+
 /***************************************************************************
 *                           VIRTUAL PROCESSORS
 ***************************************************************************/
 
+/***************************************************************************
+* A thread or task waiting for a word to change is parked on its VP's watch
+* list, which the VP checks each time it looks for something to run.  The
+* entry lives with the waiter (on its stack or in its task frame).  Entries
+* with cas set are satisfied when *addr can be swapped from old to set, so
+* the waiter owns the word when it's woken.  Entries without an addr are
+* satisfied once the CLOCK_MONOTONIC time reaches deadline.
+***************************************************************************/
+typedef struct mltp_watch_t
+{
+    mltp_t *thread;                 /* thread or task waiting */
+    volatile unsigned int *addr;    /* word being watched */
+    unsigned int old;               /* satisfied once *addr != old */
+    unsigned int set;               /* value swapped in when cas is set */
+    int cas;                        /* non-zero to swap old for set */
+    int front;                      /* non-zero to run next once satisfied */
+    long long deadline;             /* wake time (nsec) if addr is NULL */
+    struct mltp_watch_t *next;      /* next entry in VP's watch list */
+} mltp_watch_t;
+
+/***************************************************************************
+* The storage of a thread that exited is kept on its VP's zombie list
+* until the VP reclaims it in a batch.  The entry is written over the
+* bottom of the dead thread's stack, so the list needs no memory of its
+* own.
+***************************************************************************/
+typedef struct mltp_zombie_t
+{
+    size_t stksize;                 /* usable bytes of the stack */
+    void *private_data;             /* private section to free */
+    void *specific_table;           /* thread-specific data to free */
+    mltp_t *descriptor;             /* detached thread's descriptor */
+    struct mltp_zombie_t *next;     /* next entry in VP's zombie list */
+} mltp_zombie_t;
+
 /***************************************************************************
 * Data structure local to each virtual processor.  This structure replaces
 * the notion of the current gloabl process, with that of a current local
@@ -100,82 +360,234 @@ typedef struct
     int vp_id;
     mltp_t vp_main;     /* main thread for virtual processor */
     mltp_t *vp_curr;    /* thread currntly executing for virtual processor */
+
+    /***********************************************************************
+    * Wakeup inbox.  Any thread (bound or unbound) may push threads it makes
+    * runnable into a VP's inbox without locking.  Only the owning VP pops
+    * them, moving them to the run queue in batches.  inbox_head is written
+    * by the pushing VPs, so it's padded onto a cache line of its own, away
+    * from the fields the owning VP writes each time it dispatches.
+    ***********************************************************************/
+    char inbox_pad0[MLTP_CACHE_LINE];
+    mltp_t * volatile inbox_head;   /* last thread pushed */
+    char inbox_pad1[MLTP_CACHE_LINE];
+    mltp_t *inbox_tail;             /* next thread to pop */
+    mltp_t inbox_stub;              /* dummy that keeps the inbox linked */
+    volatile int inbox_busy;        /* set while a dead VP's inbox drains */
+    volatile int alive;             /* non-zero while VP dispatches threads */
+
+    /* quantum tracking for mltp_maybe_yield */
+    volatile unsigned int slice;    /* bumped each time a thread is run */
+    unsigned int ticker_slice;      /* slice seen by the ticker last tick */
+    volatile int idle;              /* non-zero if run queue came up empty */
+    volatile int yield_flag;        /* non-zero if running thread should
+                                       yield at its next mltp_maybe_yield */
+    char * volatile run_lo;         /* stack the running thread is on, */
+    char * volatile run_hi;         /* its own or a coroutine's, so
+                                       mltp_maybe_yield can find its VP */
+
+    /***********************************************************************
+    * Threads parked by mltp_wait_until.  The owning VP adds them and checks
+    * them each pass.  Idle VPs check them too, so a waiter isn't stuck
+    * behind a long running thread on its own VP.
+    ***********************************************************************/
+    mltp_watch_t *watch;
+    mltp_spinlock_t watch_lock;     /* held while watch is changed */
+
+    /* thread ID slots handed out and freed by this VP */
+    unsigned int id_next;           /* next unused slot of the VP's block */
+    unsigned int id_end;            /* end of the VP's block */
+    unsigned int id_free;           /* freed slots, linked through table */
+    unsigned int id_nfree;          /* number of slots on id_free */
+
+    /* exited threads whose storage hasn't been reclaimed */
+    mltp_zombie_t *zombies;
+    unsigned int nzombies;
 } mltp_vp_local_t;
 
 
 /***************************************************************************
-*                           LOCKS AND BARRIERS
+*                           QUEUES AND CONDITIONALS
 ***************************************************************************/
 
-/* Lock classes.  BLOCK locks may not be used by bound processes. */
-typedef enum
+/***************************************************************************
+* A queue is a linked list of threads.  The queue head is a designated
+* dummy list element.  The threads in the queue chain themselves, a pointer
+* to the tail is kept in the queue, so the tail may be easily accessed.
+***************************************************************************/
+typedef struct
 {
-    MLTP_LOCK_SPIN,
-    MLTP_LOCK_BLOCK,
-    MLTP_LOCK_BLOCK_FRONT,
-    MLTP_LOCK_SEMAPHORE
-} mltp_lock_class_t;
+    mltp_t t;           /* thread */
+    mltp_t *tail;       /* end of queue */
+    mltp_spinlock_t lock;   /* queue lock */
+} mltp_q_t;
 
-/* Standard lock type. If blocking lock, mltp_qinit must be changed */
-#define MLTP_LOCK_STD   MLTP_LOCK_SPIN
+typedef struct
+{
+    mltp_q_t q;         /* queue to wait on */
+} mltp_cond_t;
 
-/* define if spin locks should do some spinning without bus locking */
-#define IDLE_SPIN
 
+/***************************************************************************
+*                           WAITERS AND FUTURES
+***************************************************************************/
+
+/***************************************************************************
+* A thread that waits on one or more objects at once (futures, channels)
+* links one waiter per object into the objects' waiter lists.  Waiters and
+* the wait they belong to live on the waiting thread's stack, so waiting
+* on up to MLTP_WAIT_INLINE objects never allocates.  Waits on more objects
+* allocate their waiters, so they can't overflow a small stack.  The first
+* object to fire claims the wait, the other objects then skip its waiters.
+* The thread is made runnable once it has been claimed and all of its
+* waiters have been linked.
+***************************************************************************/
 typedef struct
 {
-    volatile unsigned int   next_available; /* next number for waiting */
-    volatile unsigned int   now_serving;    /* value required to enter lock */
-    jksem                   *sem;           /* semaphore for semaphore lock */
-    mltp_lock_class_t       lock_class;     /* class of lock */
+    mltp_t *thread;                 /* thread that is waiting */
+    volatile int claimed;           /* non-zero once wait has been claimed */
+    volatile int fired;             /* index of object that claimed wait */
+    volatile int arrived;           /* claimer and parker arrivals */
+} mltp_wait_t;
 
-    /***********************************************************************
-    * NOTE: Blocking locks use the now_serving field to hold lock
-    *       lock availability information.
-    ***********************************************************************/  
-} mltp_lock_t;
+typedef struct mltp_waiter_t
+{
+    mltp_wait_t *wait;              /* wait this waiter is a part of */
+    int index;                      /* index of object in the wait */
+    int linked;                     /* non-zero while in a waiter list */
+    int status;                     /* result set by object that fired */
+    void *data;                     /* data exchanged with the thread */
+    struct mltp_waiter_t *next;
+    struct mltp_waiter_t *prev;
+} mltp_waiter_t;
+
+#define MLTP_WAIT_INLINE    (8)     /* waiters kept on a waiting stack */
+
+/***************************************************************************
+* A future holds a value that is set once by one thread and may be waited
+* on by any number of threads.  Functions registered with mltp_future_then
+* are continuations.  When the future is set, each continuation is spawned
+* as a task by the setting thread, or by the registering thread if the
+* future has already been set.  Like any task, a continuation must not
+* block or switch threads.
+***************************************************************************/
+typedef void (mltp_contf_t)(void *value, void *arg);
+
+typedef struct mltp_cont_t
+{
+    mltp_t task;                    /* task that runs the continuation */
+    mltp_contf_t *func;             /* continuation function */
+    void *arg;                      /* argument passed to func */
+    void *value;                    /* value of the future */
+    struct mltp_cont_t *next;
+} mltp_cont_t;
 
 typedef struct
 {
-    volatile unsigned int   waiters;    /* threads currently waiting */
-    volatile unsigned int   episode;    /* episode of this barrier */
-    mltp_lock_t             lock;       /* prevents miscounts */
-} mltp_barrier_t;
+    volatile int ready;             /* non-zero once value has been set */
+    void *value;                    /* value of the future */
+    mltp_waiter_t *waiters;         /* threads waiting for the value */
+    mltp_cont_t *conts;             /* continuations waiting for the value */
+    mltp_cont_t *conts_tail;        /* last continuation in conts */
+    mltp_spinlock_t lock;           /* protects everything above */
+} mltp_future_t;
+
 
 
 /***************************************************************************
-*                           QUEUES AND CONDITIONALS
+*                                CHANNELS
 ***************************************************************************/
 
 /***************************************************************************
-* A queue is a linked list of threads.  The queue head is a designated
-* dummy list element.  The threads in the queue chain themselves, a pointer
-* to the tail is kept in the queue, so the tail may be easily accessed.
+* A channel passes fixed size messages between threads in FIFO order.
+* Messages are copied into and out of the channel.  Bounded channels buffer
+* up to capacity messages, senders block when the buffer is full.  A
+* capacity of 0 makes an unbuffered channel, where each send waits for a
+* receiver.  Unbounded channels grow their buffer as needed and never
+* block senders.  Receivers block while a channel is empty.  A message sent
+* while a receiver is waiting is copied straight to the receiver.
 ***************************************************************************/
+#define MLTP_CHAN_UNBOUNDED (-1)    /* capacity of an unbounded channel */
+
 typedef struct
 {
-    mltp_t t;           /* thread */
-    mltp_t *tail;       /* end of queue */
-    mltp_lock_t lock;   /* queue lock */
-} mltp_q_t;
+    int elem_size;                  /* size of a message */
+    int capacity;                   /* maximum number of messages buffered */
+    int size;                       /* number of messages buffer can hold */
+    int count;                      /* number of messages in buffer */
+    int head;                       /* index of oldest message in buffer */
+    char *buffer;                   /* circular message buffer */
+    int closed;                     /* non-zero once channel is closed */
+    mltp_waiter_t *recvq;           /* receivers waiting for a message */
+    mltp_waiter_t *sendq;           /* senders waiting for room */
+    mltp_spinlock_t lock;           /* protects everything above */
+} mltp_chan_t;
 
+typedef enum
+{
+    MLTP_CHAN_SEND,
+    MLTP_CHAN_RECV
+} mltp_chan_op_t;
+
+/* one of the operations a thread selects from */
 typedef struct
 {
-    mltp_q_t q;         /* queue to wait on */
-} mltp_cond_t;
+    mltp_chan_t *chan;              /* channel operated on */
+    mltp_chan_op_t op;              /* send or receive */
+    void *msg;                      /* message sent or buffer received into */
+    int status;                     /* 0 for success, -1 if chan closed */
+} mltp_select_t;
+
+/* a channel operation being performed by a task */
+typedef struct
+{
+    mltp_select_t sel;              /* operation being performed */
+    mltp_waiter_t waiter;           /* links task into channel's queue */
+    mltp_wait_t wait;               /* wait the waiter belongs to */
+} mltp_task_chan_t;
+
+/***************************************************************************
+* MLTP_CHAN_DECLARE declares a channel type named name_chan_t for messages
+* of type `type', along with type checked functions for using it
+* (name_chan_init, name_chan_send, name_chan_recv).
+***************************************************************************/
+#define MLTP_CHAN_DECLARE(name, type)                                       \
+    typedef struct { mltp_chan_t chan; } name##_chan_t;                     \
+    static __inline__ int name##_chan_init(name##_chan_t *ch, int capacity) \
+    { return mltp_chan_init(&(ch->chan), sizeof(type), capacity); }         \
+    static __inline__ int name##_chan_send(name##_chan_t *ch, type msg)     \
+    { return mltp_chan_send(&(ch->chan), &msg); }                           \
+    static __inline__ int name##_chan_recv(name##_chan_t *ch, type *msg)    \
+    { return mltp_chan_recv(&(ch->chan), msg); }
 
 
 /***************************************************************************
 * This macro returns a pointer to the thread-specific data area for the
-* currently executing thread.
+* currently executing thread.  The area is allocated and zeroed the first
+* time it's asked for, threads that never use it don't pay for it.  It's
+* NULL for threads created with a private_size of 0.
 ***************************************************************************/
-#define mltp_get_private() (mltp_vp_local->vp_curr->private)
+#define mltp_get_private()                                                  \
+    ((mltp_vp_local->vp_curr->private_data != NULL) ?                       \
+        mltp_vp_local->vp_curr->private_data :                              \
+        mltp_private_alloc(mltp_vp_local->vp_curr))
+
+extern void *mltp_private_alloc(mltp_t *thread);
 
 /***************************************************************************
 * This macro returns the ID of the currently executing thread.
 ***************************************************************************/
 #define mltp_get_myid() (mltp_vp_local->vp_curr->thrid)
 
+/***************************************************************************
+* mltp_lookup returns the unbound thread or task with ID id, or NULL if it
+* has exited (or id was never handed out).  It takes no locks and is
+* constant time.  An ID is never mistaken for a later thread reusing its
+* slot.  The descriptor returned is only good while the caller knows it
+* hasn't been freed.
+***************************************************************************/
+extern mltp_t *mltp_lookup(mltp_id_t id);
+
 /***************************************************************************
 *                        THREAD CONTROL FUNCTIONS
 ***************************************************************************/
@@ -186,6 +598,23 @@ typedef struct
 ***************************************************************************/
 extern void mltp_init();
 
+/***************************************************************************
+* Same as mltp_init, but threads will be scheduled by the policy passed
+* instead of the default FIFO policy.
+***************************************************************************/
+extern void mltp_init_sched(const mltp_sched_t *sched);
+
+/***************************************************************************
+* Unbound threads are only switched when they block or yield, unless a
+* time slice is set.  With a time slice, a thread that runs for longer than
+* usec microseconds is preempted by a timer signal sent to its VP.
+* Preemption is deferred while the thread holds a spin lock or jkthreads'
+* malloc and stdio locks.  Preempted threads may resume on a different VP,
+* so code must not hang on to the VP's local data (mltp_get_private and
+* mltp_get_myid need a fresh jkthread_getlocal).  Call before mltp_start.
+***************************************************************************/
+extern void mltp_set_quantum(long usec);
+
 /***************************************************************************
 * When one or more threads are created by the main thread, the system goes
 * multithread when this is called.  When this returns, it is done, there
@@ -213,6 +642,137 @@ extern mltp_t *mltp_vcreate(mltp_vuserf_t *func, int nbytes, ...);
 extern mltp_t *mltp_create_bound(mltp_buserf_t *func, void *p0, int stacksz,
                                  mltp_buserf_t *term);
 
+/***************************************************************************
+* mltp_create in two steps, for callers that want to keep data used by the
+* thread at the top of its stack instead of allocating it.
+*
+* mltp_create_reserve - allocates a thread with nbytes (no more than
+*                       MLTP_RESERVE_MAX) set aside at the top of its stack.
+*                       *area is set to the space, aligned to
+*                       MLTP_RESERVE_ALIGN.  Returns NULL if nbytes is too
+*                       large.
+* mltp_create_start   - makes the thread runnable.  The space is valid until
+*                       func returns.
+***************************************************************************/
+#define MLTP_RESERVE_MAX    (1024)
+#define MLTP_RESERVE_ALIGN  (16)
+
+extern mltp_t *mltp_create_reserve(int nbytes, void **area);
+extern void mltp_create_start(mltp_t *thread, mltp_userf_t *func, void *p0);
+
+/***************************************************************************
+* Thread stacks are mapped with a guard page past their end, so overflows
+* fault.  Their pages are only committed as the stack grows into them, so
+* idle threads cost little more than the pages they've touched.
+* mltp_create_sized is mltp_create with a stack of stksize bytes (0 for
+* MLTP_STKSIZE), rounded up as described for mltp_create_attr and at least
+* MLTP_STACK_MIN.
+***************************************************************************/
+#define MLTP_STKSIZE        (0x10000)   /* default stack size, 64Kbytes */
+#define MLTP_STACK_MIN      (0x4000)    /* smallest stack size, 16Kbytes */
+
+extern mltp_t *mltp_create_sized(mltp_userf_t *func, void *p0,
+                                 size_t stksize);
+
+/***************************************************************************
+* mltp_create_attr creates a single parameter thread described by an
+* attribute object.  A NULL attr creates the same thread as mltp_create.
+* mltp_attr_init (or MLTP_ATTR_INITIALIZER) sets the defaults.
+*
+* stksize      - bytes of stack, 0 for MLTP_STKSIZE.  Sizes up to
+*                MLTP_STACK_CLASS_MAX are rounded up to a power of two, so
+*                stacks of each size are pooled and reused separately.
+* private_size - bytes of private data, 0 for none (mltp_get_private
+*                returns NULL).  It isn't allocated until first used.
+* priority     - initial priority, see mltp_set_priority.
+* vp           - VP the thread should run on, or MLTP_VP_ANY.  It's only a
+*                hint.  mltp_sched_steal places the thread on that VP's
+*                queue if it's created while the VP is running, other VPs
+*                may still steal it.  The other policies ignore it.
+* detached     - non-zero creates the thread detached.  The pointer
+*                returned may not be referenced after the thread runs.
+* name         - name shown in debugging output.  It isn't copied.
+***************************************************************************/
+#define MLTP_PRIVATE_SIZE   (1024 * sizeof(void*))
+#define MLTP_STACK_CLASS_MAX    (0x100000)  /* largest pooled stack, 1Mbyte */
+#define MLTP_VP_ANY         (-1)
+
+typedef struct
+{
+    size_t stksize;         /* bytes of stack, 0 for MLTP_STKSIZE */
+    size_t private_size;    /* bytes of private data area */
+    int priority;           /* initial scheduling priority */
+    int vp;                 /* preferred VP or MLTP_VP_ANY */
+    int detached;           /* non-zero to create the thread detached */
+    const char *name;       /* name for debugging or NULL */
+} mltp_attr_t;
+
+#define MLTP_ATTR_INITIALIZER \
+    {0, MLTP_PRIVATE_SIZE, 0, MLTP_VP_ANY, 0, NULL}
+
+extern void mltp_attr_init(mltp_attr_t *attr);
+extern mltp_t *mltp_create_attr(const mltp_attr_t *attr, mltp_userf_t *func,
+                                void *p0);
+
+/***************************************************************************
+* mltp_create_n creates n threads running func, as if by n calls to
+* mltp_create, where thread i is passed args[i] (or NULL if args is NULL)
+* and is returned in out[i].  The stacks and run queue insertions are
+* done in batches, so creating many threads this way is cheaper.  IDs are
+* still handed out one thread at a time.
+* Returns 0 for success, -1 if n is less than 1.
+***************************************************************************/
+extern int mltp_create_n(int n, mltp_userf_t *func, void **args,
+                         mltp_t **out);
+
+/***************************************************************************
+* Thread-specific data keys give each unbound thread its own value for a
+* key, like pthread keys.  Values start out NULL.  When a thread exits,
+* the destructor of each key it has a non-NULL value for is called with
+* the value, repeating up to MLTP_KEY_ITERATIONS times while destructors
+* set new values.
+*
+* mltp_key_create  - creates a key with an optional destructor.  Returns 0
+*                    for success, -1 if MLTP_KEYS_MAX keys exist.
+* mltp_key_delete  - deletes a key.  Destructors aren't called for its
+*                    values.  Returns 0 for success, -1 for a bad key.
+* mltp_getspecific - returns the calling thread's value for key.
+* mltp_setspecific - sets the calling thread's value for key.  Returns 0
+*                    for success, -1 for a bad key or if the caller isn't
+*                    an unbound thread.
+***************************************************************************/
+#define MLTP_KEY_ITERATIONS (4)
+
+typedef unsigned int mltp_key_t;
+typedef void (mltp_key_destructor_t)(void *value);
+
+extern int mltp_key_create(mltp_key_t *key, mltp_key_destructor_t *destructor);
+extern int mltp_key_delete(mltp_key_t key);
+extern void *mltp_getspecific(mltp_key_t key);
+extern int mltp_setspecific(mltp_key_t key, const void *value);
+
+/***************************************************************************
+* Stack profiling measures how deep threads' stacks actually go, so they
+* can be given smaller stacks.  While profiling is on, the stack of each
+* unbound thread created is filled with a canary pattern.  When the thread
+* exits, its stack is scanned for the deepest word that was overwritten,
+* and the depth is added to a histogram kept for the thread's main
+* function.  Filling commits every page of the stack, so profiling is for
+* test runs only.
+*
+* mltp_set_stack_profile - turns profiling on (clearing the histograms) or
+*                          off.  Only threads created while it's on are
+*                          measured.
+* mltp_stack_used        - returns the most bytes of stack thread has used
+*                          so far, or 0 if it isn't being profiled.
+* mltp_stack_report      - writes each main function's histogram of stack
+*                          size classes used to stdout, with the class
+*                          recommended for its threads.
+***************************************************************************/
+extern void mltp_set_stack_profile(int on);
+extern size_t mltp_stack_used(mltp_t *thread);
+extern void mltp_stack_report(void);
+
 /***************************************************************************
 * Join bound threads with current point of execution.
 * NOTE: If join is attempted by an unbound thread the whole virtual process
@@ -224,6 +784,25 @@ extern mltp_t *mltp_create_bound(mltp_buserf_t *func, void *p0, int stacksz,
 ***************************************************************************/
 extern void mltp_join_bound(mltp_t thread);
 
+/***************************************************************************
+* Join unbound threads with current point of execution.
+*
+* mltp_join   - waits for an unbound thread to exit and stores its return
+*               value in retval (if retval is not NULL).  Unbound callers
+*               are parked on the thread's completion queue, other callers
+*               (the main thread, bound threads) yield their process until
+*               the thread exits.  The thread's descriptor is not freed,
+*               the caller still owns it.  Returns 0 on success, -1 if the
+*               thread can't be joined (it's bound, detached, or the caller).
+* mltp_detach - marks an unbound thread as detached.  A detached thread's
+*               descriptor is freed as soon as it exits, so it may not be
+*               joined or referenced afterwards.  Detaching a thread that
+*               has already exited frees its descriptor immediately.
+*               Returns 0 on success, -1 for threads that can't be detached.
+***************************************************************************/
+extern int mltp_join(mltp_t *thread, void **retval);
+extern int mltp_detach(mltp_t *thread);
+
 
 /***************************************************************************
 * The current thread stops running but stays runable.  It is an error to
@@ -239,6 +818,53 @@ extern void mltp_yield(void);
 ***************************************************************************/
 extern void mltp_yield_to_first(void);
 
+/***************************************************************************
+* The current thread hands its VP straight to thread, which must have just
+* been made runnable by a thread on the same VP (by a signal, channel
+* operation, or future).  The current thread stays runnable.  Returns 0 if
+* thread ran, or -1 if thread wasn't waiting to run on the caller's VP and
+* the caller kept running.
+***************************************************************************/
+extern int mltp_yield_to(mltp_t *thread);
+
+/***************************************************************************
+* Cooperative preemption points.  mltp_maybe_yield costs a load and compare
+* until a VP's running thread has used up its quantum while other threads
+* are waiting to run.  Then it yields.  Quanta are tracked by a ticker
+* process started by mltp_start when mltp_set_yield_quantum has been
+* called with a non-zero value.  mltp_yield_request is the number of VPs
+* whose threads should yield, it is only written by mltp.  While it's
+* non-zero, threads on other VPs compare their stack with the stacks of
+* the flagged VPs' threads, which doesn't need a system call.
+***************************************************************************/
+extern volatile int mltp_yield_request;
+extern void mltp_set_yield_quantum(long usec);
+extern void mltp_maybe_yield_slow(void);
+
+#define mltp_maybe_yield() \
+    do { if (mltp_yield_request) { mltp_maybe_yield_slow(); } } while (0)
+
+/***************************************************************************
+* The current thread waits until *addr no longer holds old.  Unbound
+* threads are parked on their VP's watch list, which the VP checks each
+* time it looks for a thread to run, so waiting costs no context switches
+* until the value changes.  Other callers spin with sched_yield.
+***************************************************************************/
+extern void mltp_wait_until(volatile unsigned int *addr, unsigned int old);
+
+/***************************************************************************
+* Thread priorities are used by mltp_sched_priority, larger values are run
+* first.  Threads start with priority 0.  A new priority takes effect the
+* next time the thread is made runnable.  Priorities are clamped to the
+* range MLTP_PRIO_MIN to MLTP_PRIO_MAX.
+***************************************************************************/
+#define MLTP_PRIO_LEVELS    32      /* one bit per level in a long */
+#define MLTP_PRIO_MAX       15
+#define MLTP_PRIO_MIN       (MLTP_PRIO_MAX - MLTP_PRIO_LEVELS + 1)
+
+extern void mltp_set_priority(mltp_t *thread, int priority);
+#define mltp_get_priority(thread)   ((thread)->priority)
+
 /***************************************************************************
 * Like mltp_yield but the thread is discarded.  Any intermediate state is
 * lost.  The thread can also terminate by simply returning.
@@ -258,7 +884,7 @@ extern void mltp_abort(void);
 *
 * NOTE: Only spin locks may be used with bound processes.
 ***************************************************************************/
-extern void mltp_lock_init(mltp_lock_t *lock, mltp_lock_class_t class);
+extern void mltp_lock_init(mltp_lock_t *lock, mltp_lock_class_t lock_class);
 
 /***************************************************************************
 * The class of the lock passed as a parameter will determine the behavior
@@ -280,6 +906,119 @@ extern void mltp_lock(mltp_lock_t *lock);
 ***************************************************************************/
 extern void mltp_unlock(mltp_lock_t *lock);
 
+/***************************************************************************
+* mltp_trylock gets a lock if it can without waiting.  It returns non-zero
+* if the lock was obtained.
+***************************************************************************/
+extern int mltp_trylock(mltp_lock_t *lock);
+
+/***************************************************************************
+* Class specific lock functions.  mltp_lock and mltp_unlock pick one of
+* these by the lock's class, callers that know the class may call them
+* directly.  Block functions work for both MLTP_LOCK_BLOCK classes.
+***************************************************************************/
+extern void mltp_spin_lock(mltp_lock_t *lock);
+extern void mltp_spin_unlock(mltp_lock_t *lock);
+extern void mltp_block_lock(mltp_lock_t *lock);
+extern void mltp_block_unlock(mltp_lock_t *lock);
+extern void mltp_sem_lock(mltp_lock_t *lock);
+extern void mltp_sem_unlock(mltp_lock_t *lock);
+
+/***************************************************************************
+* Preemption is deferred while the VP's count is non-zero.  The count is
+* kept by jkthreads so its malloc and stdio locks can raise it too.  A VP's
+* main thread always runs with the count raised, so threads switching to
+* it raise the count and threads switched to by it lower the count.
+* mltp_quantum is the preemption quantum (usec), 0 if preemption is off.
+* It is only written by mltp.
+***************************************************************************/
+extern volatile long mltp_quantum;
+
+#define MLTP_PREEMPT_OFF() \
+    do { if (mltp_quantum) { (*jkthread_nopreempt())++; } } while (0)
+#define MLTP_PREEMPT_ON() \
+    do { if (mltp_quantum) { (*jkthread_nopreempt())--; } } while (0)
+
+/***************************************************************************
+* Statically typed lock functions.  The _init functions may be replaced by
+* the matching static initializer.  The _wait functions are the out of line
+* slow paths, they are only called by the inline functions below.
+*
+* mltp_spinlock_trylock and mltp_mutex_trylock return non-zero if the lock
+* was obtained.  A spin lock is only obtained by trylock when no other
+* thread holds or is waiting for a ticket.
+***************************************************************************/
+extern void mltp_spinlock_wait(mltp_spinlock_t *lock, unsigned int ticket);
+extern void mltp_mutex_wait(mltp_mutex_t *mutex);
+
+static __inline__ void mltp_spinlock_init(mltp_spinlock_t *lock)
+{
+    lock->next_available = 0;
+    lock->now_serving = 0;
+}
+
+static __inline__ void mltp_spinlock_lock(mltp_spinlock_t *lock)
+{
+    unsigned int ticket;
+
+    /* a preempted holder would leave everyone else spinning */
+    MLTP_PREEMPT_OFF();
+    ticket = mltp_atomic_fetch_add(&(lock->next_available), 1, MLTP_RELAXED);
+
+    if (mltp_atomic_load_acquire(&(lock->now_serving)) != ticket)
+    {
+        mltp_spinlock_wait(lock, ticket);
+    }
+}
+
+static __inline__ int mltp_spinlock_trylock(mltp_spinlock_t *lock)
+{
+    unsigned int ticket;
+
+    MLTP_PREEMPT_OFF();
+    ticket = mltp_atomic_load(&(lock->now_serving), MLTP_RELAXED);
+
+    /* take the next ticket only if it will be served right away */
+    if (mltp_atomic_cas_acquire(&(lock->next_available), ticket, ticket + 1))
+    {
+        return 1;
+    }
+
+    MLTP_PREEMPT_ON();
+    return 0;
+}
+
+static __inline__ void mltp_spinlock_unlock(mltp_spinlock_t *lock)
+{
+    /* only the holder writes now_serving */
+    mltp_atomic_store_release(&(lock->now_serving), lock->now_serving + 1);
+    MLTP_PREEMPT_ON();
+}
+
+static __inline__ void mltp_mutex_init(mltp_mutex_t *mutex)
+{
+    mutex->locked = 0;
+}
+
+static __inline__ int mltp_mutex_trylock(mltp_mutex_t *mutex)
+{
+    return mltp_atomic_cas_acquire(&(mutex->locked), 0, 1);
+}
+
+static __inline__ void mltp_mutex_lock(mltp_mutex_t *mutex)
+{
+    if (!mltp_mutex_trylock(mutex))
+    {
+        mltp_mutex_wait(mutex);
+    }
+}
+
+static __inline__ void mltp_mutex_unlock(mltp_mutex_t *mutex)
+{
+    /* waiters watch locked, so there's no one to wake */
+    mltp_atomic_store_release(&(mutex->locked), 0);
+}
+
 /***************************************************************************
 *                            BARRIER FUNCTIONS
 ***************************************************************************/
@@ -303,11 +1042,167 @@ extern void mltp_barrier(mltp_barrier_t *barrier, unsigned int count);
 /***************************************************************************
 * The functions below support conditional waiting.  Only unbound threads may
 * wait on a conditional event, however both bound and unbound threads may
-* signal or broadcast waiting threads.
+* signal or broadcast waiting threads.  Signalled threads are pushed into
+* a VP's wakeup inbox, so signalling never takes the run queue lock.
 ***************************************************************************/
 extern void mltp_cond_init(mltp_cond_t *cond);
 extern void mltp_cond_wait(mltp_cond_t *cond);
 extern void mltp_cond_signal(mltp_cond_t *cond);
 extern void mltp_cond_broadcast(mltp_cond_t *cond);
 
+/***************************************************************************
+*                           COROUTINE FUNCTIONS
+***************************************************************************/
+
+/***************************************************************************
+* mltp_coro_create  - creates a coroutine that will run func(arg).  Its
+*                     stack comes from the same pool as thread stacks.
+* mltp_coro_destroy - frees a coroutine.  A coroutine that hasn't finished
+*                     is discarded wherever it last yielded.
+* mltp_coro_resume  - runs a coroutine until it yields or returns, and
+*                     returns the value it yielded or returned.  value is
+*                     returned by the mltp_coro_yield that suspended it.
+*                     Only unbound threads may resume coroutines.
+* mltp_coro_yield   - suspends the coroutine the calling thread is running
+*                     in.  value is returned by the mltp_coro_resume that
+*                     ran it.  Returns NULL, and does nothing else, when
+*                     not called from inside a coroutine.
+* mltp_coro_done    - non-zero once the coroutine's main function has
+*                     returned.
+*
+* A coroutine may be resumed by a different thread than the one it last
+* yielded to, but never by two threads at once.
+***************************************************************************/
+extern mltp_coro_t *mltp_coro_create(mltp_corof_t *func, void *arg);
+extern void mltp_coro_destroy(mltp_coro_t *coro);
+extern void *mltp_coro_resume(mltp_coro_t *coro, void *value);
+extern void *mltp_coro_yield(void *value);
+#define mltp_coro_done(coro)    ((coro)->done)
+
+/***************************************************************************
+*                              TASK FUNCTIONS
+***************************************************************************/
+
+/***************************************************************************
+* Tasks are stackless units of work scheduled along with unbound threads.
+* A task is an mltp_t of type MLTP_THREAD_TASK embedded in something that
+* knows how to resume itself (the frame of a C++ coroutine for example).
+* VPs run tasks by calling task_func on their main stack, which must return
+* once the task has to wait.  Tasks must not call functions that switch
+* threads (mltp_yield, mltp_cond_wait, ...).  They wait with the functions
+* below, which are called after the task has saved its state:
+*
+* mltp_task_init       - initializes task so that running it calls
+*                        func(arg).  The task counts as a user thread until
+*                        mltp_task_done is called.
+* mltp_task_spawn      - makes a new task runnable.
+* mltp_task_done       - task has finished and won't be run again.
+* mltp_task_yield      - puts a running task back on the run queue.
+* mltp_task_wait_until - parks task on the VP's watch list until *addr
+*                        != old.  w must stay valid until task is woken.
+* mltp_task_lock       - gets lock for task.  Blocking locks park task on
+*                        the VP's watch list until it owns the lock, other
+*                        classes are obtained right away.
+* mltp_task_sleep      - parks task on the VP's watch list for usec
+*                        microseconds.
+* mltp_task_cond_wait  - parks task on a conditional's queue.
+* mltp_task_chan       - performs a channel operation for task, parking it
+*                        on the channel if the operation has to wait.  The
+*                        result is in op->waiter.status once task runs.
+*
+* The functions that may park return 0 if the task may keep running and
+* non-zero if it has been parked and will be run again when it's woken.
+***************************************************************************/
+extern void mltp_task_init(mltp_t *task, mltp_taskf_t *func, void *arg);
+extern void mltp_task_spawn(mltp_t *task);
+extern void mltp_task_done(mltp_t *task);
+extern void mltp_task_yield(mltp_t *task);
+extern int mltp_task_wait_until(mltp_t *task, mltp_watch_t *w,
+                                volatile unsigned int *addr, unsigned int old);
+extern int mltp_task_lock(mltp_t *task, mltp_watch_t *w, mltp_lock_t *lock);
+extern int mltp_task_sleep(mltp_t *task, mltp_watch_t *w, long usec);
+extern int mltp_task_cond_wait(mltp_t *task, mltp_cond_t *cond);
+extern int mltp_task_chan(mltp_t *task, mltp_task_chan_t *op);
+
+/***************************************************************************
+*                            FUTURE FUNCTIONS
+***************************************************************************/
+
+/***************************************************************************
+* mltp_future_init      - initializes a future.  It must be called prior to
+*                         using a future.
+* mltp_future_set       - sets the value of a future, making all threads
+*                         waiting on it runnable and spawning its
+*                         continuations.  Returns 0 for success and -1 if
+*                         the future has already been set.
+* mltp_future_get       - waits for a future to be set and returns its
+*                         value.  Unbound threads are parked on the future,
+*                         other callers yield their process until it is set.
+* mltp_future_ready     - returns non-zero if the future has been set.
+* mltp_future_then      - registers a continuation that is called with the
+*                         value of the future and arg once it is set.
+*                         Continuations are spawned in the order they were
+*                         registered.  Under mltp_sched_steal they go on
+*                         the spawning VP's run queue, but other VPs may
+*                         steal them and run them at the same time.
+* mltp_future_when_all  - waits until all n futures have been set.
+* mltp_future_when_any  - waits until at least one of n futures has been set
+*                         and returns the index of a future that is set.
+*                         Returns -1 without waiting if n < 1.
+*
+* Unbound threads waiting on futures are parked, other waiters yield their
+* process until the futures are set.  Any thread may set a future.
+***************************************************************************/
+extern void mltp_future_init(mltp_future_t *future);
+extern int mltp_future_set(mltp_future_t *future, void *value);
+extern void *mltp_future_get(mltp_future_t *future);
+#define mltp_future_ready(future)   ((future)->ready)
+extern void mltp_future_then(mltp_future_t *future, mltp_contf_t *func,
+                             void *arg);
+extern void mltp_future_when_all(mltp_future_t **futures, int n);
+extern int mltp_future_when_any(mltp_future_t **futures, int n);
+
+/***************************************************************************
+*                            CHANNEL FUNCTIONS
+***************************************************************************/
+
+/***************************************************************************
+* mltp_chan_init    - initializes a channel for messages of elem_size bytes
+*                     holding up to capacity messages (0 for unbuffered,
+*                     MLTP_CHAN_UNBOUNDED for unbounded).  It must be called
+*                     prior to using a channel.  Returns 0 for success.
+* mltp_chan_destroy - frees a channel's buffer.  No threads may be using
+*                     the channel.
+* mltp_chan_close   - closes a channel.  Threads waiting to send are
+*                     released with an error, messages already buffered
+*                     may still be received.
+* mltp_chan_send    - sends a message, waiting for room if necessary.
+* mltp_chan_recv    - receives a message, waiting for one if necessary.
+* mltp_chan_trysend - sends a message if it can be done without waiting.
+* mltp_chan_tryrecv - receives a message if it can be done without waiting.
+* mltp_select       - performs one of n channel operations, waiting until
+*                     one of them can be done if block is non-zero.
+*
+* Send and receive return 0 for success and -1 if the channel is closed,
+* the try versions return 1 if they would have had to wait.  mltp_select
+* returns the index of the operation performed and sets its status, or -1
+* if block is zero and no operation could be performed without waiting.
+* mltp_select also returns -1 if n < 1.  Selects on more than
+* MLTP_WAIT_INLINE operations allocate their waiters.
+* Unbound threads waiting on channels are parked, other waiters yield their
+* process until the operation can be performed.
+***************************************************************************/
+extern int mltp_chan_init(mltp_chan_t *chan, int elem_size, int capacity);
+extern void mltp_chan_destroy(mltp_chan_t *chan);
+extern void mltp_chan_close(mltp_chan_t *chan);
+extern int mltp_chan_send(mltp_chan_t *chan, const void *msg);
+extern int mltp_chan_recv(mltp_chan_t *chan, void *msg);
+extern int mltp_chan_trysend(mltp_chan_t *chan, const void *msg);
+extern int mltp_chan_tryrecv(mltp_chan_t *chan, void *msg);
+extern int mltp_select(mltp_select_t *cases, int n, int block);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _MLTP_H */
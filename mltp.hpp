@@ -0,0 +1,411 @@
+/***************************************************************************
+*                        C++ Wrapper for MLTP Threads
+*
+*   File    : mltp.hpp
+*   Purpose : Header only C++ interface to mltp threads and locks.  Spawns
+*             lambdas without allocating, and wraps locks in RAII guards.
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+*   $Id:$
+****************************************************************************
+*
+* MLTP: Multi-Layer thread package for SMP Linux
+* Copyright (C) 2000 by Michael Dipperstein (mdipper@cs.ucsb.edu)
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+***************************************************************************/
+
+#ifndef MLTP_HPP
+#define MLTP_HPP
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "mltp.h"
+
+namespace mltp
+{
+
+/***************************************************************************
+*                                 LOCKS
+***************************************************************************/
+
+/***************************************************************************
+* lock_ops<C> calls the class specific lock functions for lock class C,
+* so locks whose class is known at compile time skip the switch in
+* mltp_lock and mltp_unlock.
+***************************************************************************/
+template <mltp_lock_class_t C>
+struct lock_ops;
+
+template <>
+struct lock_ops<MLTP_LOCK_SPIN>
+{
+    static void lock(mltp_lock_t *l) { mltp_spin_lock(l); }
+    static void unlock(mltp_lock_t *l) { mltp_spin_unlock(l); }
+};
+
+template <>
+struct lock_ops<MLTP_LOCK_BLOCK>
+{
+    static void lock(mltp_lock_t *l) { mltp_block_lock(l); }
+    static void unlock(mltp_lock_t *l) { mltp_block_unlock(l); }
+};
+
+template <>
+struct lock_ops<MLTP_LOCK_BLOCK_FRONT>
+{
+    static void lock(mltp_lock_t *l) { mltp_block_lock(l); }
+    static void unlock(mltp_lock_t *l) { mltp_block_unlock(l); }
+};
+
+template <>
+struct lock_ops<MLTP_LOCK_SEMAPHORE>
+{
+    static void lock(mltp_lock_t *l) { mltp_sem_lock(l); }
+    static void unlock(mltp_lock_t *l) { mltp_sem_unlock(l); }
+};
+
+/***************************************************************************
+* A lock of class C.  It meets the C++ Lockable requirements, so it may
+* also be used with std::lock_guard and std::unique_lock.
+* native_handle returns the mltp_lock_t for use with C functions.
+***************************************************************************/
+template <mltp_lock_class_t C>
+class basic_lock
+{
+public:
+    basic_lock() noexcept { mltp_lock_init(&l, C); }
+
+    basic_lock(const basic_lock &) = delete;
+    basic_lock &operator=(const basic_lock &) = delete;
+
+    void lock() { lock_ops<C>::lock(&l); }
+    void unlock() { lock_ops<C>::unlock(&l); }
+    bool try_lock() { return (mltp_trylock(&l) != 0); }
+
+    mltp_lock_t *native_handle() noexcept { return &l; }
+
+private:
+    mltp_lock_t l;
+};
+
+typedef basic_lock<MLTP_LOCK_SPIN> spin_lock;
+typedef basic_lock<MLTP_LOCK_BLOCK> block_lock;
+typedef basic_lock<MLTP_LOCK_BLOCK_FRONT> block_front_lock;
+typedef basic_lock<MLTP_LOCK_SEMAPHORE> sem_lock;
+
+/***************************************************************************
+* lockable_traits lets the guards below take plain mltp_lock_t,
+* mltp_spinlock_t, and mltp_mutex_t locks as well as anything with lock,
+* unlock, and try_lock members.  The class of a plain mltp_lock_t is only
+* known at run time.
+***************************************************************************/
+template <class L>
+struct lockable_traits
+{
+    static void lock(L &l) { l.lock(); }
+    static void unlock(L &l) { l.unlock(); }
+    static bool try_lock(L &l) { return l.try_lock(); }
+};
+
+template <>
+struct lockable_traits<mltp_lock_t>
+{
+    static void lock(mltp_lock_t &l) { mltp_lock(&l); }
+    static void unlock(mltp_lock_t &l) { mltp_unlock(&l); }
+    static bool try_lock(mltp_lock_t &l) { return (mltp_trylock(&l) != 0); }
+};
+
+template <>
+struct lockable_traits<mltp_spinlock_t>
+{
+    static void lock(mltp_spinlock_t &l) { mltp_spinlock_lock(&l); }
+    static void unlock(mltp_spinlock_t &l) { mltp_spinlock_unlock(&l); }
+    static bool try_lock(mltp_spinlock_t &l)
+    {
+        return (mltp_spinlock_trylock(&l) != 0);
+    }
+};
+
+template <>
+struct lockable_traits<mltp_mutex_t>
+{
+    static void lock(mltp_mutex_t &l) { mltp_mutex_lock(&l); }
+    static void unlock(mltp_mutex_t &l) { mltp_mutex_unlock(&l); }
+    static bool try_lock(mltp_mutex_t &l)
+    {
+        return (mltp_mutex_trylock(&l) != 0);
+    }
+};
+
+/* holds a lock for the life of the guard */
+template <class L = mltp_lock_t>
+class lock_guard
+{
+public:
+    explicit lock_guard(L &lock) : l(lock) { lockable_traits<L>::lock(l); }
+    lock_guard(L &lock, std::adopt_lock_t) noexcept : l(lock) {}
+    ~lock_guard() { lockable_traits<L>::unlock(l); }
+
+    lock_guard(const lock_guard &) = delete;
+    lock_guard &operator=(const lock_guard &) = delete;
+
+private:
+    L &l;
+};
+
+/* a movable lock owner that may give up and take back its lock */
+template <class L = mltp_lock_t>
+class unique_lock
+{
+public:
+    unique_lock() noexcept : l(nullptr), owns(false) {}
+
+    explicit unique_lock(L &lock) : l(&lock), owns(false)
+    {
+        this->lock();
+    }
+
+    unique_lock(L &lock, std::defer_lock_t) noexcept : l(&lock), owns(false)
+    {
+    }
+
+    unique_lock(L &lock, std::try_to_lock_t) : l(&lock), owns(false)
+    {
+        try_lock();
+    }
+
+    unique_lock(L &lock, std::adopt_lock_t) noexcept : l(&lock), owns(true)
+    {
+    }
+
+    unique_lock(unique_lock &&other) noexcept :
+        l(std::exchange(other.l, nullptr)),
+        owns(std::exchange(other.owns, false))
+    {
+    }
+
+    unique_lock &operator=(unique_lock &&other) noexcept
+    {
+        if (owns)
+        {
+            lockable_traits<L>::unlock(*l);
+        }
+
+        l = std::exchange(other.l, nullptr);
+        owns = std::exchange(other.owns, false);
+        return *this;
+    }
+
+    unique_lock(const unique_lock &) = delete;
+    unique_lock &operator=(const unique_lock &) = delete;
+
+    ~unique_lock()
+    {
+        if (owns)
+        {
+            lockable_traits<L>::unlock(*l);
+        }
+    }
+
+    void lock()
+    {
+        lockable_traits<L>::lock(*l);
+        owns = true;
+    }
+
+    bool try_lock()
+    {
+        owns = lockable_traits<L>::try_lock(*l);
+        return owns;
+    }
+
+    void unlock()
+    {
+        lockable_traits<L>::unlock(*l);
+        owns = false;
+    }
+
+    /* stops managing the lock without unlocking it */
+    L *release() noexcept
+    {
+        owns = false;
+        return std::exchange(l, nullptr);
+    }
+
+    bool owns_lock() const noexcept { return owns; }
+    explicit operator bool() const noexcept { return owns; }
+    L *mutex() const noexcept { return l; }
+
+private:
+    L *l;
+    bool owns;
+};
+
+/***************************************************************************
+*                                THREADS
+***************************************************************************/
+
+/***************************************************************************
+* A move-only handle for an unbound thread.  Like std::thread, a handle
+* that is still joinable when it's destroyed terminates the program.
+* join waits for the thread, frees its descriptor, and returns the value
+* its function returned.  detach lets the thread free its own descriptor
+* when it exits.
+***************************************************************************/
+class thread
+{
+public:
+    thread() noexcept : t(nullptr) {}
+    explicit thread(mltp_t *handle) noexcept : t(handle) {}
+
+    thread(thread &&other) noexcept : t(std::exchange(other.t, nullptr)) {}
+
+    thread &operator=(thread &&other) noexcept
+    {
+        if (joinable())
+        {
+            std::terminate();
+        }
+
+        t = std::exchange(other.t, nullptr);
+        return *this;
+    }
+
+    thread(const thread &) = delete;
+    thread &operator=(const thread &) = delete;
+
+    ~thread()
+    {
+        if (joinable())
+        {
+            std::terminate();
+        }
+    }
+
+    bool joinable() const noexcept { return (t != nullptr); }
+
+    void *join()
+    {
+        void *retval = nullptr;
+
+        if (mltp_join(t, &retval) == 0)
+        {
+            std::free(t);
+        }
+
+        t = nullptr;
+        return retval;
+    }
+
+    void detach()
+    {
+        mltp_detach(t);
+        t = nullptr;
+    }
+
+    mltp_t *native_handle() const noexcept { return t; }
+
+private:
+    mltp_t *t;
+};
+
+namespace detail
+{
+
+/* calls a closure, its result must be void or convertible to void * */
+template <class F>
+void *invoke(F &f)
+{
+    if constexpr (std::is_void_v<std::invoke_result_t<F &>>)
+    {
+        f();
+        return nullptr;
+    }
+    else
+    {
+        static_assert(std::is_convertible_v<std::invoke_result_t<F &>, void *>,
+            "mltp::spawn closures must return void or a pointer");
+        return f();
+    }
+}
+
+/* thread function for closures kept on the thread's stack */
+template <class F>
+void *inline_main(void *p) noexcept
+{
+    F *f = static_cast<F *>(p);
+    void *retval = invoke(*f);
+
+    f->~F();
+    return retval;
+}
+
+/* thread function for closures too large for the reserved stack area */
+template <class F>
+void *heap_main(void *p) noexcept
+{
+    F *f = static_cast<F *>(p);
+    void *retval = invoke(*f);
+
+    delete f;
+    return retval;
+}
+
+}   /* namespace detail */
+
+/***************************************************************************
+* spawn creates an unbound thread that runs f().  Closures up to
+* MLTP_RESERVE_MAX bytes are moved to the top of the new thread's stack,
+* larger ones are allocated.  f must return void or a pointer, which join
+* returns.  Exceptions escaping f terminate the program.
+***************************************************************************/
+template <class F,
+          std::enable_if_t<std::is_invocable_v<std::decay_t<F> &>, int> = 0>
+thread spawn(F &&f)
+{
+    typedef std::decay_t<F> closure_t;
+
+    if constexpr ((sizeof(closure_t) <= MLTP_RESERVE_MAX) &&
+                  (alignof(closure_t) <= MLTP_RESERVE_ALIGN))
+    {
+        void *area;
+        mltp_t *t;
+
+        t = mltp_create_reserve(sizeof(closure_t), &area);
+        ::new (area) closure_t(std::forward<F>(f));
+        mltp_create_start(t, detail::inline_main<closure_t>, area);
+        return thread(t);
+    }
+    else
+    {
+        closure_t *c = new closure_t(std::forward<F>(f));
+
+        return thread(mltp_create(detail::heap_main<closure_t>, c));
+    }
+}
+
+}   /* namespace mltp */
+
+#endif  /* MLTP_HPP */
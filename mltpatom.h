@@ -0,0 +1,114 @@
+/***************************************************************************
+*                       Portable Atomic Operations
+*
+*   File    : mltpatom.h
+*   Purpose : Atomic operations with explicit memory ordering for mltp
+*             counters, flags, and lock-free lists
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+*   $Id:$
+****************************************************************************
+*   NOTE: The operations are built on the GCC __atomic builtins, which are
+*   what <stdatomic.h> is implemented with.  Unlike the <stdatomic.h>
+*   functions they work on the plain volatile fields mltp already uses,
+*   and this header may be included by C++ code.
+*
+*   The operations are type generic.  They work on int, long, 64-bit, and
+*   pointer objects.
+****************************************************************************
+*
+* MLTP: Multi-Layer thread package for SMP Linux
+* Copyright (C) 2000 by Michael Dipperstein (mdipper@cs.ucsb.edu)
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+***************************************************************************/
+
+#ifndef MLTPATOM_H
+#define MLTPATOM_H
+
+/***************************************************************************
+*                             MEMORY ORDERS
+***************************************************************************/
+
+/***************************************************************************
+* MLTP_RELAXED - atomicity only, for counters and IDs whose values don't
+*                publish other data.
+* MLTP_ACQUIRE - later accesses aren't moved before it, use when taking.
+* MLTP_RELEASE - earlier accesses aren't moved after it, use when handing
+*                off.
+* MLTP_ACQ_REL - both, for read-modify-writes that take and hand off.
+* MLTP_SEQ_CST - one total order, the ordering of mltp_compare_and_swap.
+***************************************************************************/
+#define MLTP_RELAXED    __ATOMIC_RELAXED
+#define MLTP_ACQUIRE    __ATOMIC_ACQUIRE
+#define MLTP_RELEASE    __ATOMIC_RELEASE
+#define MLTP_ACQ_REL    __ATOMIC_ACQ_REL
+#define MLTP_SEQ_CST    __ATOMIC_SEQ_CST
+
+/***************************************************************************
+*                           ATOMIC OPERATIONS
+***************************************************************************/
+
+/* loads and stores */
+#define mltp_atomic_load(p, order)      __atomic_load_n((p), (order))
+#define mltp_atomic_store(p, v, order)  __atomic_store_n((p), (v), (order))
+#define mltp_atomic_load_acquire(p)     __atomic_load_n((p), MLTP_ACQUIRE)
+#define mltp_atomic_store_release(p, v) \
+    __atomic_store_n((p), (v), MLTP_RELEASE)
+
+/* read-modify-writes, each returns the value *p held before */
+#define mltp_atomic_fetch_add(p, v, order) \
+    __atomic_fetch_add((p), (v), (order))
+#define mltp_atomic_fetch_sub(p, v, order) \
+    __atomic_fetch_sub((p), (v), (order))
+#define mltp_atomic_exchange(p, v, order) \
+    __atomic_exchange_n((p), (v), (order))
+
+/***************************************************************************
+* mltp_atomic_cas sets *p to newval if it holds oldval.  It returns
+* non-zero if it did.  Like mltp_compare_and_swap it is a full barrier,
+* but it works on objects of any width up to 64 bits, including pointers.
+*
+* mltp_atomic_cas_acquire is the same, but only orders later accesses.
+* It's used for taking locks and flags.
+***************************************************************************/
+#define mltp_atomic_cas(p, oldval, newval) \
+    __sync_bool_compare_and_swap((p), (oldval), (newval))
+
+#define mltp_atomic_cas_acquire(p, oldval, newval)                          \
+    __extension__ ({                                                        \
+        __typeof__(*(p) + 0) _mltp_expected = (oldval);                     \
+        __atomic_compare_exchange_n((p), &_mltp_expected, (newval), 0,      \
+            MLTP_ACQUIRE, MLTP_RELAXED);                                    \
+    })
+
+/* orders accesses without touching memory */
+#define mltp_atomic_fence(order)        __atomic_thread_fence(order)
+
+/***************************************************************************
+* mltp_cpu_relax is placed in spin loops.  On x86 it's the pause
+* instruction, which tells the processor the loop is waiting on memory.
+* This saves power and leaves the pipeline to the waiting thread's
+* hyper-thread sibling.
+***************************************************************************/
+#if defined(__i386__) || defined(__x86_64__)
+#define mltp_cpu_relax()    __builtin_ia32_pause()
+#else
+#define mltp_cpu_relax()    __asm__ __volatile__("" : : : "memory")
+#endif
+
+#endif /* MLTPATOM_H */
@@ -132,3 +132,22 @@ __inline__ int mltp_compare_and_swap(long oldval, long newval,
                          : "r" (newval), "a" (oldval));
     return (int)ret;
 }
+
+/****************************************************************************
+*   Function   : mltp_find_first_bit
+*   Description: This function finds the least significant bit that is set
+*                in a word.
+*   Parameters : word - word being searched.  It must not be 0.
+*   Effects    : None
+*   Returned   : Index of least significant set bit (0 = lsb, 31 = msb).
+****************************************************************************/
+__inline__ int mltp_find_first_bit(unsigned long word)
+{
+    int bit;
+
+    __asm__("bsfl %1, %0"                       /* scan from lsb up */
+            : "=r" (bit)
+            : "rm" (word));
+
+    return bit;
+}
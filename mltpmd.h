@@ -53,15 +53,35 @@
 #define LOCK_PREFIX ""
 #endif
 
+/***************************************************************************
+* Data written by different processors is kept at least MLTP_CACHE_LINE
+* bytes apart, so writes by one don't invalidate the other's cache line.
+* MLTP_CACHE_ALIGNED starts a type or static object on a cache line and
+* rounds its size up to whole lines.  It is only honored for static
+* objects, so structures that may be allocated use explicit padding.
+***************************************************************************/
+#define MLTP_CACHE_LINE     64
+#define MLTP_CACHE_ALIGNED  __attribute__((aligned(MLTP_CACHE_LINE)))
+
 /***************************************************************************
 *                            ATOMIC FUNCTIONS
 ***************************************************************************/
 
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
 /* function prototypes to keep gcc -Wall happy */
 extern int mltp_test_and_set_bit(int bit, volatile void *addr);
 extern int mltp_test_and_clear_bit(int bit, volatile void *addr);
 extern int mltp_test_and_change_bit(int bit, volatile void *addr);
 extern int mltp_compare_and_swap(long oldval, long newval, volatile void *addr);
+extern int mltp_find_first_bit(unsigned long word);
+
+#ifdef __cplusplus
+}
+#endif
 
 
 /* some hacks to defeat gcc over-optimizations */
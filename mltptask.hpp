@@ -0,0 +1,329 @@
+/***************************************************************************
+*                        C++20 Coroutine Tasks for MLTP
+*
+*   File    : mltptask.hpp
+*   Purpose : Stackless C++20 coroutine tasks scheduled on mltp virtual
+*             processors along with unbound threads
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+*   $Id:$
+****************************************************************************
+*
+* MLTP: Multi-Layer thread package for SMP Linux
+* Copyright (C) 2000 by Michael Dipperstein (mdipper@cs.ucsb.edu)
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+***************************************************************************/
+
+#ifndef MLTPTASK_HPP
+#define MLTPTASK_HPP
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include "mltp.h"
+
+/***************************************************************************
+* A coroutine returning mltp::task is a stackless task.  Its frame holds an
+* mltp_t of type MLTP_THREAD_TASK, so the scheduling policy queues, steals,
+* and wakes it exactly like an unbound thread.  A VP runs the task by
+* resuming the coroutine on its main stack, the coroutine runs until it
+* suspends on one of the awaitables below or returns.
+*
+* Tasks start suspended and are started with spawn.  The frame is freed
+* when the coroutine returns.  Tasks must only co_await the awaitables in
+* this file, and must not call mltp functions that switch threads.
+*
+*   mltp::task worker(mltp_chan_t *in)
+*   {
+*       long msg;
+*
+*       while (co_await mltp::recv(*in, msg) == 0)
+*       {
+*           co_await mltp::yield();
+*       }
+*   }
+*
+*   mltp::executor ex;
+*   ex.spawn(worker(&chan));
+*   ex.run(4);
+***************************************************************************/
+namespace mltp
+{
+
+class task
+{
+public:
+    struct promise_type
+    {
+        mltp_t node;            /* the scheduler's handle for this task */
+
+        task get_return_object() noexcept
+        {
+            handle_type h = handle_type::from_promise(*this);
+
+            mltp_task_init(&node, task::resume, h.address());
+            return task(h);
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        ~promise_type() { mltp_task_done(&node); }
+    };
+
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task(task &&other) noexcept : handle(std::exchange(other.handle, nullptr))
+    {
+    }
+
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+
+    ~task()
+    {
+        /* never spawned */
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    /* gives up the coroutine so it can be handed to the scheduler */
+    mltp_t *release() noexcept
+    {
+        return &(std::exchange(handle, nullptr).promise().node);
+    }
+
+private:
+    explicit task(handle_type h) noexcept : handle(h) {}
+
+    /* task_func of every task, called by a VP to run it */
+    static void resume(void *address)
+    {
+        handle_type::from_address(address).resume();
+    }
+
+    handle_type handle;
+};
+
+/* the mltp_t of the task awaiting, used by the awaitables */
+inline mltp_t *node_of(task::handle_type h) noexcept
+{
+    return &(h.promise().node);
+}
+
+/***************************************************************************
+* spawn makes a task runnable.  It may be called before mltp_start or from
+* running threads and tasks.
+***************************************************************************/
+inline void spawn(task t)
+{
+    mltp_task_spawn(t.release());
+}
+
+/***************************************************************************
+* An executor initializes mltp with a scheduling policy and runs spawned
+* tasks and created threads on VPs until they have all finished.
+***************************************************************************/
+class executor
+{
+public:
+    explicit executor(const mltp_sched_t *sched = &mltp_sched_fifo)
+    {
+        mltp_init_sched(sched);
+    }
+
+    void spawn(task t) { mltp::spawn(std::move(t)); }
+    void run(int vps) { mltp_start(vps); }
+};
+
+/***************************************************************************
+*                               AWAITABLES
+***************************************************************************/
+
+/* co_await yield() puts the task at the end of the run queue */
+struct yield_awaiter
+{
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(task::handle_type h) noexcept
+    {
+        mltp_task_yield(node_of(h));
+    }
+
+    void await_resume() const noexcept {}
+};
+
+inline yield_awaiter yield() noexcept
+{
+    return {};
+}
+
+/* co_await sleep_for(usec) parks the task on its VP's watch list */
+struct sleep_awaiter
+{
+    long usec;
+    mltp_watch_t watch;
+
+    bool await_ready() const noexcept { return (usec <= 0); }
+
+    bool await_suspend(task::handle_type h) noexcept
+    {
+        return (mltp_task_sleep(node_of(h), &watch, usec) != 0);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+inline sleep_awaiter sleep_for(long usec) noexcept
+{
+    return {usec, {}};
+}
+
+/* co_await wait_until(word, old) waits until word != old */
+struct wait_until_awaiter
+{
+    volatile unsigned int *addr;
+    unsigned int old;
+    mltp_watch_t watch;
+
+    bool await_ready() const noexcept { return (*addr != old); }
+
+    bool await_suspend(task::handle_type h) noexcept
+    {
+        return (mltp_task_wait_until(node_of(h), &watch, addr, old) != 0);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+inline wait_until_awaiter wait_until(volatile unsigned int &word,
+                                     unsigned int old) noexcept
+{
+    return {&word, old, {}};
+}
+
+/***************************************************************************
+* co_await lock(l) returns once the task holds l.  Tasks waiting for
+* blocking locks are parked, spin and semaphore locks are obtained right
+* away.  Release the lock with mltp_unlock.
+***************************************************************************/
+struct lock_awaiter
+{
+    mltp_lock_t *lock;
+    mltp_watch_t watch;
+
+    bool await_ready() noexcept { return (mltp_trylock(lock) != 0); }
+
+    bool await_suspend(task::handle_type h) noexcept
+    {
+        return (mltp_task_lock(node_of(h), &watch, lock) != 0);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+inline lock_awaiter lock(mltp_lock_t &l) noexcept
+{
+    return {&l, {}};
+}
+
+/* co_await wait(c) parks the task until c is signalled */
+struct cond_awaiter
+{
+    mltp_cond_t *cond;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(task::handle_type h) noexcept
+    {
+        mltp_task_cond_wait(node_of(h), cond);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+inline cond_awaiter wait(mltp_cond_t &c) noexcept
+{
+    return {&c};
+}
+
+/***************************************************************************
+* co_await send(chan, msg) and co_await recv(chan, msg) perform a channel
+* operation, parking the task if it has to wait.  Both return 0 for
+* success or -1 if the channel is closed.  send copies msg, so it may be a
+* temporary.
+***************************************************************************/
+struct chan_awaiter
+{
+    mltp_task_chan_t op;
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(task::handle_type h) noexcept
+    {
+        return (mltp_task_chan(node_of(h), &op) != 0);
+    }
+
+    int await_resume() const noexcept { return op.waiter.status; }
+};
+
+template <class T>
+struct send_awaiter : chan_awaiter
+{
+    T msg;
+
+    bool await_suspend(task::handle_type h) noexcept
+    {
+        /* msg has reached its final address */
+        op.sel.msg = &msg;
+        return chan_awaiter::await_suspend(h);
+    }
+};
+
+template <class T>
+inline send_awaiter<T> send(mltp_chan_t &chan, const T &msg)
+{
+    send_awaiter<T> a{};
+
+    a.op.sel.chan = &chan;
+    a.op.sel.op = MLTP_CHAN_SEND;
+    a.msg = msg;
+    return a;
+}
+
+template <class T>
+inline chan_awaiter recv(mltp_chan_t &chan, T &msg) noexcept
+{
+    chan_awaiter a{};
+
+    a.op.sel.chan = &chan;
+    a.op.sel.op = MLTP_CHAN_RECV;
+    a.op.sel.msg = &msg;
+    return a;
+}
+
+}   /* namespace mltp */
+
+#endif  /* MLTPTASK_HPP */
@@ -0,0 +1,253 @@
+/***************************************************************************
+*                       MLTP Thread Attributes
+*
+*   File    : attr.c
+*   Purpose : Verify threads created with mltp_create_attr get the stack,
+*             private storage, and detach state they asked for, and that
+*             stack profiling sees how deep they go
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+*   $Id: $
+****************************************************************************
+*
+* MLTP: Multi-Layer thread package for SMP Linux
+* Copyright (C) 2000 by Michael Dipperstein (mdipper@cs.ucsb.edu)
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+***************************************************************************/
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "mltp.h"
+
+/***************************************************************************
+*                                CONSTANTS
+***************************************************************************/
+#define HANDLERS    1000    /* small detached threads per pass */
+#define DEEP_STACK  (MLTP_STACK_CLASS_MAX)
+#define DEPTH       1000    /* recursion depth of the deep thread */
+#define FRAME       512     /* bytes of stack used by each recursion */
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+volatile int handlerCount;          /* number of handler threads run */
+volatile int privateErrors;         /* handlers with unexpected private data */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Recurse
+*   Description: This function recurses depth times, using about FRAME
+*                bytes of stack at each level.
+*   Parameters : depth - number of levels left
+*   Effects    : None
+*   Returned   : Sum of the first bytes of every frame's buffer
+****************************************************************************/
+static long Recurse(int depth)
+{
+    volatile char buffer[FRAME];
+
+    buffer[0] = (char)(depth & 0x7F);
+
+    if (depth == 0)
+    {
+        return buffer[0];
+    }
+
+    return buffer[0] + Recurse(depth - 1);
+}
+
+
+/****************************************************************************
+*   Function   : DeepProc
+*   Description: This is the thread function for the thread created with a
+*                large stack.  It recurses well past MLTP_STKSIZE.
+*   Parameters : unused - not used
+*   Effects    : None
+*   Returned   : Result of the recursion
+****************************************************************************/
+static void *DeepProc(void *unused)
+{
+    return (void *)Recurse(DEPTH);
+}
+
+
+/****************************************************************************
+*   Function   : HandlerProc
+*   Description: This is the thread function for the small detached
+*                threads.  They are created without private storage.
+*   Parameters : unused - not used
+*   Effects    : handlerCount is incremented, privateErrors is incremented
+*                if the thread has private storage.
+*   Returned   : NULL
+****************************************************************************/
+static void *HandlerProc(void *unused)
+{
+    mltp_vp_local_t *mltp_vp_local;
+
+    /* stay on this VP while looking at its current thread */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+
+    if (mltp_get_private() != NULL)
+    {
+        mltp_atomic_fetch_add(&privateErrors, 1, MLTP_RELAXED);
+    }
+
+    MLTP_PREEMPT_ON();
+
+    mltp_atomic_fetch_add(&handlerCount, 1, MLTP_RELAXED);
+    return NULL;
+}
+
+
+/****************************************************************************
+*   Function   : CreatorProc
+*   Description: This is the thread function for the unbound thread that
+*                creates the other threads.  Handlers get the smallest
+*                stack, no private storage, and are spread across VPs.  The
+*                deep thread gets the largest pooled stack and is joined.
+*   Parameters : vps - number of virtual processors
+*   Effects    : Results are written to stdout.
+*   Returned   : Result of the deep thread
+****************************************************************************/
+static void *CreatorProc(void *vps)
+{
+    mltp_attr_t attr;
+    mltp_t *deep;
+    void *retval;
+    int i;
+
+    mltp_attr_init(&attr);
+    attr.stksize = MLTP_STACK_MIN;
+    attr.private_size = 0;
+    attr.detached = 1;
+    attr.name = "handler";
+
+    for (i = 0; i < HANDLERS; i++)
+    {
+        attr.vp = i % (long)vps;
+        mltp_create_attr(&attr, HandlerProc, NULL);
+    }
+
+    mltp_attr_init(&attr);
+    attr.stksize = DEEP_STACK;
+    attr.priority = 1;
+    attr.name = "deep";
+    deep = mltp_create_attr(&attr, DeepProc, NULL);
+
+    if (mltp_join(deep, &retval) != 0)
+    {
+        printf("\tFailed to join deep thread\n");
+        return NULL;
+    }
+
+    printf("\t%s thread with %u byte stack returned %ld\n", deep->name,
+        (unsigned)deep->stksize, (long)retval);
+    free(deep);
+
+    return retval;
+}
+
+
+/****************************************************************************
+*   Function   : ThreadTest
+*   Description: This function is responsible for creating and dispatching
+*                the creator thread under the work stealing policy.  The
+*                stacks of all threads are profiled.
+*   Parameters : n - number of times to repeate the process
+*                vps - number of virtual processors
+*   Effects    : Stack use report is written to stdout.
+*   Returned   : None
+****************************************************************************/
+void ThreadTest(int n, int vps)
+{
+    mltp_t *creator;
+    int pass = 0;
+
+    mltp_init_sched(&mltp_sched_steal);
+    mltp_set_stack_profile(1);
+
+    while (pass < n)
+    {
+        pass++;
+        handlerCount = 0;
+        privateErrors = 0;
+
+        printf("Pass %d of %d\n", pass, n);
+        creator = mltp_create(CreatorProc, (void *)(long)vps);
+        mltp_start(vps);
+        free(creator);
+
+        printf("\t%d handler threads ran, %d had private storage\n\n",
+            handlerCount, privateErrors);
+    }
+
+    mltp_set_stack_profile(0);
+    mltp_stack_report();
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This function is the entry and exit point for the program.
+*                It parses the input for an itteration count and VP count
+*                and then uses those value to call the function that kicks
+*                off the testing.
+*   Parameters : argc - number of arguments (should be 1, 2, or 3)
+*                argv - list of arguments
+*   Effects    : None
+*   Returned   : 0 is returned upon completion
+****************************************************************************/
+int main (int argc, char **argv)
+{
+    int n, vps;
+
+    n = 3;
+    vps = 2;
+
+    if (argc > 1)
+    {
+        n = atoi(argv[1]);
+
+        if (n <= 0)
+        {
+            n = 1;
+        }
+    }
+
+    if (argc > 2)
+    {
+        vps = atoi(argv[2]);
+
+        if (vps <= 0)
+        {
+            vps = 1;
+        }
+    }
+
+    /* run the test */
+    ThreadTest(n, vps);
+
+    return(0);
+}
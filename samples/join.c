@@ -0,0 +1,237 @@
+/***************************************************************************
+*                    MLTP Thread Joining and Detaching
+*
+*   File    : join.c
+*   Purpose : Verify mltp join and detach primitives, and looking up
+*             threads by ID
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+*   $Id: $
+****************************************************************************
+*
+* MLTP: Multi-Layer thread package for SMP Linux
+* Copyright (C) 2000 by Michael Dipperstein (mdipper@cs.ucsb.edu)
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+***************************************************************************/
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "mltp.h"
+
+/***************************************************************************
+*                                CONSTANTS
+***************************************************************************/
+#define WORKERS     8       /* joinable threads per pass */
+#define DETACHED    1000    /* detached threads per pass */
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+mltp_lock_t countLock;              /* protects detachedCount */
+volatile int detachedCount;         /* number of detached threads run */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : WorkerProc
+*   Description: This is the thread function for joinable threads.  It
+*                yields once so that its joiner is likely to be parked when
+*                it exits.
+*   Parameters : n - worker number
+*   Effects    : None
+*   Returned   : The square of the worker number
+****************************************************************************/
+static void *WorkerProc(void *n)
+{
+    mltp_yield();
+    return (void *)((long)n * (long)n);
+}
+
+
+/****************************************************************************
+*   Function   : DetachedProc
+*   Description: This is the thread function for detached threads.  It
+*                counts the number of detached threads that ran.
+*   Parameters : unused - not used
+*   Effects    : detachedCount is incremented
+*   Returned   : NULL
+****************************************************************************/
+static void *DetachedProc(void *unused)
+{
+    mltp_lock(&countLock);
+    detachedCount++;
+    mltp_unlock(&countLock);
+
+    return NULL;
+}
+
+
+/****************************************************************************
+*   Function   : JoinerProc
+*   Description: This is the thread function for the unbound thread that
+*                creates and joins the workers.  It also spawns detached
+*                threads which it never waits for.  The joiner must be
+*                found by its ID, and joined workers must not be.
+*   Parameters : unused - not used
+*   Effects    : Worker return values are written to stdout.
+*   Returned   : Sum of the worker return values
+****************************************************************************/
+static void *JoinerProc(void *unused)
+{
+    mltp_t *workers[WORKERS];
+    mltp_id_t id;
+    void *retval;
+    mltp_vp_local_t *mltp_vp_local;
+    mltp_t *self;
+    long sum;
+    int i;
+
+    /* stay on this VP while looking at its current thread */
+    MLTP_PREEMPT_OFF();
+    mltp_vp_local = (mltp_vp_local_t *)jkthread_getlocal();
+    self = mltp_vp_local->vp_curr;
+    MLTP_PREEMPT_ON();
+
+    if (mltp_lookup(self->thrid) != self)
+    {
+        printf("\tJoiner not found by ID %lld\n", self->thrid);
+    }
+
+    for (i = 0; i < WORKERS; i++)
+    {
+        workers[i] = mltp_create(WorkerProc, (void *)(long)i);
+    }
+
+    /* spawn and forget, descriptors are recycled as the threads exit */
+    for (i = 0; i < DETACHED; i++)
+    {
+        mltp_detach(mltp_create(DetachedProc, NULL));
+    }
+
+    sum = 0;
+
+    for (i = 0; i < WORKERS; i++)
+    {
+        id = workers[i]->thrid;
+
+        if (mltp_join(workers[i], &retval) != 0)
+        {
+            printf("\tFailed to join worker %d\n", i);
+            continue;
+        }
+
+        if (mltp_lookup(id) != NULL)
+        {
+            printf("\tExited worker %d found by ID %lld\n", i, id);
+        }
+
+        printf("\tWorker %d returned %ld\n", i, (long)retval);
+        sum += (long)retval;
+        free(workers[i]);
+    }
+
+    return (void *)sum;
+}
+
+
+/****************************************************************************
+*   Function   : ThreadTest
+*   Description: This function is responsible for creating and dispatching
+*                the joining thread, and then joining it from the main
+*                thread.
+*   Parameters : n - number of times to repeate the process
+*                vps - number of virtual processors
+*   Effects    : None
+*   Returned   : None
+****************************************************************************/
+void ThreadTest(int n, int vps)
+{
+    mltp_t *joiner;
+    void *retval;
+    int pass = 0;
+
+    mltp_init();
+    mltp_lock_init(&countLock, MLTP_LOCK_STD);
+
+    while (pass < n)
+    {
+        pass++;
+        detachedCount = 0;
+
+        printf("Pass %d of %d\n", pass, n);
+        joiner = mltp_create(JoinerProc, NULL);
+        mltp_start(vps);
+
+        /* joiner has exited, this won't block */
+        mltp_join(joiner, &retval);
+        free(joiner);
+
+        printf("\tWorker sum %ld, %d detached threads ran\n\n",
+            (long)retval, detachedCount);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This function is the entry and exit point for the program.
+*                It parses the input for an itteration count and VP count
+*                and then uses those value to call the function that kicks
+*                off the testing.
+*   Parameters : argc - number of arguments (should be 1, 2, or 3)
+*                argv - list of arguments
+*   Effects    : None
+*   Returned   : 0 is returned upon completion
+****************************************************************************/
+int main (int argc, char **argv)
+{
+    int n, vps;
+
+    n = 3;
+    vps = 2;
+
+    if (argc > 1)
+    {
+        n = atoi(argv[1]);
+
+        if (n <= 0)
+        {
+            n = 1;
+        }
+    }
+
+    if (argc > 2)
+    {
+        vps = atoi(argv[2]);
+
+        if (vps <= 0)
+        {
+            vps = 1;
+        }
+    }
+
+    /* run the test */
+    ThreadTest(n, vps);
+
+    return(0);
+}
@@ -0,0 +1,174 @@
+/***************************************************************************
+*                        MLTP C++ Wrapper Test
+*
+*   File    : lambda.cpp
+*   Purpose : Verify lambda spawning, thread handles, and the RAII lock
+*             guards in mltp.hpp
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+*   $Id: $
+****************************************************************************
+*
+* MLTP: Multi-Layer thread package for SMP Linux
+* Copyright (C) 2000 by Michael Dipperstein (mdipper@cs.ucsb.edu)
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+***************************************************************************/
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include "mltp.hpp"
+
+/***************************************************************************
+*                                CONSTANTS
+***************************************************************************/
+#define WORKERS     16      /* threads spawned by each test */
+#define INCREMENTS  1000    /* increments made by each worker */
+#define BIG         2048    /* bytes captured by the large closure */
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+mltp::block_lock blockLock;         /* protects blockCount */
+mltp::spin_lock spinLock;           /* protects spinCount */
+mltp_lock_t rawLock;                /* protects rawCount */
+volatile long blockCount;           /* incremented under blockLock */
+volatile long spinCount;            /* incremented under spinLock */
+volatile long rawCount;             /* incremented under rawLock */
+volatile int errors;                /* number of failed checks */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Parent
+*   Description: This function is run by the first thread.  It spawns
+*                workers from lambdas that capture their worker number,
+*                joins them, and checks their results.
+*   Parameters : None
+*   Effects    : errors is incremented for each failed check.
+*   Returned   : None
+****************************************************************************/
+static void Parent(void)
+{
+    mltp::thread workers[WORKERS];
+    char big[BIG];
+    long i;
+
+    /* small closures live on the workers' stacks */
+    for (i = 0; i < WORKERS; i++)
+    {
+        workers[i] = mltp::spawn([i]() -> void *
+        {
+            int j;
+
+            for (j = 0; j < INCREMENTS; j++)
+            {
+                {
+                    mltp::lock_guard guard(blockLock);
+                    blockCount = blockCount + 1;
+                }
+
+                {
+                    mltp::unique_lock<mltp::spin_lock> guard(spinLock);
+                    spinCount = spinCount + 1;
+                    guard.unlock();
+                }
+
+                {
+                    mltp::lock_guard guard(rawLock);
+                    rawCount = rawCount + 1;
+                }
+            }
+
+            return (void *)(i + 1);
+        });
+    }
+
+    for (i = 0; i < WORKERS; i++)
+    {
+        if (workers[i].join() != (void *)(i + 1))
+        {
+            printf("join: worker %ld returned the wrong value\n", i);
+            errors = errors + 1;
+        }
+    }
+
+    if ((blockCount != WORKERS * INCREMENTS) ||
+        (spinCount != WORKERS * INCREMENTS) ||
+        (rawCount != WORKERS * INCREMENTS))
+    {
+        printf("locks: counts are %ld %ld %ld, expected %d\n", blockCount,
+            spinCount, rawCount, WORKERS * INCREMENTS);
+        errors = errors + 1;
+    }
+
+    /* a closure too large for the stack reserve is allocated */
+    for (i = 0; i < BIG; i++)
+    {
+        big[i] = (char)i;
+    }
+
+    mltp::thread large = mltp::spawn([big]()
+    {
+        long k;
+
+        for (k = 0; k < BIG; k++)
+        {
+            if (big[k] != (char)k)
+            {
+                printf("large: closure copy is corrupt\n");
+                errors = errors + 1;
+                break;
+            }
+        }
+    });
+
+    large.join();
+
+    /* a detached thread frees itself */
+    mltp::spawn([]() { }).detach();
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the main function for the C++ wrapper test.
+*   Parameters : argc - number of parameters
+*                argv - parameter list
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 if all tests pass, otherwise 1
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    mltp_init();
+    mltp_lock_init(&rawLock, MLTP_LOCK_BLOCK_FRONT);
+    blockCount = 0;
+    spinCount = 0;
+    rawCount = 0;
+    errors = 0;
+
+    mltp::thread parent = mltp::spawn(Parent);
+    mltp_start(4);
+    parent.join();
+
+    printf("lambda: %s\n", errors ? "FAILED" : "passed");
+    return (errors ? 1 : 0);
+}
@@ -40,6 +40,8 @@
 ***************************************************************************/
 /* one lock of each */
 mltp_lock_t spinLock, blockLock, frontBlockLock, semLock;
+mltp_spinlock_t typedSpinLock = MLTP_SPINLOCK_INITIALIZER;
+mltp_mutex_t mutex = MLTP_MUTEX_INITIALIZER;
 
 mltp_barrier_t barrier; /* barrier between lock acquisitions */
 
@@ -104,6 +106,28 @@ void *Test(int id, int threads)
 
     mltp_unlock(&semLock);
 
+    /* wait for everyone to finish */
+    mltp_barrier(&barrier, threads);
+
+    /* every one go through a statically typed spin lock */
+    mltp_spinlock_lock(&typedSpinLock);
+
+    printf("Thread %02d of %02d acquired typed spin lock\n", id, threads);
+    for(i = 0; i < 1000000; i++);
+
+    mltp_spinlock_unlock(&typedSpinLock);
+
+    /* wait for everyone to finish */
+    mltp_barrier(&barrier, threads);
+
+    /* every one go through a mutex */
+    mltp_mutex_lock(&mutex);
+
+    printf("Thread %02d of %02d acquired mutex\n", id, threads);
+    for(i = 0; i < 1000000; i++);
+
+    mltp_mutex_unlock(&mutex);
+
     return(NULL);
 }
 
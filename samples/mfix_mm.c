@@ -479,11 +479,7 @@ int main(int argc, char *argv[])
     t1 = gettime();
 
     /* Make a thread for each process */
-    for (i = 0; i < nproc; i++)
-    {
-        threads[i] = mltp_create(
-            (mltp_userf_t*)work, NULL);
-    }
+    mltp_create_n(nproc, (mltp_userf_t*)work, NULL, threads);
 
     /* Run the threads */
     mltp_start(numvp);
@@ -0,0 +1,203 @@
+/***************************************************************************
+*                        MLTP C++20 Coroutine Tasks
+*
+*   File    : tasks.cpp
+*   Purpose : Verify stackless tasks and their awaitables, running along
+*             with unbound threads
+*   Author  : Michael Dipperstein
+*   Date    : October 19, 2026
+*
+*   $Id: $
+****************************************************************************
+*
+* MLTP: Multi-Layer thread package for SMP Linux
+* Copyright (C) 2000 by Michael Dipperstein (mdipper@cs.ucsb.edu)
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Lesser General Public
+* License as published by the Free Software Foundation; either
+* version 2.1 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public
+* License along with this library; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*
+***************************************************************************/
+
+/***************************************************************************
+*                             INCLUDED FILES
+***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "mltptask.hpp"
+
+/***************************************************************************
+*                                CONSTANTS
+***************************************************************************/
+#define WORKERS     16      /* tasks incrementing the shared counter */
+#define INCREMENTS  100     /* increments made by each worker */
+#define MESSAGES    1000    /* messages passed from thread to task */
+
+/***************************************************************************
+*                            GLOBAL VARIABLES
+***************************************************************************/
+mltp_lock_t countLock;              /* protects count */
+volatile long count;                /* incremented by workers */
+mltp_chan_t chan;                   /* thread to task channel */
+volatile long received;             /* sum of messages received by task */
+volatile int slept;                 /* non-zero once sleeper is done */
+
+/***************************************************************************
+*                                FUNCTIONS
+***************************************************************************/
+
+/****************************************************************************
+*   Function   : Worker
+*   Description: This task increments the shared counter under a blocking
+*                lock, yielding while it holds the lock so that other
+*                workers have to wait for it.
+*   Parameters : None
+*   Effects    : count is incremented INCREMENTS times.
+*   Returned   : None
+****************************************************************************/
+static mltp::task Worker(void)
+{
+    long value;
+    int i;
+
+    for (i = 0; i < INCREMENTS; i++)
+    {
+        co_await mltp::lock(countLock);
+        value = count;
+        co_await mltp::yield();
+        count = value + 1;
+        mltp_unlock(&countLock);
+    }
+}
+
+
+/****************************************************************************
+*   Function   : Receiver
+*   Description: This task sums the messages sent on chan until it is
+*                closed.
+*   Parameters : None
+*   Effects    : received is set to the sum of the messages.
+*   Returned   : None
+****************************************************************************/
+static mltp::task Receiver(void)
+{
+    long msg, sum;
+
+    sum = 0;
+
+    while (co_await mltp::recv(chan, msg) == 0)
+    {
+        sum += msg;
+    }
+
+    received = sum;
+}
+
+
+/****************************************************************************
+*   Function   : Sleeper
+*   Description: This task sleeps for a short time.
+*   Parameters : None
+*   Effects    : slept is set once the task wakes up.
+*   Returned   : None
+****************************************************************************/
+static mltp::task Sleeper(void)
+{
+    co_await mltp::sleep_for(10000);
+    slept = 1;
+}
+
+
+/****************************************************************************
+*   Function   : SenderProc
+*   Description: This is the thread function of an unbound thread sending
+*                messages to the Receiver task.
+*   Parameters : unused - not used
+*   Effects    : MESSAGES messages are sent on chan, then it is closed.
+*   Returned   : NULL
+****************************************************************************/
+static void *SenderProc(void *unused)
+{
+    long i;
+
+    for (i = 1; i <= MESSAGES; i++)
+    {
+        mltp_chan_send(&chan, &i);
+    }
+
+    mltp_chan_close(&chan);
+    return NULL;
+}
+
+
+/****************************************************************************
+*   Function   : main
+*   Description: This is the main function for the task test.  It runs
+*                workers contending for a lock, a task receiving from a
+*                thread over an unbuffered channel, and a sleeping task.
+*   Parameters : argc - number of parameters
+*                argv - parameter list
+*   Effects    : Results are written to stdout.
+*   Returned   : 0 if all tests pass, otherwise 1
+****************************************************************************/
+int main(int argc, char *argv[])
+{
+    mltp::executor ex(&mltp_sched_steal);
+    mltp_t *sender;
+    int i, errors;
+
+    mltp_lock_init(&countLock, MLTP_LOCK_BLOCK);
+    mltp_chan_init(&chan, sizeof(long), 0);
+    count = 0;
+    received = 0;
+    slept = 0;
+
+    for (i = 0; i < WORKERS; i++)
+    {
+        ex.spawn(Worker());
+    }
+
+    ex.spawn(Receiver());
+    ex.spawn(Sleeper());
+    sender = mltp_create(SenderProc, NULL);
+
+    ex.run(4);
+
+    errors = 0;
+
+    if (count != WORKERS * INCREMENTS)
+    {
+        printf("lock: count is %ld, expected %d\n", count,
+            WORKERS * INCREMENTS);
+        errors++;
+    }
+
+    if (received != ((long)MESSAGES * (MESSAGES + 1)) / 2)
+    {
+        printf("channel: received %ld, expected %ld\n", received,
+            ((long)MESSAGES * (MESSAGES + 1)) / 2);
+        errors++;
+    }
+
+    if (!slept)
+    {
+        printf("sleep: sleeper didn't wake\n");
+        errors++;
+    }
+
+    free(sender);
+    mltp_chan_destroy(&chan);
+
+    printf("tasks: %s\n", errors ? "FAILED" : "passed");
+    return (errors ? 1 : 0);
+}